@@ -40,11 +40,14 @@ This source file is part of the
 
 #include "effect/PostEffectManager.h"
 #include "effect/PostEffect.h"
+#include "effect/PostEffectProgramCache.h"
+#include "effect/PostEffectQualityGovernor.h"
 
 const Ogre::Real MinimalOgre::ROTATION_VELOCITY = static_cast<Ogre::Real>(100.0);
 const Ogre::Real MinimalOgre::ZOOM_VELOCITY = static_cast<Ogre::Real>(1000.0);
 const Ogre::Real MinimalOgre::HEAD_SCALE_MIN = static_cast<Ogre::Real>(0.1);
 const Ogre::Real MinimalOgre::HEAD_SCALE_MAX = static_cast<Ogre::Real>(2.0);
+const Ogre::String MinimalOgre::SHADER_BINARIES_FILE = "PostEffectShaders.cache";
 
 //-------------------------------------------------------------------------------------
 MinimalOgre::MinimalOgre(void)
@@ -62,13 +65,18 @@ MinimalOgre::MinimalOgre(void)
     mInputManager(0),
     mMouse(0),
     mKeyboard(0),
-	mOverlaySystem(0)
+	mOverlaySystem(0),
+    mQualityGovernor(0)
 {
 }
 //-------------------------------------------------------------------------------------
 MinimalOgre::~MinimalOgre(void)
 {
     if (mTrayMgr) delete mTrayMgr;
+    if (mQualityGovernor) delete mQualityGovernor;
+    if (mWindow) OgreEffect::PostEffectManager::getSingleton().GetProgramCache().SaveBinaries(SHADER_BINARIES_FILE);
+    //effects and their materials should be released while the render system is alive
+    OgreEffect::PostEffectManager::getSingleton().Shutdown();
     //if (mCameraMan) delete mCameraMan;
 	if (mOverlaySystem) delete mOverlaySystem;
  
@@ -265,6 +273,14 @@ void MinimalOgre::checkBoxToggled(OgreBites::CheckBox* box)
     }
 }
 
+bool MinimalOgre::frameStarted(const Ogre::FrameEvent& evt)
+{
+    (void)evt;
+    //the effects should be updated before the frame is rendered
+    OgreEffect::PostEffectManager::getSingleton().Update();
+    return true;
+}
+
 bool MinimalOgre::frameRenderingQueued(const Ogre::FrameEvent& evt)
 {
     if(mWindow->isClosed())
@@ -278,6 +294,11 @@ bool MinimalOgre::frameRenderingQueued(const Ogre::FrameEvent& evt)
     mMouse->capture();
  
     mTrayMgr->frameRenderingQueued(evt);
+
+    if (mQualityGovernor)
+    {
+        mQualityGovernor->NotifyFrame(evt.timeSinceLastFrame);
+    }
     /*
     if (!mTrayMgr->isDialogVisible())
     {
@@ -463,6 +484,8 @@ void MinimalOgre::windowResized(Ogre::RenderWindow* rw)
     const OIS::MouseState &ms = mMouse->getMouseState();
     ms.width = width;
     ms.height = height;
+
+    OgreEffect::PostEffectManager::getSingleton().NotifyWindowResized(rw);
 }
  
 //Unattach OIS before window shutdown (very important under Linux)
@@ -636,6 +659,9 @@ void MinimalOgre::SetupScene()
 
 void MinimalOgre::SetupPostEffects()
 {
+    //Skip compiling the effects' shaders if they were linked by the previous run with the same driver
+    OgreEffect::PostEffectManager::getSingleton().GetProgramCache().LoadBinaries(SHADER_BINARIES_FILE);
+
     //OgreEffect::PostEffect* postEffect = OgreEffect::PostEffectManager::getSingleton().CreatePostEffect(OgreEffect::PostEffectManager::PE_NULL, mWindow, mCamera->getViewport());
     //OgreEffect::PostEffect* postEffect = OgreEffect::PostEffectManager::getSingleton().CreatePostEffect(OgreEffect::PostEffectManager::PE_FADING, mWindow, mCamera->getViewport());
     //OgreEffect::PostEffect* postEffect = OgreEffect::PostEffectManager::getSingleton().CreatePostEffect(OgreEffect::PostEffectManager::PE_BLUR, mWindow, mCamera->getViewport());
@@ -647,6 +673,12 @@ void MinimalOgre::SetupPostEffects()
     //}
 
 
+    //All effects start disabled, so build them only when they are switched on and release after a minute of idling
+    OgreEffect::PostEffectManager::getSingleton().SetLazyBuildEnabled(true);
+    OgreEffect::PostEffectManager::getSingleton().SetReleaseTimeout(60.0f);
+    //Bloom and GodRays are adjacent, so they share the downsampled scene
+    OgreEffect::PostEffectManager::getSingleton().SetScenePyramidEnabled(true);
+
     auto postEffects = OgreEffect::PostEffectManager::getSingleton().CreatePostEffectsChain({
 #ifdef TEST_EFFECTS
         "DownsampleTest",
@@ -660,13 +692,16 @@ void MinimalOgre::SetupPostEffects()
         OgreEffect::PostEffectManager::PE_GODRAYS,
         OgreEffect::PostEffectManager::PE_FADING,
         OgreEffect::PostEffectManager::PE_RAIN,
-    }, mWindow, mCamera->getViewport(), true);
+    }, mWindow, mCamera->getViewport());
 
     for (OgreEffect::PostEffect* effect : postEffects)
     {
         mPostEffects["CheckBox/" + effect->GetName()] = effect;
     }
 
+    //Hold 60 fps by lowering quality of the most expensive effects
+    mQualityGovernor = new OgreEffect::PostEffectQualityGovernor(OgreEffect::PostEffectManager::getSingletonPtr(), 1.0f / 60.0f);
+
 }
 
  
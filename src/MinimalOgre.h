@@ -50,6 +50,7 @@ This source file is part of the
 namespace OgreEffect
 {
     class PostEffect;
+    class PostEffectQualityGovernor;
 }
 
 class MinimalOgre : public Ogre::FrameListener, 
@@ -68,6 +69,7 @@ protected:
     static const Ogre::Real ZOOM_VELOCITY;
     static const Ogre::Real HEAD_SCALE_MIN;
     static const Ogre::Real HEAD_SCALE_MAX;
+    static const Ogre::String SHADER_BINARIES_FILE;
 
     Ogre::Root *mRoot;
     Ogre::Camera* mCamera;
@@ -92,6 +94,7 @@ protected:
     OIS::Keyboard* mKeyboard;
  
     // Ogre::FrameListener
+    virtual bool frameStarted(const Ogre::FrameEvent& evt);
     virtual bool frameRenderingQueued(const Ogre::FrameEvent& evt);
  
     // OIS::KeyListener
@@ -124,6 +127,8 @@ private:
     using PostEffectsMap = OGRE_HashMap<Ogre::String, OgreEffect::PostEffect*>;
     PostEffectsMap mPostEffects;
 
+    OgreEffect::PostEffectQualityGovernor* mQualityGovernor;
+
     void SetupEffectsGui();
 	void CreateMaterials();
 	void SetupScene();
@@ -9,9 +9,13 @@
 */
 
 #include <string>
-#include <array>
+#include <algorithm>
 
 #include "PostEffect.h"
+#include "PostEffectManager.h"
+#include "PostEffectProgramCache.h"
+#include "PostEffectPrototypeRegistry.h"
+#include "PostEffectScenePyramid.h"
 
 #include <OgreCompositorManager.h>
 #include <OgreRenderWindow.h>
@@ -19,11 +23,13 @@
 #include <OgreCompositionTargetPass.h>
 #include <OgreCompositionPass.h>
 #include <OgreCompositorChain.h>
+#include <OgreViewport.h>
 #include <OgreTechnique.h>
 #include <OgreMaterial.h>
 #include <OgrePass.h>
 #include <OgreTimer.h>
 #include <OgreTextureManager.h>
+#include <OgreStringConverter.h>
 
 namespace OgreEffect
 {
@@ -33,7 +39,68 @@ namespace OgreEffect
     const Ogre::String PostEffect::TEXTURE_MARKER_PREVIOUS = "TM_Previous";
     const Ogre::String PostEffect::TEXTURE_MARKER_SCENE = "TM_Scene";
 
-    OGRE_HashMap<Ogre::String, PostEffect::MaterialsVector> PostEffect::msMaterialPrototypesMap = {};
+    const Ogre::String PostEffect::PIXEL_FUNCTION_PREFIX = "$";
+
+    const Ogre::String PostEffect::FRAME_TIME_UNIFORM = "pe_FrameTime";
+    const Ogre::String PostEffect::RESOLUTION_UNIFORM = "pe_Resolution";
+
+    namespace
+    {
+        //StringInterface adapter of the typed parameters; One command serves the parameter with the same id of all effect types
+        class CmdTypedParameter : public Ogre::ParamCommand
+        {
+            const PostEffect::ParameterId mId;
+
+        public:
+            explicit CmdTypedParameter(PostEffect::ParameterId id) :
+                mId(id)
+            { }
+
+            Ogre::String doGet(const void* target) const override
+            {
+                return static_cast<const PostEffect*>(static_cast<const Ogre::StringInterface*>(target))->GetParameterAsString(mId);
+            }
+
+            void doSet(void* target, const Ogre::String& val) override
+            {
+                static_cast<PostEffect*>(static_cast<Ogre::StringInterface*>(target))->SetParameterFromString(mId, val);
+            }
+        };
+        //-------------------------------------------------------
+
+        Ogre::ParamCommand* GetTypedParameterCommand(PostEffect::ParameterId id)
+        {
+            //commands should live as long as the dictionaries
+            static Ogre::vector<Ogre::SharedPtr<CmdTypedParameter> >::type commands;
+            while (commands.size() <= id)
+            {
+                commands.push_back(Ogre::SharedPtr<CmdTypedParameter>(new CmdTypedParameter(commands.size())));
+            }
+            return commands[id].get();
+        }
+        //-------------------------------------------------------
+
+        Ogre::ParameterType GetStringInterfaceType(PostEffect::ParameterType type)
+        {
+            switch (type)
+            {
+            case PostEffect::VT_FLOAT:
+                return Ogre::PT_REAL;
+            case PostEffect::VT_VECTOR3:
+                return Ogre::PT_VECTOR3;
+            case PostEffect::VT_COLOUR:
+                return Ogre::PT_COLOURVALUE;
+            case PostEffect::VT_INT:
+                return Ogre::PT_INT;
+            case PostEffect::VT_BOOL:
+                return Ogre::PT_BOOL;
+            default:
+                //StringInterface has no 2 and 4 components vectors
+                return Ogre::PT_STRING;
+            }
+        }
+    }
+    //-------------------------------------------------------
 
     //-------------------------------------------------------
     void PostEffect::CreateDummyTexture(const Ogre::String & name)
@@ -48,27 +115,251 @@ namespace OgreEffect
         Ogre::TextureManager::getSingleton().remove(name);
     }
     //-------------------------------------------------------
-    void PostEffect::CreateMarkerDummies()
+    void PostEffect::CreateParametersDictionary()
     {
-        for (const Ogre::String & name: { TEXTURE_MARKER_PREVIOUS, TEXTURE_MARKER_SCENE })
+        //Effect types have different parameters, so every type has its own dictionary
+        if (createParamDictionary(DICTIONARY_NAME + "/" + mTypeName))
         {
-            if (true == Ogre::TextureManager::getSingleton().getByName(name).isNull())
+            Ogre::ParamDictionary* dictionary = getParamDictionary();
+            if (nullptr != dictionary)
             {
-                CreateDummyTexture(name);
+                for (ParameterId id = 0; id < mParameters.size(); ++id)
+                {
+                    const Parameter & parameter = mParameters[id];
+                    dictionary->addParameter(Ogre::ParameterDef(parameter.name, parameter.description, GetStringInterfaceType(parameter.type)),
+                        GetTypedParameterCommand(id));
+                }
+                DoCreateParametersDictionary(dictionary);
             }
         }
     }
     //-------------------------------------------------------
-    void PostEffect::CreateParametersDictionary()
+    void PostEffect::ResetInstance()
     {
-        if (createParamDictionary(DICTIONARY_NAME))
+        if (false == mDefaultParametersSaved)
         {
-            Ogre::ParamDictionary* dictionary = getParamDictionary();
-            if (nullptr != dictionary)
+            mDefaultParameters = mParameters;
+            mDefaultParametersSaved = true;
+            return;
+        }
+        mParameters = mDefaultParameters;
+        mRebuildRequired = false;
+        mEnabled = false;
+        mCulled = false;
+        mCullRequests = 0;
+        mStartTime = -1;
+        mLastUpdateFrame = static_cast<unsigned long>(-1);
+        mLastUpdateTime = -1;
+        DoReset();
+    }
+    //-------------------------------------------------------
+    PostEffect::ParameterId PostEffect::AddParameter(const Ogre::String & name, const Ogre::String & description, ParameterType type, bool rebuild /* = false */)
+    {
+        if (INVALID_PARAMETER != GetParameterId(name))
+        {
+            OGRE_EXCEPT(Ogre::Exception::ERR_DUPLICATE_ITEM, "Parameter " + name + " is already registered", "PostEffect[AddParameter]");
+        }
+        Parameter parameter;
+        parameter.name = name;
+        parameter.description = description;
+        parameter.type = type;
+        std::fill(parameter.values, parameter.values + 4, static_cast<Ogre::Real>(0));
+        parameter.integer = 0;
+        parameter.rebuild = rebuild;
+        mParameters.push_back(parameter);
+        return mParameters.size() - 1;
+    }
+    //-------------------------------------------------------
+    PostEffect::ParameterId PostEffect::GetParameterId(const Ogre::String & name) const
+    {
+        for (ParameterId id = 0; id < mParameters.size(); ++id)
+        {
+            if (mParameters[id].name == name)
             {
-                DoCreateParametersDictionary(dictionary);
+                return id;
             }
         }
+        return INVALID_PARAMETER;
+    }
+    //-------------------------------------------------------
+    const Ogre::String & PostEffect::GetParameterName(ParameterId id) const
+    {
+        if (id >= mParameters.size())
+        {
+            OGRE_EXCEPT(Ogre::Exception::ERR_INVALIDPARAMS, "Invalid parameter id", "PostEffect[GetParameterName]");
+        }
+        return mParameters[id].name;
+    }
+    //-------------------------------------------------------
+    PostEffect::ParameterType PostEffect::GetParameterType(ParameterId id) const
+    {
+        if (id >= mParameters.size())
+        {
+            OGRE_EXCEPT(Ogre::Exception::ERR_INVALIDPARAMS, "Invalid parameter id", "PostEffect[GetParameterType]");
+        }
+        return mParameters[id].type;
+    }
+    //-------------------------------------------------------
+    const PostEffect::Parameter & PostEffect::GetTypedParameter(ParameterId id, ParameterType type, const char* method) const
+    {
+        if ((id >= mParameters.size()) || (type != mParameters[id].type))
+        {
+            OGRE_EXCEPT(Ogre::Exception::ERR_INVALIDPARAMS, "Invalid parameter id or type", Ogre::String("PostEffect[") + method + "]");
+        }
+        return mParameters[id];
+    }
+    //-------------------------------------------------------
+    PostEffect::Parameter & PostEffect::GetTypedParameter(ParameterId id, ParameterType type, const char* method)
+    {
+        return const_cast<Parameter &>(static_cast<const PostEffect*>(this)->GetTypedParameter(id, type, method));
+    }
+    //-------------------------------------------------------
+    void PostEffect::WriteParameter(Parameter & parameter, const Ogre::Real* values, size_t count)
+    {
+        if (false == std::equal(values, values + count, parameter.values))
+        {
+            std::copy(values, values + count, parameter.values);
+            if ((true == parameter.rebuild) && (true == IsBuilt()))
+            {
+                //Close values share the prototypes, so only a change of the key requires the rebuild
+                mRebuildRequired = (GetPrototypesKey() != mPrototypesKey);
+            }
+        }
+    }
+    //-------------------------------------------------------
+    void PostEffect::WriteParameter(Parameter & parameter, int value)
+    {
+        if (parameter.integer != value)
+        {
+            parameter.integer = value;
+            if ((true == parameter.rebuild) && (true == IsBuilt()))
+            {
+                //Close values share the prototypes, so only a change of the key requires the rebuild
+                mRebuildRequired = (GetPrototypesKey() != mPrototypesKey);
+            }
+        }
+    }
+    //-------------------------------------------------------
+    void PostEffect::SetFloat(ParameterId id, Ogre::Real value)
+    {
+        WriteParameter(GetTypedParameter(id, VT_FLOAT, "SetFloat"), &value, 1);
+    }
+    //-------------------------------------------------------
+    void PostEffect::SetVector2(ParameterId id, const Ogre::Vector2 & value)
+    {
+        WriteParameter(GetTypedParameter(id, VT_VECTOR2, "SetVector2"), value.ptr(), 2);
+    }
+    //-------------------------------------------------------
+    void PostEffect::SetVector3(ParameterId id, const Ogre::Vector3 & value)
+    {
+        WriteParameter(GetTypedParameter(id, VT_VECTOR3, "SetVector3"), value.ptr(), 3);
+    }
+    //-------------------------------------------------------
+    void PostEffect::SetVector4(ParameterId id, const Ogre::Vector4 & value)
+    {
+        WriteParameter(GetTypedParameter(id, VT_VECTOR4, "SetVector4"), value.ptr(), 4);
+    }
+    //-------------------------------------------------------
+    void PostEffect::SetColour(ParameterId id, const Ogre::ColourValue & value)
+    {
+        WriteParameter(GetTypedParameter(id, VT_COLOUR, "SetColour"), value.ptr(), 4);
+    }
+    //-------------------------------------------------------
+    void PostEffect::SetInt(ParameterId id, int value)
+    {
+        WriteParameter(GetTypedParameter(id, VT_INT, "SetInt"), value);
+    }
+    //-------------------------------------------------------
+    void PostEffect::SetBool(ParameterId id, bool value)
+    {
+        WriteParameter(GetTypedParameter(id, VT_BOOL, "SetBool"), value ? 1 : 0);
+    }
+    //-------------------------------------------------------
+    Ogre::Real PostEffect::GetFloat(ParameterId id) const
+    {
+        return GetTypedParameter(id, VT_FLOAT, "GetFloat").values[0];
+    }
+    //-------------------------------------------------------
+    Ogre::Vector2 PostEffect::GetVector2(ParameterId id) const
+    {
+        const Ogre::Real* values = GetTypedParameter(id, VT_VECTOR2, "GetVector2").values;
+        return Ogre::Vector2(values[0], values[1]);
+    }
+    //-------------------------------------------------------
+    Ogre::Vector3 PostEffect::GetVector3(ParameterId id) const
+    {
+        return Ogre::Vector3(GetTypedParameter(id, VT_VECTOR3, "GetVector3").values);
+    }
+    //-------------------------------------------------------
+    Ogre::Vector4 PostEffect::GetVector4(ParameterId id) const
+    {
+        return Ogre::Vector4(GetTypedParameter(id, VT_VECTOR4, "GetVector4").values);
+    }
+    //-------------------------------------------------------
+    Ogre::ColourValue PostEffect::GetColour(ParameterId id) const
+    {
+        const Ogre::Real* values = GetTypedParameter(id, VT_COLOUR, "GetColour").values;
+        return Ogre::ColourValue(values[0], values[1], values[2], values[3]);
+    }
+    //-------------------------------------------------------
+    int PostEffect::GetInt(ParameterId id) const
+    {
+        return GetTypedParameter(id, VT_INT, "GetInt").integer;
+    }
+    //-------------------------------------------------------
+    bool PostEffect::GetBool(ParameterId id) const
+    {
+        return 0 != GetTypedParameter(id, VT_BOOL, "GetBool").integer;
+    }
+    //-------------------------------------------------------
+    void PostEffect::SetParameterFromString(ParameterId id, const Ogre::String & value)
+    {
+        switch (GetParameterType(id))
+        {
+        case VT_FLOAT:
+            SetFloat(id, Ogre::StringConverter::parseReal(value));
+            break;
+        case VT_VECTOR2:
+            SetVector2(id, Ogre::StringConverter::parseVector2(value));
+            break;
+        case VT_VECTOR3:
+            SetVector3(id, Ogre::StringConverter::parseVector3(value));
+            break;
+        case VT_VECTOR4:
+            SetVector4(id, Ogre::StringConverter::parseVector4(value));
+            break;
+        case VT_COLOUR:
+            SetColour(id, Ogre::StringConverter::parseColourValue(value));
+            break;
+        case VT_INT:
+            SetInt(id, Ogre::StringConverter::parseInt(value));
+            break;
+        case VT_BOOL:
+            SetBool(id, Ogre::StringConverter::parseBool(value));
+            break;
+        }
+    }
+    //-------------------------------------------------------
+    Ogre::String PostEffect::GetParameterAsString(ParameterId id) const
+    {
+        switch (GetParameterType(id))
+        {
+        case VT_FLOAT:
+            return Ogre::StringConverter::toString(GetFloat(id));
+        case VT_VECTOR2:
+            return Ogre::StringConverter::toString(GetVector2(id));
+        case VT_VECTOR3:
+            return Ogre::StringConverter::toString(GetVector3(id));
+        case VT_VECTOR4:
+            return Ogre::StringConverter::toString(GetVector4(id));
+        case VT_COLOUR:
+            return Ogre::StringConverter::toString(GetColour(id));
+        case VT_INT:
+            return Ogre::StringConverter::toString(GetInt(id));
+        case VT_BOOL:
+            return Ogre::StringConverter::toString(GetBool(id));
+        }
+        return Ogre::StringUtil::BLANK;
     }
     //-------------------------------------------------------
     PostEffect::PostEffect(const Ogre::String & name, size_t id) :
@@ -76,9 +367,6 @@ namespace OgreEffect
     {
         mName = GetUniquePostfix();
         mTimer = Ogre::Root::getSingleton().getTimer();
-
-        //create dummy textures if they were not created
-        CreateMarkerDummies();
     }
     //-------------------------------------------------------
     PostEffect::~PostEffect()
@@ -93,18 +381,53 @@ namespace OgreEffect
     //-------------------------------------------------------
     Ogre::String PostEffect::GetUniquePostfix() const
     {
-        return "PostEffect/" + mTypeName + "/" + std::to_string(mId);
+        Ogre::String postfix = "PostEffect/" + mTypeName + "/" + std::to_string(mId);
+        if (mBuildsCounter > 0)
+        {
+            postfix += "/" + std::to_string(mBuildsCounter);
+        }
+        return postfix;
+    }
+    //-------------------------------------------------------
+    Ogre::Viewport* PostEffect::GetViewport() const
+    {
+        if (nullptr == mCompositorInstance)
+        {
+            return nullptr;
+        }
+        return mCompositorInstance->getChain()->getViewport();
+    }
+    //-------------------------------------------------------
+    Ogre::HighLevelGpuProgramPtr PostEffect::AcquireProgram(Ogre::GpuProgramType type, const Ogre::String & source, const Ogre::String & defines)
+    {
+        return PostEffectManager::getSingleton().GetProgramCache().Acquire("glsl", type, source, defines);
     }
     //-------------------------------------------------------
-    Ogre::CompositionTechnique::TextureDefinition* PostEffect::CreateTextureDefinition(Ogre::String name, size_t width, size_t height, Ogre::PixelFormat format)
+    Ogre::String PostEffect::GetPrototypesKey() const
+    {
+        const QualitySettings settings = GetCurrentQualitySettings();
+        Ogre::String key = mTypeName + "/" + Ogre::StringConverter::toString(settings.resolutionScale) + "/" +
+            Ogre::StringConverter::toString(settings.samplesNumber) + "/" + Ogre::StringConverter::toString(settings.pyramidDepth);
+        const Ogre::String variant = GetPrototypesVariant();
+        if (false == variant.empty())
+        {
+            key += "/" + variant;
+        }
+        return key;
+    }
+    //-------------------------------------------------------
+    Ogre::CompositionTechnique::TextureDefinition* PostEffect::CreateTextureDefinition(Ogre::String name, size_t width, size_t height, Ogre::Real widthFactor, Ogre::Real heightFactor, Ogre::PixelFormat format)
     {
         Ogre::CompositionTechnique::TextureDefinition* texture = mCompositionTechnique->createTextureDefinition(name);
         if (nullptr == texture)
         {
             OGRE_EXCEPT(Ogre::Exception::ERR_INTERNAL_ERROR, "Failed to create texture definition", "PostEffect[CreateTextureDefinition]");
         }
-        texture->width = width; //same as render window
-        texture->height = height; //same as render window
+        texture->width = width;
+        texture->height = height;
+        //is used if the size is 0
+        texture->widthFactor = widthFactor;
+        texture->heightFactor = heightFactor;
         texture->formatList.push_back(format);
         return texture;
     }
@@ -113,55 +436,75 @@ namespace OgreEffect
     {
         ManualOutputInfo info;
         info.material = materialName;
-        info.texture = "TD/" + GetUniquePostfix() + "/" + Ogre::StringConverter::toString(mTexturesCounter);
+        info.texture = "Manual/" + Ogre::StringConverter::toString(mTexturesCounter);
         info.marker = "Texture/Dummy/" + GetUniquePostfix() + "/" + Ogre::StringConverter::toString(mTexturesCounter);
+        info.width = width;
+        info.height = height;
+        info.widthFactor = 0.0f;
+        info.heightFactor = 0.0f;
+        info.format = format;
         ++mTexturesCounter;
 
         //Create dummy texture to use as marker
         CreateDummyTexture(info.marker);
 
-        //Create new texture definition for the compositor
-        CreateTextureDefinition(info.texture, width, height, format);
-
-        //save the info 
+        //save the info; the texture will be declared in the pass graph
         mManualTextures.push_back(info);
 
         return info.marker;
     }
     //-------------------------------------------------------
-    void PostEffect::SetupCompositionTechnique(const MaterialsVector & materials, Ogre::CompositorChain* chain)
+    Ogre::String PostEffect::CreateRelativeOutputTexture(Ogre::String materialName, Ogre::Real widthFactor, Ogre::Real heightFactor, Ogre::PixelFormat format /* = Ogre::PF_R8G8B8A8 */)
     {
-        //Create a RT to render the scene into
+        Ogre::String marker = CreateOutputTexture(materialName, 0, 0, format);
+        ManualOutputInfo & info = mManualTextures.back();
+        info.widthFactor = widthFactor;
+        info.heightFactor = heightFactor;
+        return marker;
+    }
+    //-------------------------------------------------------
+    void PostEffect::MarkTextureUsage(const Ogre::String & name, size_t targetPassIdx)
+    {
+        auto entryIt = mTextureLifetimes.find(name);
+        if (entryIt == mTextureLifetimes.end())
         {
-            Ogre::CompositionTechnique::TextureDefinition* textureBg = mCompositionTechnique->createTextureDefinition(mSceneRtName);
-            textureBg->name = mSceneRtName;
-            textureBg->scope = Ogre::CompositionTechnique::TS_GLOBAL;
-            textureBg->width = mRenderWindow->getWidth(); //same as render window
-            textureBg->height = mRenderWindow->getHeight(); //same as render window
-            textureBg->formatList.push_back(Ogre::PixelFormat::PF_R8G8B8A8);
+            mTextureLifetimes.emplace(name, TextureLifetime{ targetPassIdx, targetPassIdx });
         }
-        //if there are more than one material in the post effect, then create additional render targets 
-        std::array<Ogre::String, 2> rtPingPong = { "ping", "pong" };
-        int pingPongIdx = 0;
-        if (materials.size() > 1)
+        else
         {
-            CreateTextureDefinition(rtPingPong[0], mRenderWindow->getWidth(), mRenderWindow->getHeight(), Ogre::PF_R8G8B8A8);
-            //will not be used in the case of 2 materials
-            if (materials.size() > 2)
-            {
-                CreateTextureDefinition(rtPingPong[1], mRenderWindow->getWidth(), mRenderWindow->getHeight(), Ogre::PF_R8G8B8A8);
-            }
+            entryIt->second.firstPass = std::min(entryIt->second.firstPass, targetPassIdx);
+            entryIt->second.lastPass = std::max(entryIt->second.lastPass, targetPassIdx);
         }
-
+    }
+    //-------------------------------------------------------
+    bool PostEffect::IsSceneCopyRequired() const
+    {
+        auto entryIt = mTextureLifetimes.find(mSceneRtName);
+        //target pass 1 is the first material pass
+        return (entryIt != mTextureLifetimes.end()) && (entryIt->second.lastPass > 1);
+    }
+    //-------------------------------------------------------
+    void PostEffect::CreatePassGraph(PostEffectPassGraph & graph, const MaterialsVector & materials)
+    {
+        //Declare the manual textures
+        Ogre::map<Ogre::String, Ogre::String>::type markers;
+        Ogre::map<Ogre::String, Ogre::String>::type materialOutputs;
+        for (const ManualOutputInfo & info : mManualTextures)
         {
-            Ogre::CompositionTargetPass* target = mCompositionTechnique->createTargetPass();
-            target->setInputMode(Ogre::CompositionTargetPass::IM_PREVIOUS);
-            target->setOutputName(mSceneRtName);
+            if ((0 == info.width) && (0 == info.height))
+            {
+                graph.AddRelativeResource(info.texture, info.widthFactor, info.heightFactor, info.format);
+            }
+            else
+            {
+                graph.AddResource(info.texture, info.width, info.height, info.format);
+            }
+            markers[info.marker] = info.texture;
+            materialOutputs[info.material] = info.texture;
         }
 
-        //create composition target passes for the each material
-        //all found markers substitute by created texture definitions
-        bool previousOutputWasManual = false;
+        //Chain the materials in the same order
+        Ogre::String previousOutput;
         size_t materialsNumber = materials.size();
         for (size_t matIdx = 0; matIdx < materialsNumber; ++matIdx)
         {
@@ -171,81 +514,154 @@ namespace OgreEffect
                 material->load();
             }
 
-            bool isOutputPass = (matIdx == materialsNumber - 1);
-            //Create target passes for all materials except the last one; it will be used in the output pass
-            Ogre::CompositionTargetPass* target = (false == isOutputPass) ?
-                mCompositionTechnique->createTargetPass() : mCompositionTechnique->getOutputTargetPass();
-
-            target->setInputMode(Ogre::CompositionTargetPass::IM_NONE);
-            Ogre::CompositionPass* pass = target->createPass();
-
-            //Iterate all texture unit states to replace texture markers with the local compositor RTs
+            //replace texture markers with the graph resources
+            Ogre::vector<Ogre::String>::type inputs;
             assert(nullptr != material->getBestTechnique());
             Ogre::Pass* matPass = material->getBestTechnique()->getPass(0);
             auto it = matPass->getTextureUnitStateIterator();
-            for (size_t texIdx = 0; true == it.hasMoreElements(); ++texIdx)
+            while (true == it.hasMoreElements())
             {
-                //change texture markers to render target names
                 auto textureName = it.getNext()->getTextureName();
                 if (TEXTURE_MARKER_SCENE == textureName)
                 {
-                    pass->setInput(texIdx, mSceneRtName);
+                    inputs.push_back(PostEffectPassGraph::RESOURCE_SCENE);
                 }
                 else if (TEXTURE_MARKER_PREVIOUS == textureName)
                 {
-                    if (previousOutputWasManual)
-                    {
-                        OGRE_EXCEPT(Ogre::Exception::ERR_INTERNAL_ERROR, "Wrong texture marker. \
-                            The PREVIOUS texture cant be used after manual output texture. Use the explicit texture name instead", "PostEffect[CreateCompositor]");
-                    }
                     if (0 == matIdx)
                     {
-                        OGRE_EXCEPT(Ogre::Exception::ERR_INTERNAL_ERROR, "Wrong texture marker. The PREVIOUS texture cant be used in the first material", "PostEffect[CreateCompositor]");
+                        OGRE_EXCEPT(Ogre::Exception::ERR_INTERNAL_ERROR, "Wrong texture marker. The PREVIOUS texture cant be used in the first material", "PostEffect[CreatePassGraph]");
                     }
-                    //attach one of render targets and change the index to the other one
-                    pass->setInput(texIdx, rtPingPong[pingPongIdx]);
-                    pingPongIdx = 1 - pingPongIdx;
+                    inputs.push_back(previousOutput);
                 }
-                else //check manual textures 
+                else
                 {
-                    auto entryIt = std::find_if(mManualTextures.cbegin(), mManualTextures.cend(), [&textureName](const ManualOutputInfo& info) { return info.marker == textureName; });
-                    if (entryIt != mManualTextures.cend())
-                    {
-                        pass->setInput(texIdx, entryIt->texture);
-                    }
+                    auto markerIt = markers.find(textureName);
+                    inputs.push_back((markerIt != markers.end()) ? markerIt->second : Ogre::StringUtil::BLANK);
                 }
             }
-            if (false == isOutputPass)
+
+            Ogre::String output;
+            if (matIdx == materialsNumber - 1)
             {
-                //check manual output textures
-                //auto entryIt = mManualTextures.find(material->getName());
-                Ogre::String materialName = material->getName();
-                auto entryIt = std::find_if(mManualTextures.cbegin(), mManualTextures.cend(), [&materialName](const ManualOutputInfo & info){return info.material == materialName;});
-                if (entryIt != mManualTextures.cend())
+                output = PostEffectPassGraph::RESOURCE_OUTPUT;
+            }
+            else
+            {
+                auto outputIt = materialOutputs.find(material->getName());
+                if (outputIt != materialOutputs.end())
                 {
-                    //output to the manually created texture
-                    target->setOutputName(entryIt->texture);
-                    previousOutputWasManual = true;
+                    output = outputIt->second;
                 }
                 else
                 {
-                    //pingPongIdx is already changed and point another texture
-                    target->setOutputName(rtPingPong[pingPongIdx]);
-                    previousOutputWasManual = false;
+                    //full screen intermediate texture; the graph compiler shares them as ping-pong targets
+                    output = "Intermediate/" + Ogre::StringConverter::toString(matIdx);
+                    graph.AddRelativeResource(output, 1.0f, 1.0f, Ogre::PF_R8G8B8A8);
                 }
             }
+            graph.AddPass(material->getName(), inputs, output);
+            previousOutput = output;
+        }
+    }
+    //-------------------------------------------------------
+    void PostEffect::SetupCompositionTechnique(const PostEffectPassGraph & graph)
+    {
+        //Create a RT to render the scene into; same size as render window
+        //Global textures can't be relative sized, so the texture is local
+        CreateTextureDefinition(mSceneRtName, 0, 0, 1.0f, 1.0f, Ogre::PF_R8G8B8A8);
 
-            //pass->setMaterialName(GetEffectMaterialName());
-            pass->setMaterialName(material->getName());
+        const PostEffectPassGraph::CompiledGraph compiled = graph.Compile("TD/" + GetUniquePostfix());
+        for (const PostEffectPassGraph::CompiledTexture & texture : compiled.textures)
+        {
+            CreateTextureDefinition(texture.name, texture.width, texture.height, texture.widthFactor, texture.heightFactor, texture.format);
         }
-        //Free texture dummies for the manual textures
-        for (const auto & entry : mManualTextures)
+
+        //Pyramid levels are references to the chain textures of the pyramid compositor
+        Ogre::map<Ogre::String, Ogre::String>::type pyramidTextures;
+        for (const PostEffectPassGraph::CompiledPass & compiledPass : compiled.passes)
         {
-            DestroyDummyTexture(entry.marker);
+            for (const Ogre::String & input : compiledPass.inputs)
+            {
+                if ((false == PostEffectPassGraph::IsPyramidResource(input)) || (pyramidTextures.end() != pyramidTextures.find(input)))
+                {
+                    continue;
+                }
+                if (false == mScenePyramidUsed)
+                {
+                    OGRE_EXCEPT(Ogre::Exception::ERR_INVALID_STATE, "The scene pyramid is not provided to the effect", "PostEffect[SetupCompositionTechnique]");
+                }
+                const Ogre::String levelName = input.substr(PostEffectPassGraph::RESOURCE_PYRAMID.size());
+                const size_t level = (true == Ogre::StringConverter::isNumber(levelName)) ?
+                    Ogre::StringConverter::parseUnsignedLong(levelName) : PostEffectScenePyramid::LEVELS_NUMBER;
+                if (level >= PostEffectScenePyramid::LEVELS_NUMBER)
+                {
+                    OGRE_EXCEPT(Ogre::Exception::ERR_INVALIDPARAMS, "Invalid scene pyramid level '" + input + "'", "PostEffect[SetupCompositionTechnique]");
+                }
+                const Ogre::String name = "TD/" + GetUniquePostfix() + "/" + input;
+                Ogre::CompositionTechnique::TextureDefinition* texture = mCompositionTechnique->createTextureDefinition(name);
+                if (nullptr == texture)
+                {
+                    OGRE_EXCEPT(Ogre::Exception::ERR_INTERNAL_ERROR, "Failed to create texture definition", "PostEffect[SetupCompositionTechnique]");
+                }
+                texture->refCompName = PostEffectScenePyramid::COMPOSITOR_NAME;
+                texture->refTexName = PostEffectScenePyramid::GetLevelName(level);
+                pyramidTextures[input] = name;
+                mPyramidLevelsNumber = std::max(mPyramidLevelsNumber, level + 1);
+            }
         }
+
+        {
+            Ogre::CompositionTargetPass* target = mCompositionTechnique->createTargetPass();
+            target->setInputMode(Ogre::CompositionTargetPass::IM_PREVIOUS);
+            target->setOutputName(mSceneRtName);
+            MarkTextureUsage(mSceneRtName, 0);
+        }
+
+        //create composition target passes in the scheduled order
+        size_t passesNumber = compiled.passes.size();
+        for (size_t passIdx = 0; passIdx < passesNumber; ++passIdx)
+        {
+            const PostEffectPassGraph::CompiledPass & compiledPass = compiled.passes[passIdx];
+
+            //the target pass 0 receives the scene
+            size_t targetPassIdx = passIdx + 1;
+            bool isOutputPass = (passIdx == passesNumber - 1);
+            //The last scheduled pass writes the output
+            Ogre::CompositionTargetPass* target = (false == isOutputPass) ?
+                mCompositionTechnique->createTargetPass() : mCompositionTechnique->getOutputTargetPass();
+
+            target->setInputMode(Ogre::CompositionTargetPass::IM_NONE);
+            Ogre::CompositionPass* pass = target->createPass();
+
+            for (size_t texIdx = 0; texIdx < compiledPass.inputs.size(); ++texIdx)
+            {
+                const Ogre::String & input = compiledPass.inputs[texIdx];
+                if (true == PostEffectPassGraph::IsPyramidResource(input))
+                {
+                    //the pyramid textures are not owned by the effect, so they have no lifetime here
+                    pass->setInput(texIdx, pyramidTextures[input]);
+                }
+                else if (false == input.empty())
+                {
+                    const Ogre::String & textureName = (PostEffectPassGraph::RESOURCE_SCENE == input) ? mSceneRtName : input;
+                    pass->setInput(texIdx, textureName);
+                    MarkTextureUsage(textureName, targetPassIdx);
+                }
+            }
+            if (false == isOutputPass)
+            {
+                target->setOutputName(compiledPass.output);
+                MarkTextureUsage(compiledPass.output, targetPassIdx);
+            }
+            pass->setMaterialName(compiledPass.material);
+            //the listener gets the identifier, so effects address their passes without comparing material names
+            pass->setIdentifier(static_cast<Ogre::uint32>(compiledPass.pass));
+        }
+        mTargetPassesNumber = passesNumber + 1;
     }
     //-------------------------------------------------------
-    void PostEffect::Prepare(const Ogre::RenderWindow* window, Ogre::CompositorChain* chain)
+    void PostEffect::BuildCompositor(const Ogre::RenderWindow* window)
     {
         mRenderWindow = window;
         mSceneRtName = "Texture/RT/" + GetUniquePostfix();
@@ -258,21 +674,38 @@ namespace OgreEffect
 
         //Create compositor and technique
         //The technique can be used during setting up materials to create additional output textures
-        Ogre::CompositorPtr compositor = Ogre::CompositorManager::getSingleton().create("Compositor/" + GetUniquePostfix(),
+        mCompositor = Ogre::CompositorManager::getSingleton().create("Compositor/" + GetUniquePostfix(),
             Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
-        mCompositionTechnique = compositor->createTechnique();
+        mCompositionTechnique = mCompositor->createTechnique();
 
-        //Check if materials for this effect type have been created already
-        auto & prototypes = msMaterialPrototypesMap[mTypeName]; //get or create
-        if (true == prototypes.empty())
-        {
-            prototypes = CreateEffectMaterialPrototypes();
-            assert(false == prototypes.empty());
-        }
+        //Materials for this effect type and settings are created by the first instance
+        const Ogre::String key = GetPrototypesKey();
+        const PostEffectPrototypeRegistry::Prototypes & prototypes = PostEffectManager::getSingleton().GetPrototypeRegistry().Acquire(key,
+            [this](PostEffectPrototypeRegistry::Prototypes & created)
+            {
+                created.materials = CreateEffectMaterialPrototypes();
+                assert(false == created.materials.empty());
+
+                CreatePassGraph(created.graph, created.materials);
 
-        //Setup composition technique using the created material and add it to the end of the chain
-        SetupCompositionTechnique(prototypes, chain);
-        mCompositorInstance = chain->addCompositor(compositor);
+                //Free texture dummies for the manual textures
+                for (const auto & entry : mManualTextures)
+                {
+                    DestroyDummyTexture(entry.marker);
+                }
+                mManualTextures.clear();
+            });
+        mPrototypesKey = key;
+        mRebuildRequired = false;
+
+        //Setup composition technique using the pass graph
+        SetupCompositionTechnique(prototypes.graph);
+    }
+    //-------------------------------------------------------
+    void PostEffect::AttachCompositor(Ogre::CompositorChain* chain, size_t position /* = Ogre::CompositorChain::LAST */)
+    {
+        assert(false == mCompositor.isNull());
+        mCompositorInstance = chain->addCompositor(mCompositor, position);
         if (nullptr == mCompositorInstance)
         { 
             OGRE_EXCEPT(Ogre::Exception::ERR_INTERNAL_ERROR, "Compositor is not supported", "PostEffect[InitializeCompositor]");
@@ -280,23 +713,191 @@ namespace OgreEffect
         mCompositorInstance->addListener(this);
     }
     //-------------------------------------------------------
-    void PostEffect::notifyMaterialRender(Ogre::uint32 pass_id, Ogre::MaterialPtr & mat)
+    void PostEffect::DetachCompositor()
     {
-        (void)pass_id;
-
-        //compute time from the beginning of the effect
-        Ogre::Real time = 0;
-        if (mStartTime < static_cast<Ogre::Real>(0))
+        if (nullptr == mCompositorInstance)
+        {
+            return;
+        }
+        Ogre::CompositorChain* chain = mCompositorInstance->getChain();
+        for (size_t idx = 0; idx < chain->getNumCompositors(); ++idx)
+        {
+            if (chain->getCompositor(idx) == mCompositorInstance)
+            {
+                mCompositorInstance->removeListener(this);
+                chain->removeCompositor(idx);
+                break;
+            }
+        }
+        mCompositorInstance = nullptr;
+        //the materials copies are destroyed with the instance
+        mDynamicPasses.clear();
+    }
+    //-------------------------------------------------------
+    void PostEffect::DestroyCompositor()
+    {
+        DetachCompositor();
+        if (false == mCompositor.isNull())
+        {
+            Ogre::CompositorManager::getSingleton().remove(mCompositor->getName());
+            mCompositor.setNull();
+            DoRelease();
+        }
+        if (false == mPrototypesKey.empty())
+        {
+            //the last instance of the type and settings destroys the prototypes
+            PostEffectManager::getSingleton().GetPrototypeRegistry().Release(mPrototypesKey);
+            mPrototypesKey.clear();
+        }
+        mCompositionTechnique = nullptr;
+        mRebuildRequired = false;
+        mTextureLifetimes.clear();
+        mTargetPassesNumber = 0;
+        mPyramidLevelsNumber = 0;
+        ++mBuildsCounter;
+    }
+    //-------------------------------------------------------
+    void PostEffect::SetInstanceEnabled(bool enabled)
+    {
+        assert(nullptr != mCompositorInstance);
+        if (mCompositorInstance->getEnabled() != enabled)
+        {
+            mCompositorInstance->setEnabled(enabled);
+        }
+    }
+    //-------------------------------------------------------
+    void PostEffect::NotifyResized()
+    {
+        if (nullptr != mRenderWindow)
+        {
+            DoResize(mRenderWindow->getWidth(), mRenderWindow->getHeight());
+        }
+    }
+    //-------------------------------------------------------
+    void PostEffect::SetEnabled(bool enabled)
+    {
+        if ((nullptr == mCompositorInstance) && (nullptr == mManager))
         {
-            mStartTime = GetTimeInSeconds();
+            //throw std::runtime_error("PostEffect[SetEnabled]: the effect was not initialized");
+            OGRE_EXCEPT(Ogre::Exception::ERR_INVALID_STATE, "The effect was not initialized", "PostEffect[SetEnabled]");
+        }
+        mEnabled = enabled;
+        if (nullptr != mManager)
+        {
+            //the manager can replace the effect with a fused one
+            mManager->NotifyEnabledChanged(this);
         }
         else
         {
-            time = GetTimeInSeconds() - mStartTime;
+            SetInstanceEnabled(enabled);
+        }
+    }
+    //-------------------------------------------------------
+    void PostEffect::Prepare(const Ogre::RenderWindow* window, Ogre::CompositorChain* chain)
+    {
+        if ((nullptr == mManager) && (true == mFrameParameters.isNull()))
+        {
+            //Without the manager there is no chain's block, so the effect fills its own one
+            mFrameParameters.bind(OGRE_NEW Ogre::GpuSharedParameters("PostEffect/Frame/" + GetUniquePostfix()));
+            mFrameParameters->addConstantDefinition(FRAME_TIME_UNIFORM, Ogre::GCT_FLOAT4);
+            mFrameParameters->addConstantDefinition(RESOLUTION_UNIFORM, Ogre::GCT_FLOAT4);
         }
+        BuildCompositor(window);
+        AttachCompositor(chain);
+    }
+    //-------------------------------------------------------
+    Ogre::Real PostEffect::GetEffectTime(Ogre::Real globalTime)
+    {
+        if (mStartTime < static_cast<Ogre::Real>(0))
+        {
+            mStartTime = globalTime;
+        }
+        return globalTime - mStartTime;
+    }
+    //-------------------------------------------------------
+    void PostEffect::UpdateFrame(Ogre::Real globalTime)
+    {
+        //compute time from the beginning of the effect
+        const Ogre::Real time = GetEffectTime(globalTime);
 
-        //update the effect
-        Update(mat, time);
+        for (auto & entry : mDynamicPasses)
+        {
+            DoUpdate(entry.first, entry.second, time);
+            ++mUpdateCallbacksCounter;
+        }
+    }
+    //-------------------------------------------------------
+    void PostEffect::BindFrameParameters(Ogre::MaterialPtr & material) const
+    {
+        Ogre::Technique* technique = material->getBestTechnique();
+        if (nullptr == technique)
+        {
+            return;
+        }
+        for (unsigned short passIdx = 0; passIdx < technique->getNumPasses(); ++passIdx)
+        {
+            Ogre::Pass* pass = technique->getPass(passIdx);
+            Ogre::GpuProgramParametersSharedPtr programsParams[] = {
+                pass->hasVertexProgram() ? pass->getVertexProgramParameters() : Ogre::GpuProgramParametersSharedPtr(),
+                pass->hasFragmentProgram() ? pass->getFragmentProgramParameters() : Ogre::GpuProgramParametersSharedPtr()
+            };
+            for (auto & params : programsParams)
+            {
+                //Ogre copies the shared values on binding the program; Link only the programs using them
+                if ((false == params.isNull()) && 
+                    ((nullptr != params->_findNamedConstantDefinition(FRAME_TIME_UNIFORM)) || (nullptr != params->_findNamedConstantDefinition(RESOLUTION_UNIFORM))))
+                {
+                    params->addSharedParameters(mFrameParameters);
+                }
+            }
+        }
+    }
+    //-------------------------------------------------------
+    void PostEffect::UpdateOwnFrameParameters(Ogre::Real globalTime, unsigned long frame)
+    {
+        const Ogre::Viewport* viewport = GetViewport();
+        if ((true == mFrameParameters.isNull()) || (nullptr == viewport))
+        {
+            return;
+        }
+        const Ogre::Real delta = (mLastUpdateTime < static_cast<Ogre::Real>(0)) ? static_cast<Ogre::Real>(0) : globalTime - mLastUpdateTime;
+        mLastUpdateTime = globalTime;
+        const Ogre::Real width = static_cast<Ogre::Real>(std::max(viewport->getActualWidth(), 1));
+        const Ogre::Real height = static_cast<Ogre::Real>(std::max(viewport->getActualHeight(), 1));
+        mFrameParameters->setNamedConstant(FRAME_TIME_UNIFORM, Ogre::Vector4(globalTime, delta, static_cast<Ogre::Real>(frame), 0.0f));
+        mFrameParameters->setNamedConstant(RESOLUTION_UNIFORM, Ogre::Vector4(width, height, 1.0f / width, 1.0f / height));
+    }
+    //-------------------------------------------------------
+    void PostEffect::notifyMaterialSetup(Ogre::uint32 pass_id, Ogre::MaterialPtr & mat)
+    {
+        if (false == mFrameParameters.isNull())
+        {
+            BindFrameParameters(mat);
+        }
+        DoInit(pass_id, mat);
+        if (true == IsDynamicPass(pass_id))
+        {
+            mDynamicPasses[pass_id] = mat;
+        }
+    }
+    //-------------------------------------------------------
+    void PostEffect::notifyMaterialRender(Ogre::uint32 pass_id, Ogre::MaterialPtr & mat)
+    {
+        (void)pass_id;
+        (void)mat;
+        if (nullptr != mManager)
+        {
+            //the manager updates effects in its frame phase
+            return;
+        }
+        const unsigned long frame = Ogre::Root::getSingleton().getNextFrameNumber();
+        if (frame != mLastUpdateFrame)
+        {
+            mLastUpdateFrame = frame;
+            const Ogre::Real time = GetTimeInSeconds();
+            UpdateOwnFrameParameters(time, frame);
+            UpdateFrame(time);
+        }
     }
 
 } //namespace OgreEffect
\ No newline at end of file
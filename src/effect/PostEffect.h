@@ -21,6 +21,15 @@
 #include <OgreCompositorInstance.h>
 #include <OgreMaterial.h>
 #include <OgreCompositionTechnique.h>
+#include <OgreCompositorChain.h>
+#include <OgreGpuProgramParams.h>
+#include <OgreHighLevelGpuProgram.h>
+#include <OgreVector2.h>
+#include <OgreVector3.h>
+#include <OgreVector4.h>
+#include <OgreColourValue.h>
+
+#include "PostEffectPassGraph.h"
 
 #if (OGRE_VERSION_MAJOR < 1) || (OGRE_VERSION_MAJOR == 1 && OGRE_VERSION_MINOR < 9)
 #error Only Ogre version 1.9.0 or higher is supported
@@ -31,23 +40,122 @@
     #define OGRE_HashMap HashMap
 #endif
 
+/**
+ * GLSL declaration of the per-frame uniforms shared by all programs of a chain
+ * The names should match PostEffect::FRAME_TIME_UNIFORM and PostEffect::RESOLUTION_UNIFORM
+ */
+#define POSTEFFECT_FRAME_UNIFORMS ""                                                   \
+    "uniform vec4 pe_FrameTime;   //global time, delta time, frame index, 0           \n" \
+    "uniform vec4 pe_Resolution;  //width, height, 1/width, 1/height of the viewport  \n"
+
 namespace Ogre
 {
     class RenderWindow;
     class Timer;
+    class Viewport;
 }
 
 namespace OgreEffect
 {
 
+    class PostEffectManager;
+
     class PostEffect : public Ogre::StringInterface, public Ogre::CompositorInstance::Listener
     {
         struct ManualOutputInfo
         {
             Ogre::String material; ///< material name 
-            Ogre::String texture; ///< texture definition name
+            Ogre::String texture; ///< pass graph resource name
             Ogre::String marker; ///< temporal name of a texture marker
+            size_t width;
+            size_t height;
+            Ogre::Real widthFactor;
+            Ogre::Real heightFactor;
+            Ogre::PixelFormat format;
+        };
+    public:
+        /**
+         * Range of the compositor target passes where a texture definition is used
+         * Index 0 is the target pass receiving the previous compositor's output
+         */
+        struct TextureLifetime
+        {
+            size_t firstPass;
+            size_t lastPass;
+        };
+        using TextureLifetimesMap = Ogre::map<Ogre::String, TextureLifetime>::type;
+
+        /**
+         * GLSL code of a per-pixel effect which can be fused with other ones into a single pass
+         * The body should modify the variable 'vec4 color' containing the input pixel
+         * Names of the declared uniforms should start with PIXEL_FUNCTION_PREFIX; 
+         * it will be replaced with a unique prefix in the fused program
+         */
+        struct PixelFunction
+        {
+            Ogre::String uniforms;
+            Ogre::String body;
+        };
+
+        static const Ogre::String PIXEL_FUNCTION_PREFIX; ///< placeholder for the uniform names prefix
+
+        static const Ogre::String FRAME_TIME_UNIFORM; ///< name of the shared time uniform, see POSTEFFECT_FRAME_UNIFORMS
+        static const Ogre::String RESOLUTION_UNIFORM; ///< name of the shared resolution uniform, see POSTEFFECT_FRAME_UNIFORMS
+
+        /**
+         * Global quality levels; Every effect maps a tier to its own settings
+         */
+        enum QualityTier
+        {
+            QT_LOW = 0,
+            QT_MEDIUM,
+            QT_HIGH,  ///< default
+            QT_ULTRA
+        };
+
+        /**
+         * Internal settings of an effect for a quality tier
+         * The meaning of the values depends on the effect; Unused values should be left zero
+         */
+        struct QualitySettings
+        {
+            Ogre::Real resolutionScale = 1.0f; ///< scale of the internal textures sizes
+            size_t samplesNumber = 0;  ///< number of filter taps
+            size_t pyramidDepth = 0;   ///< number of downsampling levels
+
+            bool operator==(const QualitySettings & other) const
+            {
+                return (resolutionScale == other.resolutionScale) && (samplesNumber == other.samplesNumber) && (pyramidDepth == other.pyramidDepth);
+            }
+
+            bool operator!=(const QualitySettings & other) const
+            {
+                return !(*this == other);
+            }
         };
+
+        /**
+         * Types of the effect parameters
+         */
+        enum ParameterType
+        {
+            VT_FLOAT = 0,
+            VT_VECTOR2,
+            VT_VECTOR3,
+            VT_VECTOR4,
+            VT_COLOUR,
+            VT_INT,
+            VT_BOOL
+        };
+
+        /**
+         * Index of a parameter in the registration order
+         * Is the same for all instances of an effect type, so it can be found once and reused
+         */
+        using ParameterId = size_t;
+        static const ParameterId INVALID_PARAMETER = static_cast<ParameterId>(-1);
+        //-------------------------------------------------------
+
     protected:
         using MaterialsVector = Ogre::vector<Ogre::Material*>::type;
         //-------------------------------------------------------
@@ -59,38 +167,78 @@ namespace OgreEffect
         //-------------------------------------------------------
 
     private:
-        //Store materials of the effect shared between all instances
-        //Will be initialized by the first effect instance
-        //ToDo: maybe using the static field is not the best idea. Consider other solutions
-        static OGRE_HashMap<Ogre::String, MaterialsVector> msMaterialPrototypesMap;
+        //Typed parameter of the instance; int and bool values are stored in the integer field
+        struct Parameter
+        {
+            Ogre::String name;
+            Ogre::String description;
+            ParameterType type;
+            Ogre::Real values[4];
+            int integer;
+            bool rebuild; ///< the value is used to create the materials
+        };
         //-------------------------------------------------------
-        
+
         //Small empty texture to use its name in texture unit states
         static void CreateDummyTexture(const Ogre::String & name);
         //Free resources
         static void DestroyDummyTexture(const Ogre::String & name);
-
-        /**
-         * Create dummy textures with names of markers in order to
-         * the Material Manager will generate 'failed to find texture' errors
-         */
-        static void CreateMarkerDummies();
         //-------------------------------------------------------
 
-        bool mInited = false;
+        bool mEnabled = false;
+        QualityTier mQualityTier = QT_HIGH;
+        //number of the compositor rebuilds; is used to generate unique names
+        size_t mBuildsCounter = 0;
         Ogre::Real mStartTime = -1;
 
-        //Ogre::CompositorPtr mCompositor;
-        Ogre::CompositorInstance* mCompositorInstance;
-        Ogre::CompositionTechnique* mCompositionTechnique;
+        //Manager controlling the compositor instance state; can be null
+        PostEffectManager* mManager = nullptr;
+        //Per-frame uniforms of the chain; Are set by the manager or owned by the effect created without it
+        Ogre::GpuSharedParametersPtr mFrameParameters;
+        //Time in milliseconds when the effect was disabled; Is used by the manager to release idle effects
+        unsigned long mDisabledTime = 0;
+
+        //Key of the material prototypes referenced by the built compositor; empty if there is no reference
+        Ogre::String mPrototypesKey;
+
+        Ogre::CompositorPtr mCompositor;
+        Ogre::CompositorInstance* mCompositorInstance = nullptr;
+        Ogre::CompositionTechnique* mCompositionTechnique = nullptr;
 
         //name of the render target where the scene will be rendered before applying post effects
         Ogre::String mSceneRtName;
 
         size_t mTexturesCounter = 0;
-        //save materials and texture definitions created for them with the help of CreateTextureDefinition
+        //save materials and textures created for them with the help of CreateOutputTexture
         Ogre::vector<ManualOutputInfo>::type mManualTextures;
 
+        //target passes where the texture definitions are written or read
+        TextureLifetimesMap mTextureLifetimes;
+        size_t mTargetPassesNumber = 0;
+
+        Ogre::vector<Parameter>::type mParameters;
+        //values set by the constructor; Are restored when a pooled instance is reused
+        Ogre::vector<Parameter>::type mDefaultParameters;
+        bool mDefaultParametersSaved = false;
+        //a parameter used by the materials has been changed since the compositor was built
+        bool mRebuildRequired = false;
+        //the effect gives no contribution to the current frame, so its instance is disabled by the manager
+        bool mCulled = false;
+        //number of the consecutive frames DoCull() requested the culling
+        size_t mCullRequests = 0;
+        //the manager provides the scene pyramid to the effect; Is set before building
+        bool mScenePyramidUsed = false;
+        //number of the scene pyramid levels read by the built compositor
+        size_t mPyramidLevelsNumber = 0;
+
+        //local copies of the dynamic passes' materials; are filled when the compositor instance is compiled
+        Ogre::map<size_t, Ogre::MaterialPtr>::type mDynamicPasses;
+        size_t mUpdateCallbacksCounter = 0;
+        //frame of the last update for effects without the manager
+        unsigned long mLastUpdateFrame = static_cast<unsigned long>(-1);
+        //global time of the last update for effects without the manager
+        Ogre::Real mLastUpdateTime = -1;
+
         //-------------------------------------------------------
         //Get current global time 
         Ogre::Real GetTimeInSeconds() const;
@@ -100,15 +248,67 @@ namespace OgreEffect
 
 
         /**
-        * Create and setup post effect compositor; Add to the end of the chain
-        * @return true if the created compositor has any supported technique
+        * Compile the pass graph and setup target passes of the compositor technique
         */
-        void SetupCompositionTechnique(const MaterialsVector & materials, Ogre::CompositorChain* chain);
+        void SetupCompositionTechnique(const PostEffectPassGraph & graph);
+
+        //Extend the lifetime of the texture definition to the target pass
+        void MarkTextureUsage(const Ogre::String & name, size_t targetPassIdx);
+
+        /**
+         * Create materials and the compositor; The compositor is not added to the chain
+         */
+        void BuildCompositor(const Ogre::RenderWindow* window);
+
+        /**
+         * Add the built compositor to the chain
+         */
+        void AttachCompositor(Ogre::CompositorChain* chain, size_t position = Ogre::CompositorChain::LAST);
+
+        /**
+         * Remove the compositor instance from its chain
+         */
+        void DetachCompositor();
+
+        /**
+         * Detach and destroy the compositor; The effect can be built again
+         * Materials are kept in the prototypes cache
+         */
+        void DestroyCompositor();
+
+        /**
+         * Save the initial state of a new instance or restore it for an instance reused by a pooling factory
+         */
+        void ResetInstance();
+
+        //Link the chain's frame uniforms to the programs of the material copy which declare them
+        void BindFrameParameters(Ogre::MaterialPtr & material) const;
+
+        //Fill the frame uniforms owned by an effect without the manager
+        void UpdateOwnFrameParameters(Ogre::Real globalTime, unsigned long frame);
+
+        //Write values of the parameter; Requests rebuilding if a changed parameter changes the prototypes key
+        void WriteParameter(Parameter & parameter, const Ogre::Real* values, size_t count);
+        void WriteParameter(Parameter & parameter, int value);
+
+        //Check the id and the type of the parameter; Throws on mismatch
+        const Parameter & GetTypedParameter(ParameterId id, ParameterType type, const char* method) const;
+        Parameter & GetTypedParameter(ParameterId id, ParameterType type, const char* method);
+
+        //Key of the material prototypes and pass graph of the effect type and its current quality settings
+        Ogre::String GetPrototypesKey() const;
+
+        //Enable/disable the compositor instance ignoring the user's state
+        void SetInstanceEnabled(bool enabled);
+
+        //Time from the first update of the effect; The first call starts the effect's time
+        Ogre::Real GetEffectTime(Ogre::Real globalTime);
 
         /**
          *	Create a simple texture definition for the compositor technique 
+         *  If width and height are 0 then the size is relative to the target
          */
-        Ogre::CompositionTechnique::TextureDefinition* CreateTextureDefinition(Ogre::String name, size_t width, size_t height, Ogre::PixelFormat format);
+        Ogre::CompositionTechnique::TextureDefinition* CreateTextureDefinition(Ogre::String name, size_t width, size_t height, Ogre::Real widthFactor, Ogre::Real heightFactor, Ogre::PixelFormat format);
 
         PostEffect(const PostEffect&) = delete;
         PostEffect(const PostEffect&&) = delete;
@@ -116,27 +316,70 @@ namespace OgreEffect
         PostEffect& operator=(const PostEffect&&) = delete;
         //-------------------------------------------------------
 
+        friend class PostEffectManager;
+        friend class PostEffectFactory;
+        //the fusion updates its members with their own time
+        friend class PostEffectFusion;
+
     protected:
         const Ogre::String mTypeName; ///< Unique name of the post effect type
         const size_t mId; ///< Unique number of the post effect instance
         Ogre::String mName; ///< Unique name of the instance
 
-        const Ogre::RenderWindow* mRenderWindow;
+        const Ogre::RenderWindow* mRenderWindow = nullptr;
 
         Ogre::Timer* mTimer = Ogre::Root::getSingleton().getTimer();
 
         //Helper method to generate unique names
         Ogre::String GetUniquePostfix() const;
 
+        //Viewport of the chain the compositor is attached to; nullptr if it is not attached
+        Ogre::Viewport* GetViewport() const;
+
+        /**
+         * Register a typed parameter; Should be called from the constructor of the effect
+         * The parameter is exposed through the StringInterface as well
+         * @param rebuild the parameter is used to create the materials; Changing it rebuilds the compositor
+         *     on the next PostEffectManager::Update(), the value should be a part of GetPrototypesVariant()
+         * @return id of the parameter; The value is zero
+         */
+        ParameterId AddParameter(const Ogre::String & name, const Ogre::String & description, ParameterType type, bool rebuild = false);
+
+        //Get a GLSL program shared by all effects with the same source and defines
+        static Ogre::HighLevelGpuProgramPtr AcquireProgram(Ogre::GpuProgramType type, const Ogre::String & source, const Ogre::String & defines = Ogre::StringUtil::BLANK);
+
+        //Settings of the current quality tier; Use them to create materials and the pass graph
+        QualitySettings GetCurrentQualitySettings() const
+        {
+            return GetQualitySettings(mQualityTier);
+        }
+
+        /**
+         * Check if the chain provides the scene pyramid; Is fixed before the effect is built
+         * Effects reading PostEffectPassGraph::GetPyramidResource() inputs should check it in CreatePassGraph()
+         * and make it a part of GetPrototypesVariant()
+         */
+        bool IsScenePyramidUsed() const
+        {
+            return mScenePyramidUsed;
+        }
+
         /**
          * Create a new local texture for passing output from the specified material
          * The name of the created texture should be used in another material explicitly 
-         * (Using market PREVIOUS is not allowed)
          *
-         * @return name of the new texture
+         * @return name of the texture marker
          */
         Ogre::String CreateOutputTexture(Ogre::String materialName, size_t width, size_t height, Ogre::PixelFormat format = Ogre::PF_R8G8B8A8);
 
+        /**
+         * Create a new local texture with the size relative to the render window
+         * The texture is reallocated by the compositor when the window is resized
+         *
+         * @return name of the texture marker
+         */
+        Ogre::String CreateRelativeOutputTexture(Ogre::String materialName, Ogre::Real widthFactor, Ogre::Real heightFactor, Ogre::PixelFormat format = Ogre::PF_R8G8B8A8);
+
         //-------------------------------------------------------
 
         //Methods for implementing in the derived classes
@@ -162,20 +405,78 @@ namespace OgreEffect
          */
         virtual MaterialsVector CreateEffectMaterialPrototypes() = 0;
 
+        /**
+         * Describe the effect pipeline as a graph of passes
+         * Is called one time per effect type after creating the material prototypes
+         * The default implementation builds a linear graph from the materials order and texture markers;
+         * Override it to declare the resources and the passes explicitly. In this case the materials 
+         * texture units should not use the markers, their inputs are bound by the graph
+         */
+        virtual void CreatePassGraph(PostEffectPassGraph & graph, const MaterialsVector & materials);
+
+        /**
+         * Distinguish material prototypes created for different values of the rebuild parameters
+         * Instances with the same type, quality settings and variant share the prototypes
+         * A rebuild parameter is applied only when it changes the variant, so it should be reflected here
+         */
+        virtual Ogre::String GetPrototypesVariant() const
+        {
+            return Ogre::StringUtil::BLANK;
+        }
+
         //Setup dictionary values depending on the specific PostEffect implementation
         virtual void DoCreateParametersDictionary(Ogre::ParamDictionary* dictionary) {}
         /*
          * Effects initialization
+         * Is called for the every pass material when the compositor instance creates its local copies;
+         * Bind PostEffectUniform objects to the copies' parameters here
+         */
+        virtual void DoInit(size_t passId, Ogre::MaterialPtr & material) {}
+        //Updating the material parameters of a dynamic pass once per frame
+        virtual void DoUpdate(size_t passId, Ogre::MaterialPtr & material, Ogre::Real time) {}
+
+        /**
+         * Check if the pass has parameters changing every frame
+         * Only dynamic passes get DoUpdate() calls; The id is the index of the pass in the pass graph,
+         * which is the index of the material for the default graph
          */
-        virtual void DoInit(Ogre::MaterialPtr & material) {}
-        //Updating the effect's material parameters on every frame
-        virtual void DoUpdate(Ogre::MaterialPtr & material, Ogre::Real time) {}
+        virtual bool IsDynamicPass(size_t passId) const
+        {
+            (void)passId;
+            return false;
+        }
         //-------------------------------------------------------
 
         //Initialize stuff before creating material 
         //Will be called one time per instance
         virtual void DoPrepare() {}
 
+        //Free resources created in DoPrepare()
+        //Is called when the compositor is destroyed; The effect can be prepared and built again after it
+        virtual void DoRelease() {}
+
+        //CPU side preparation, e.g. loading images or generating shader sources
+        //Is called on a worker thread before DoPrepare() if the effect is created asynchronously;
+        //Must not access the render system, scene managers or the effect's compositor
+        virtual void DoPrepareBackground() {}
+
+        //Update resources depending on the render window size
+        //The compositor textures with relative sizes are reallocated by Ogre
+        virtual void DoResize(size_t width, size_t height) {}
+
+        //Check if the effect gives no contribution to the next frame, e.g. its source is out of the view
+        //Is called by the manager once per frame for enabled effects; A culled effect is skipped like a disabled one,
+        //but stays enabled. The manager culls the effect after several consecutive requests and unculls it at once,
+        //so the result should have a hysteresis around the boundary, see IsCulled()
+        virtual bool DoCull()
+        {
+            return false;
+        }
+
+        //Restore the state of the effect not kept in the typed parameters
+        //Is called when a pooled instance is reused; The typed parameters are restored already
+        virtual void DoReset() {}
+
     public:
         /**
          *	Create post effect instance
@@ -200,50 +501,147 @@ namespace OgreEffect
         void Prepare(const Ogre::RenderWindow* window, Ogre::CompositorChain* chain);
 
         /**
-         * Init post effect's parameters; The method will be called delayed on the first update
-         * Call it manually if you want to init the effect at the specific time
-         * The material and compositor will be created when the Init() is called
+         * Update the dynamic passes of the effect
+         * Is called by the post effects manager once per frame; Effects without the manager
+         * are updated before rendering their first pass in the frame
+         * @param globalTime time in seconds of the current frame; The effect's time is counted from its first update
+         */
+        void UpdateFrame(Ogre::Real globalTime);
+
+        /**
+         * Number of DoUpdate() calls made since the effect creation
          */
-        void Init(Ogre::MaterialPtr & material)
+        size_t GetUpdateCallbacksNumber() const
         {
-            if (false == mInited)
-            {
-                //init the effect
-                DoInit(material);
-                mInited = true;
-            }
-            else
-            {
-                //throw std::logic_error("PostEffect[Init]: second initialization attempt");
-                OGRE_EXCEPT(Ogre::Exception::ERR_INVALID_STATE, "Second initialization attempt", "PostEffect[Init]");
-            }
+            return mUpdateCallbacksCounter;
         }
+        /**
+         * Is called by the post effects manager after the render window has been resized
+         */
+        void NotifyResized();
 
         /**
-         * Update the effects parameters
-         * The first call will cause calling Init() method
-         * @param material pointer of the local copy of the effect material (unique for the every PostEffect instance)
-         * @param time time in seconds spent after the effect begin
+         * Enables/disables the post effect
+         * If the effect is controlled by the manager in the lazy mode, the compositor is built on the first enabling
          */
-        void Update(Ogre::MaterialPtr & material, Ogre::Real time)
+        void SetEnabled(bool enabled);
+
+        /**
+         * Check if the materials and the compositor of the effect are created
+         */
+        bool IsBuilt() const
         {
-            if (false == mInited)
-            {
-                Init(material);
-            }
-            DoUpdate(material, time);
+            return false == mCompositor.isNull();
+        }
+
+        bool IsEnabled() const
+        {
+            return mEnabled;
         }
+
         /**
-         * Enables/disables the post effect
+         * Check if the enabled effect is skipped by the manager, since it gives no contribution to the frame
          */
-        void SetEnabled(bool enabled)
+        bool IsCulled() const
         {
-            if (nullptr == mCompositorInstance)
-            {
-                //throw std::runtime_error("PostEffect[SetEnabled]: the effect was not initialized");
-                OGRE_EXCEPT(Ogre::Exception::ERR_INVALID_STATE, "The effect was not initialized", "PostEffect[SetEnabled]");
-            }
-            mCompositorInstance->setEnabled(enabled);
+            return mCulled;
+        }
+
+        /**
+         * Check if a parameter used by the materials was changed to another prototypes variant after the compositor was built
+         */
+        bool IsRebuildRequired() const
+        {
+            return mRebuildRequired;
+        }
+
+        /**
+         * Find a parameter by name
+         * @return INVALID_PARAMETER if the effect has no such parameter
+         */
+        ParameterId GetParameterId(const Ogre::String & name) const;
+
+        size_t GetParametersNumber() const
+        {
+            return mParameters.size();
+        }
+
+        const Ogre::String & GetParameterName(ParameterId id) const;
+
+        ParameterType GetParameterType(ParameterId id) const;
+
+        /**
+         * Typed access to the parameters; Doesn't allocate memory
+         * Throws if the id is invalid or the parameter has another type
+         */
+        void SetFloat(ParameterId id, Ogre::Real value);
+        void SetVector2(ParameterId id, const Ogre::Vector2 & value);
+        void SetVector3(ParameterId id, const Ogre::Vector3 & value);
+        void SetVector4(ParameterId id, const Ogre::Vector4 & value);
+        void SetColour(ParameterId id, const Ogre::ColourValue & value);
+        void SetInt(ParameterId id, int value);
+        void SetBool(ParameterId id, bool value);
+
+        Ogre::Real GetFloat(ParameterId id) const;
+        Ogre::Vector2 GetVector2(ParameterId id) const;
+        Ogre::Vector3 GetVector3(ParameterId id) const;
+        Ogre::Vector4 GetVector4(ParameterId id) const;
+        Ogre::ColourValue GetColour(ParameterId id) const;
+        int GetInt(ParameterId id) const;
+        bool GetBool(ParameterId id) const;
+
+        /**
+         * String access to a typed parameter; Is used by the StringInterface adapter
+         */
+        void SetParameterFromString(ParameterId id, const Ogre::String & value);
+        Ogre::String GetParameterAsString(ParameterId id) const;
+
+        /**
+         * Map a quality tier to the effect's internal settings
+         * Override it if the effect's cost can be scaled; Materials and passes are rebuilt 
+         * only if the settings of the new tier differ from the current ones
+         */
+        virtual QualitySettings GetQualitySettings(QualityTier tier) const
+        {
+            (void)tier;
+            return QualitySettings();
+        }
+
+        QualityTier GetQualityTier() const
+        {
+            return mQualityTier;
+        }
+
+        /**
+         * Get the per-pixel function of the effect
+         * Override it if the effect is a single pass depending only on the scene pixel at the same coordinates
+         * @return false if the effect can't be fused
+         */
+        virtual bool GetPixelFunction(PixelFunction & function) const
+        {
+            (void)function;
+            return false;
+        }
+
+        /**
+         * Bind uniforms of the pixel function in a fused program, see PostEffectUniform
+         * Is called when the fusion's material is set up; The effect is a member of one fusion at a time
+         * @param params parameters of the fused fragment program
+         * @param prefix prefix of the effect's uniform names
+         */
+        virtual void BindPixelFunction(const Ogre::GpuProgramParametersSharedPtr & params, const Ogre::String & prefix)
+        {
+            (void)params;
+            (void)prefix;
+        }
+
+        /**
+         * Update uniforms of the pixel function bound by BindPixelFunction()
+         * @param time time of the effect, not of the fusion
+         */
+        virtual void UpdatePixelFunction(Ogre::Real time)
+        {
+            (void)time;
         }
 
         /**
@@ -260,9 +658,61 @@ namespace OgreEffect
             return mName;
         }
 
+        /**
+         *	Get technique of the effect's compositor
+         *  Returns nullptr if the effect is not prepared
+         */
+        Ogre::CompositionTechnique* GetCompositionTechnique() const
+        {
+            return mCompositionTechnique;
+        }
+
+        /**
+         *	Get lifetimes of the effect's texture definitions
+         */
+        const TextureLifetimesMap & GetTextureLifetimes() const
+        {
+            return mTextureLifetimes;
+        }
+
+        /**
+         *	Get name of the texture definition receiving the previous compositor's output
+         */
+        const Ogre::String & GetSceneTextureName() const
+        {
+            return mSceneRtName;
+        }
+
+        /**
+         *	Check if the input scene is read after the first material pass
+         *  Otherwise the input is transient and can share memory with the previous effects' textures
+         */
+        bool IsSceneCopyRequired() const;
+
+        /**
+         *	Get number of the scene pyramid levels read by the effect; The pyramid should be placed before the effect
+         */
+        size_t GetPyramidLevelsNumber() const
+        {
+            return mPyramidLevelsNumber;
+        }
+
+        /**
+         *	Get number of the target passes including the output one
+         */
+        size_t GetTargetPassesNumber() const
+        {
+            return mTargetPassesNumber;
+        }
+
+        /**
+         * Is called when the compositor instance creates the local copy of a pass material
+         */
+        virtual void notifyMaterialSetup(Ogre::uint32 pass_id, Ogre::MaterialPtr & mat) override;
+
         /**
          * Is called on the every frame before rendering compositor pass
-         * Update effect here
+         * Updates effects which are not controlled by the manager
          */
         virtual void notifyMaterialRender(Ogre::uint32 pass_id, Ogre::MaterialPtr & mat) override;
 
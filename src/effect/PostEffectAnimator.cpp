@@ -0,0 +1,297 @@
+/**
+* @file PostEffectAnimator.cpp
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+#include "PostEffectAnimator.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace OgreEffect
+{
+
+    PostEffectAnimator::Track & PostEffectAnimator::GetTrack(TrackId track, const char* method)
+    {
+        if ((track >= mTracks.size()) || (nullptr == mTracks[track].effect))
+        {
+            OGRE_EXCEPT(Ogre::Exception::ERR_INVALIDPARAMS, "Invalid track id", Ogre::String("PostEffectAnimator[") + method + "]");
+        }
+        return mTracks[track];
+    }
+    //-------------------------------------------------------
+    PostEffectAnimator::TrackId PostEffectAnimator::CreateTrack(PostEffect* effect, PostEffect::ParameterId parameter, Interpolation interpolation, bool loop)
+    {
+        if (nullptr == effect)
+        {
+            OGRE_EXCEPT(Ogre::Exception::ERR_INVALIDPARAMS, "Effect is null", "PostEffectAnimator[CreateTrack]");
+        }
+        Track track;
+        track.effect = effect;
+        track.parameter = parameter;
+        track.type = effect->GetParameterType(parameter);
+        track.interpolation = interpolation;
+        track.loop = loop;
+        mTracks.push_back(track);
+        ++mTracksNumber;
+        return mTracks.size() - 1;
+    }
+    //-------------------------------------------------------
+    void PostEffectAnimator::AddKeyframe(TrackId trackId, Ogre::Real time, const Ogre::Vector4 & value)
+    {
+        Track & track = GetTrack(trackId, "AddKeyframe");
+        Keyframe keyframe;
+        keyframe.time = time;
+        keyframe.value = value;
+        auto keyIt = std::lower_bound(track.keyframes.begin(), track.keyframes.end(), time,
+            [](const Keyframe & key, Ogre::Real keyTime) { return key.time < keyTime; });
+        if ((track.keyframes.end() != keyIt) && (keyIt->time == time))
+        {
+            *keyIt = keyframe;
+        }
+        else
+        {
+            track.keyframes.insert(keyIt, keyframe);
+        }
+        mPackDirty = true;
+    }
+    //-------------------------------------------------------
+    void PostEffectAnimator::RestartTrack(TrackId trackId)
+    {
+        GetTrack(trackId, "RestartTrack").startTime = -1.0f;
+        //resets the segments cursors
+        mPackDirty = true;
+    }
+    //-------------------------------------------------------
+    void PostEffectAnimator::DestroyTrack(TrackId trackId)
+    {
+        Track & track = GetTrack(trackId, "DestroyTrack");
+        track = Track();
+        --mTracksNumber;
+        mPackDirty = true;
+    }
+    //-------------------------------------------------------
+    void PostEffectAnimator::DestroyTracks(const PostEffect* effect)
+    {
+        for (Track & track : mTracks)
+        {
+            if ((nullptr != effect) && (track.effect == effect))
+            {
+                track = Track();
+                --mTracksNumber;
+                mPackDirty = true;
+            }
+        }
+    }
+    //-------------------------------------------------------
+    void PostEffectAnimator::Pack()
+    {
+        mPackedTracks.clear();
+        mFirstKey.clear();
+        mKeysNumber.clear();
+        mCursor.clear();
+        mKeyTimes.clear();
+        mKeyValues.clear();
+        mKeyTangents.clear();
+
+        for (TrackId trackId = 0; trackId < mTracks.size(); ++trackId)
+        {
+            const Track & track = mTracks[trackId];
+            if ((nullptr == track.effect) || (true == track.keyframes.empty()))
+            {
+                continue;
+            }
+            const size_t keysNumber = track.keyframes.size();
+            mPackedTracks.push_back(trackId);
+            mFirstKey.push_back(mKeyTimes.size());
+            mKeysNumber.push_back(keysNumber);
+            mCursor.push_back(0);
+            for (size_t keyIdx = 0; keyIdx < keysNumber; ++keyIdx)
+            {
+                const Keyframe & key = track.keyframes[keyIdx];
+                mKeyTimes.push_back(key.time);
+                //Catmull-Rom tangents; the end keys use one-sided differences
+                const Keyframe & prev = track.keyframes[(keyIdx > 0) ? keyIdx - 1 : keyIdx];
+                const Keyframe & next = track.keyframes[(keyIdx + 1 < keysNumber) ? keyIdx + 1 : keyIdx];
+                const Ogre::Real span = next.time - prev.time;
+                for (size_t component = 0; component < COMPONENTS; ++component)
+                {
+                    mKeyValues.push_back(key.value[component]);
+                    const bool cubic = (IT_CUBIC == track.interpolation) && (span > 0.0f);
+                    mKeyTangents.push_back(cubic ? (next.value[component] - prev.value[component]) / span : 0.0f);
+                }
+            }
+        }
+
+        const size_t lanesNumber = mPackedTracks.size() * COMPONENTS;
+        for (size_t idx = 0; idx < 4; ++idx)
+        {
+            mPoints[idx].resize(lanesNumber);
+            mWeights[idx].resize(lanesNumber);
+        }
+        mResults.resize(lanesNumber);
+        mPackDirty = false;
+    }
+    //-------------------------------------------------------
+    void PostEffectAnimator::PrepareSegment(size_t packedIdx, Ogre::Real globalTime)
+    {
+        Track & track = mTracks[mPackedTracks[packedIdx]];
+        if (track.startTime < 0.0f)
+        {
+            track.startTime = globalTime;
+        }
+        const size_t firstKey = mFirstKey[packedIdx];
+        const size_t keysNumber = mKeysNumber[packedIdx];
+        const Ogre::Real* times = &mKeyTimes[firstKey];
+
+        Ogre::Real time = globalTime - track.startTime;
+        const Ogre::Real duration = times[keysNumber - 1] - times[0];
+        if ((true == track.loop) && (duration > 0.0f) && (time > times[keysNumber - 1]))
+        {
+            time = times[0] + std::fmod(time - times[0], duration);
+        }
+
+        //Segment [key, key + 1] and the position in it
+        size_t key = 0;
+        Ogre::Real s = 0.0f;
+        Ogre::Real span = 0.0f;
+        if ((keysNumber > 1) && (time > times[0]))
+        {
+            if (time >= times[keysNumber - 1])
+            {
+                key = keysNumber - 2;
+                s = 1.0f;
+            }
+            else
+            {
+                //time usually moves forward, so the search starts from the last segment
+                key = (times[mCursor[packedIdx]] <= time) ? mCursor[packedIdx] : 0;
+                while (times[key + 1] <= time)
+                {
+                    ++key;
+                }
+                span = times[key + 1] - times[key];
+                s = (time - times[key]) / span;
+            }
+        }
+        mCursor[packedIdx] = key;
+        const size_t nextKey = (keysNumber > 1) ? key + 1 : key;
+
+        Ogre::Real weights[4];
+        switch (track.interpolation)
+        {
+        case IT_STEP:
+            weights[0] = (s < 1.0f) ? 1.0f : 0.0f;
+            weights[1] = 0.0f;
+            weights[2] = 1.0f - weights[0];
+            weights[3] = 0.0f;
+            break;
+        case IT_CUBIC:
+            {
+                const Ogre::Real s2 = s * s;
+                const Ogre::Real s3 = s2 * s;
+                weights[0] = 2.0f * s3 - 3.0f * s2 + 1.0f;
+                weights[1] = (s3 - 2.0f * s2 + s) * span;
+                weights[2] = -2.0f * s3 + 3.0f * s2;
+                weights[3] = (s3 - s2) * span;
+            }
+            break;
+        default:
+            weights[0] = 1.0f - s;
+            weights[1] = 0.0f;
+            weights[2] = s;
+            weights[3] = 0.0f;
+            break;
+        }
+
+        const size_t lane = packedIdx * COMPONENTS;
+        const size_t first = (firstKey + key) * COMPONENTS;
+        const size_t next = (firstKey + nextKey) * COMPONENTS;
+        for (size_t component = 0; component < COMPONENTS; ++component)
+        {
+            mPoints[0][lane + component] = mKeyValues[first + component];
+            mPoints[1][lane + component] = mKeyTangents[first + component];
+            mPoints[2][lane + component] = mKeyValues[next + component];
+            mPoints[3][lane + component] = mKeyTangents[next + component];
+            for (size_t idx = 0; idx < 4; ++idx)
+            {
+                mWeights[idx][lane + component] = weights[idx];
+            }
+        }
+    }
+    //-------------------------------------------------------
+    void PostEffectAnimator::WriteResult(size_t packedIdx)
+    {
+        const Track & track = mTracks[mPackedTracks[packedIdx]];
+        const Ogre::Real* result = &mResults[packedIdx * COMPONENTS];
+        switch (track.type)
+        {
+        case PostEffect::VT_FLOAT:
+            track.effect->SetFloat(track.parameter, result[0]);
+            break;
+        case PostEffect::VT_VECTOR2:
+            track.effect->SetVector2(track.parameter, Ogre::Vector2(result[0], result[1]));
+            break;
+        case PostEffect::VT_VECTOR3:
+            track.effect->SetVector3(track.parameter, Ogre::Vector3(result[0], result[1], result[2]));
+            break;
+        case PostEffect::VT_VECTOR4:
+            track.effect->SetVector4(track.parameter, Ogre::Vector4(result[0], result[1], result[2], result[3]));
+            break;
+        case PostEffect::VT_COLOUR:
+            track.effect->SetColour(track.parameter, Ogre::ColourValue(result[0], result[1], result[2], result[3]));
+            break;
+        case PostEffect::VT_INT:
+            track.effect->SetInt(track.parameter, static_cast<int>(std::floor(result[0] + 0.5f)));
+            break;
+        case PostEffect::VT_BOOL:
+            track.effect->SetBool(track.parameter, result[0] > 0.5f);
+            break;
+        }
+    }
+    //-------------------------------------------------------
+    void PostEffectAnimator::Evaluate(Ogre::Real globalTime)
+    {
+        if (true == mPackDirty)
+        {
+            Pack();
+        }
+        const size_t tracksNumber = mPackedTracks.size();
+        if (0 == tracksNumber)
+        {
+            return;
+        }
+
+        for (size_t packedIdx = 0; packedIdx < tracksNumber; ++packedIdx)
+        {
+            PrepareSegment(packedIdx, globalTime);
+        }
+
+        //Hermite combination of all components of all tracks
+        const size_t lanesNumber = mResults.size();
+        const Ogre::Real* p0 = mPoints[0].data();
+        const Ogre::Real* m0 = mPoints[1].data();
+        const Ogre::Real* p1 = mPoints[2].data();
+        const Ogre::Real* m1 = mPoints[3].data();
+        const Ogre::Real* w0 = mWeights[0].data();
+        const Ogre::Real* w1 = mWeights[1].data();
+        const Ogre::Real* w2 = mWeights[2].data();
+        const Ogre::Real* w3 = mWeights[3].data();
+        Ogre::Real* results = mResults.data();
+        for (size_t lane = 0; lane < lanesNumber; ++lane)
+        {
+            results[lane] = w0[lane] * p0[lane] + w1[lane] * m0[lane] + w2[lane] * p1[lane] + w3[lane] * m1[lane];
+        }
+
+        for (size_t packedIdx = 0; packedIdx < tracksNumber; ++packedIdx)
+        {
+            WriteResult(packedIdx);
+        }
+    }
+
+}//namespace OgreEffect
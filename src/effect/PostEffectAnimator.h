@@ -0,0 +1,155 @@
+/**
+* @file PostEffectAnimator.h
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+#ifndef _POSTEFFECT_ANIMATOR_H_
+#define _POSTEFFECT_ANIMATOR_H_
+
+#include <OgrePrerequisites.h>
+#include <OgreVector4.h>
+
+#include "PostEffect.h"
+
+namespace OgreEffect
+{
+
+    /**
+     * Keyframe animation of the effects' typed parameters
+     * A track animates one parameter of one effect; Keyframe times are relative to the first evaluation of the track
+     *
+     * Tracks are packed into flat arrays when they are changed. Evaluation is done for all tracks at once:
+     * the first loop finds the current segment of every track and computes Hermite basis weights, the second one
+     * combines the keyframe values with the weights for all components in a single branch-free loop
+     * Step and linear curves are Hermite curves with zero tangent weights; Cubic curves use Catmull-Rom tangents
+     */
+    class PostEffectAnimator
+    {
+    public:
+        enum Interpolation
+        {
+            IT_STEP = 0,
+            IT_LINEAR,
+            IT_CUBIC
+        };
+
+        using TrackId = size_t;
+        //-------------------------------------------------------
+
+    private:
+        static const size_t COMPONENTS = 4;
+
+        struct Keyframe
+        {
+            Ogre::Real time;
+            Ogre::Vector4 value;
+        };
+
+        //Authoring data of a track
+        struct Track
+        {
+            PostEffect* effect = nullptr;     ///< null for destroyed tracks
+            PostEffect::ParameterId parameter = PostEffect::INVALID_PARAMETER;
+            PostEffect::ParameterType type = PostEffect::VT_FLOAT;
+            Interpolation interpolation = IT_LINEAR;
+            bool loop = false;
+            Ogre::Real startTime = -1.0f;     ///< global time of the first evaluation
+            Ogre::vector<Keyframe>::type keyframes;
+        };
+        //-------------------------------------------------------
+
+        Ogre::vector<Track>::type mTracks;   ///< index is the track id; Destroyed tracks keep their slots
+        size_t mTracksNumber = 0;
+        bool mPackDirty = false;
+
+        //Packed tracks; Every array has an entry per animated track
+        Ogre::vector<TrackId>::type mPackedTracks;
+        Ogre::vector<size_t>::type mFirstKey;
+        Ogre::vector<size_t>::type mKeysNumber;
+        Ogre::vector<size_t>::type mCursor;           ///< segment found in the last evaluation
+
+        //Packed keyframes of all tracks; Values and tangents have COMPONENTS entries per key
+        Ogre::vector<Ogre::Real>::type mKeyTimes;
+        Ogre::vector<Ogre::Real>::type mKeyValues;
+        Ogre::vector<Ogre::Real>::type mKeyTangents;  ///< per unit of time
+
+        //Per evaluation data; Points and weights have COMPONENTS entries per track
+        Ogre::vector<Ogre::Real>::type mPoints[4];    ///< p0, m0, p1, m1 of the current segments
+        Ogre::vector<Ogre::Real>::type mWeights[4];   ///< basis weights of the current segments
+        Ogre::vector<Ogre::Real>::type mResults;
+        //-------------------------------------------------------
+
+        //Build the packed arrays from the tracks
+        void Pack();
+
+        //Find the segment and compute the basis weights of a packed track
+        void PrepareSegment(size_t packedIdx, Ogre::Real globalTime);
+
+        //Write the evaluated value through the typed parameters API
+        void WriteResult(size_t packedIdx);
+
+        Track & GetTrack(TrackId track, const char* method);
+
+        PostEffectAnimator(const PostEffectAnimator&) = delete;
+        PostEffectAnimator(const PostEffectAnimator&&) = delete;
+        PostEffectAnimator& operator=(const PostEffectAnimator&) = delete;
+        PostEffectAnimator& operator=(const PostEffectAnimator&&) = delete;
+        //-------------------------------------------------------
+
+    public:
+        PostEffectAnimator() = default;
+
+        /**
+         * Create an animation track of an effect parameter
+         * Int and bool parameters are rounded; Bool values greater than 0.5 are true
+         * @param loop repeat the keyframes after the last one; Otherwise the last value is held
+         */
+        TrackId CreateTrack(PostEffect* effect, PostEffect::ParameterId parameter, Interpolation interpolation, bool loop = false);
+
+        /**
+         * Add a keyframe; Keyframes are sorted by time, a keyframe with the same time replaces the existing one
+         * Components which are not used by the parameter type are ignored
+         * @param time time in seconds from the track start
+         */
+        void AddKeyframe(TrackId track, Ogre::Real time, const Ogre::Vector4 & value);
+
+        void AddKeyframe(TrackId track, Ogre::Real time, Ogre::Real value)
+        {
+            AddKeyframe(track, time, Ogre::Vector4(value, 0.0f, 0.0f, 0.0f));
+        }
+
+        /**
+         * Restart the track from the next evaluation
+         */
+        void RestartTrack(TrackId track);
+
+        void DestroyTrack(TrackId track);
+
+        /**
+         * Destroy all tracks of the effect; Is called by the manager when the effect is removed
+         */
+        void DestroyTracks(const PostEffect* effect);
+
+        /**
+         * Evaluate all tracks and write the parameters
+         * @param globalTime current time in seconds
+         */
+        void Evaluate(Ogre::Real globalTime);
+
+        /**
+         * Number of the existing tracks
+         */
+        size_t GetTracksNumber() const
+        {
+            return mTracksNumber;
+        }
+    };
+
+}//namespace OgreEffect
+
+#endif //_POSTEFFECT_ANIMATOR_H_
@@ -14,7 +14,6 @@
 #include <OgreMaterial.h>
 #include <OgreMaterialManager.h>
 #include <OgreHighLevelGpuProgram.h>
-#include <OgreHighLevelGpuProgramManager.h>
 #include <OgreTechnique.h>
 #include <OgrePass.h>
 
@@ -70,17 +69,13 @@ namespace OgreEffect
                 Ogre::Pass* pass = techniqueGL->getPass(0);
 
                 {
-                    auto vprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/V/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_VERTEX_PROGRAM);
-                    vprogram->setSource(Shader_GL_BlWh_V);
+                    auto vprogram = AcquireProgram(Ogre::GPT_VERTEX_PROGRAM, Shader_GL_BlWh_V);
 
                     pass->setVertexProgram(vprogram->getName());
                 }
 
                 {
-                    auto fprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/F/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_FRAGMENT_PROGRAM);
-                    fprogram->setSource(Shader_GL_BlWh_F);
+                    auto fprogram = AcquireProgram(Ogre::GPT_FRAGMENT_PROGRAM, Shader_GL_BlWh_F);
 
                     auto unit0 = pass->createTextureUnitState(TEXTURE_MARKER_SCENE);
                     unit0->setTextureAddressingMode(Ogre::TextureUnitState::TAM_CLAMP);
@@ -92,11 +87,20 @@ namespace OgreEffect
             material->load();
             return { material.get() };
         }
+
+        virtual bool GetPixelFunction(PixelFunction & function) const override
+        {
+            function.uniforms = "";
+            function.body = ""
+                "float grey = dot(color.rgb, vec3(0.299, 0.587, 0.114));\n"
+                "color = vec4(grey, grey, grey, 1.0);\n";
+            return true;
+        }
     };
 
     IMPLEMENT_REGISTRATION_FUNCTION(EffectBlackWhite)
     {
-        Ogre::SharedPtr<PostEffectFactory> factory(new DefaultPostEffectFactory<PostEffectBlackWhite>(PostEffectManager::PE_BLACKWHITE));
+        Ogre::SharedPtr<PostEffectFactory> factory(new DefaultPostEffectFactory<PostEffectBlackWhite>(PostEffectManager::PE_BLACKWHITE, 2));
         manager->RegisterPostEffectFactory(factory);
     }
 
@@ -10,14 +10,19 @@
 
 #include "PostEffectFactory.h"
 #include "PostEffectManager.h"
+#include "PostEffectScenePyramid.h"
 
 #include <OgreMaterial.h>
 #include <OgreMaterialManager.h>
 #include <OgreHighLevelGpuProgram.h>
-#include <OgreHighLevelGpuProgramManager.h>
 #include <OgreTechnique.h>
 #include <OgrePass.h>
 #include <OgreRenderWindow.h>
+#include <OgreStringConverter.h>
+
+#include <assert.h>
+#include <algorithm>
+#include <cmath>
 
 namespace
 {
@@ -33,82 +38,108 @@ namespace
         "}                                                                         \n"
         "";
 
-    static const char Shader_GL_Copy_F[] = ""
-        "#version 120                                                              \n"
-        "                                                                          \n"
-        "uniform sampler2D texture;                                                \n"
-        "                                                                          \n"
-        "void main()                                                               \n"
-        "{                                                                         \n"
-        "    gl_FragColor = texture2D(texture, gl_TexCoord[0].st);                 \n"
-        "}                                                                         \n"
-        "";
-
 #define THRESHOLD "0.7"
-    static const char Shader_GL_Threshold_F[] = ""
-        "#version 120                                                                               \n"
-        "                                                                                           \n"
-        "uniform sampler2D texture;                                                                 \n"
-        "                                                                                           \n"
-        "void main()                                                                                \n"
-        "{                                                                                          \n"
-        "    vec3  rgb = texture2D(texture, gl_TexCoord[0].st).rgb;                                 \n"
-        "    float lum = dot(rgb, vec3(0.299, 0.587, 0.114));                                       \n"
-        "    gl_FragColor = (lum > "THRESHOLD") ? vec4(rgb, lum) : vec4(0.0, 0.0, 0.0, 0.0);        \n"
-        "}                                                                                          \n"
-        "";
-
 
-#define KOEF0 "0.4"
-#define KOEF1 "0.3"
-#define KOEF2 "0.2"
-
-    static const char Shader_GL_Blur_Horz_F[] = ""
+    //Drops dark pixels if BLOOM_THRESHOLD is defined
+#define SHADER_THRESHOLD_FUNCTION ""\
+        "#ifdef BLOOM_THRESHOLD                                                                             \n"\
+        "vec4 threshold(vec4 color)                                                                         \n"\
+        "{                                                                                                  \n"\
+        "    float lum = dot(color.rgb, vec3(0.299, 0.587, 0.114));                                         \n"\
+        "    return (lum > BLOOM_THRESHOLD) ? vec4(color.rgb, lum) : vec4(0.0);                             \n"\
+        "}                                                                                                  \n"\
+        "#endif                                                                                             \n"
+
+    //13 bilinear taps downsampling; Overlapping 4x4 boxes weighted towards the center suppress aliasing
+    //and flickering of small bright features. With BLOOM_THRESHOLD defined dark pixels are dropped
+    static const char Shader_GL_Downsample_F[] = ""
         "#version 120                                                                                       \n"
         "                                                                                                   \n"
         "uniform sampler2D texture;                                                                         \n"
-        "uniform vec4 offset;                                                                               \n"
+        POSTEFFECT_FRAME_UNIFORMS
+        "uniform float levelScale;  //ratio of the chain's resolution to the source level                   \n"
+        "                                                                                                   \n"
+        SHADER_THRESHOLD_FUNCTION
+        "                                                                                                   \n"
+        "vec4 tap(vec2 coords, vec2 texel, float x, float y)                                                \n"
+        "{                                                                                                  \n"
+        "    return texture2D(texture, coords + texel * vec2(x, y));                                        \n"
+        "}                                                                                                  \n"
         "                                                                                                   \n"
         "void main()                                                                                        \n"
         "{                                                                                                  \n"
-        "    vec2 coords  = gl_TexCoord[0].st;                                                              \n"
-        "    float step = offset.z * 1.5;                                                                         \n"
-        "    gl_FragColor = "KOEF2" * texture2D(texture, coords  - vec2(step + step, 0.0)) +               \n"
-        "                   "KOEF1" * texture2D(texture, coords  - vec2(step, 0.0)) +                      \n"
-        "                   "KOEF0" * texture2D(texture, coords) +                                         \n"
-        "                   "KOEF1" * texture2D(texture, coords  + vec2(step, 0.0)) +                      \n"
-        "                   "KOEF2" * texture2D(texture, coords  + vec2(step + step, 0.0));                \n"
+        "    vec2 coords = gl_TexCoord[0].st;                                                               \n"
+        "    vec2 texel = pe_Resolution.zw * levelScale;                                                    \n"
+        "    vec4 inner   = tap(coords, texel, -1.0, -1.0) + tap(coords, texel,  1.0, -1.0) +                \n"
+        "                   tap(coords, texel, -1.0,  1.0) + tap(coords, texel,  1.0,  1.0);                \n"
+        "    vec4 corners = tap(coords, texel, -2.0, -2.0) + tap(coords, texel,  2.0, -2.0) +                \n"
+        "                   tap(coords, texel, -2.0,  2.0) + tap(coords, texel,  2.0,  2.0);                \n"
+        "    vec4 sides   = tap(coords, texel,  0.0, -2.0) + tap(coords, texel, -2.0,  0.0) +                \n"
+        "                   tap(coords, texel,  2.0,  0.0) + tap(coords, texel,  0.0,  2.0);                \n"
+        "    vec4 color = 0.125 * (inner + tap(coords, texel, 0.0, 0.0)) + 0.03125 * corners + 0.0625 * sides;\n"
+        "#ifdef BLOOM_THRESHOLD                                                                             \n"
+        "    color = threshold(color);                                                                      \n"
+        "#endif                                                                                             \n"
+        "    gl_FragColor = color;                                                                          \n"
         "}                                                                                                  \n"
         "";
 
-    static const char Shader_GL_Blur_Vert_F[] = ""
+    //3x3 tent filter upsampling of the smaller level blended with the current one
+    //The result is the running mean of the levels, so it fits 8 bit targets
+    //Levels built from the scene pyramid are not thresholded; BLOOM_THRESHOLD applies the threshold to the current level
+    //and BLOOM_THRESHOLD_SOURCE to the smaller one, if it is the smallest level
+    static const char Shader_GL_Upsample_F[] = ""
         "#version 120                                                                                       \n"
         "                                                                                                   \n"
-        "uniform sampler2D texture;                                                                         \n"
-        "uniform vec4 offset;                                                                               \n"
+        "uniform sampler2D texture;   //smaller level accumulated so far                                    \n"
+        "uniform sampler2D texlevel;  //current level of the pyramid                                        \n"
+        POSTEFFECT_FRAME_UNIFORMS
+        "uniform float levelScale;   //ratio of the chain's resolution to the smaller level                 \n"
+        "uniform float levelWeight;  //weight of the current level in the mean                              \n"
+        "                                                                                                   \n"
+        SHADER_THRESHOLD_FUNCTION
         "                                                                                                   \n"
         "void main()                                                                                        \n"
         "{                                                                                                  \n"
-        "    vec2 coords  = gl_TexCoord[0].st;                                                              \n"
-        "    float step = offset.w * 1.5;                                                                         \n"
-        "    gl_FragColor = "KOEF2" * texture2D(texture, coords  - vec2(0.0, step + step)) +               \n"
-        "                   "KOEF1" * texture2D(texture, coords  - vec2(0.0, step)) +                      \n"
-        "                   "KOEF0" * texture2D(texture, coords) +                                         \n"
-        "                   "KOEF1" * texture2D(texture, coords  + vec2(0.0, step)) +                      \n"
-        "                   "KOEF2" * texture2D(texture, coords  + vec2(0.0, step + step));                \n"
+        "    vec2 coords = gl_TexCoord[0].st;                                                               \n"
+        "    vec2 texel = pe_Resolution.zw * levelScale;                                                    \n"
+        "    vec4 sum = 4.0 * texture2D(texture, coords);                                                   \n"
+        "    sum += 2.0 * (texture2D(texture, coords + vec2(texel.x, 0.0)) + texture2D(texture, coords - vec2(texel.x, 0.0)));\n"
+        "    sum += 2.0 * (texture2D(texture, coords + vec2(0.0, texel.y)) + texture2D(texture, coords - vec2(0.0, texel.y)));\n"
+        "    sum += texture2D(texture, coords + texel) + texture2D(texture, coords - texel);                \n"
+        "    sum += texture2D(texture, coords + vec2(texel.x, -texel.y)) + texture2D(texture, coords - vec2(texel.x, -texel.y));\n"
+        "    vec4 smaller = sum / 16.0;                                                                     \n"
+        "    vec4 level = texture2D(texlevel, coords);                                                      \n"
+        "#ifdef BLOOM_THRESHOLD                                                                             \n"
+        "    level = threshold(level);                                                                      \n"
+        "#ifdef BLOOM_THRESHOLD_SOURCE                                                                      \n"
+        "    smaller = threshold(smaller);                                                                  \n"
+        "#endif                                                                                             \n"
+        "#endif                                                                                             \n"
+        "    gl_FragColor = mix(smaller, level, levelWeight);                                               \n"
         "}                                                                                                  \n"
         "";
 
+    //Limits of the pyramid levels number
+    static const int BLOOM_MIN_LEVELS = 1;
+    static const int BLOOM_MAX_LEVELS = 8;
+
+    //With BLOOM_THRESHOLD defined the bloom texture is a not thresholded level of the scene pyramid
     static const char Shader_GL_Blend_F[] = ""
         "#version 120                                                              \n"
         "                                                                          \n"
         "uniform sampler2D texture;                                                \n"
         "uniform sampler2D texbloom;                                               \n"
         "                                                                          \n"
+        SHADER_THRESHOLD_FUNCTION
+        "                                                                          \n"
         "void main()                                                               \n"
         "{                                                                         \n"
         "    vec3 rgb = texture2D(texture, gl_TexCoord[0].st).rgb;                 \n"
         "    vec4 bloom = texture2D(texbloom, gl_TexCoord[0].st).rgba;             \n"
+        "#ifdef BLOOM_THRESHOLD                                                    \n"
+        "    bloom = threshold(bloom);                                             \n"
+        "#endif                                                                    \n"
         "    gl_FragColor = vec4(clamp(rgb + bloom.rgb, 0.0, 1.0), 1.0);           \n"
         "}                                                                         \n"
         "";
@@ -119,179 +150,172 @@ namespace OgreEffect
 
     class PostEffectBloom : public PostEffect
     {
-    public:
-        PostEffectBloom(const Ogre::String& name, size_t id) :
-            PostEffect(name, id)
-        {
+        const ParameterId mLevelsParameter;
 
+        //Number of the pyramid levels; The parameter overrides the quality tier's depth
+        size_t GetLevelsNumber() const
+        {
+            const int levels = GetInt(mLevelsParameter);
+            if (levels <= 0)
+            {
+                return GetCurrentQualitySettings().pyramidDepth;
+            }
+            return static_cast<size_t>(std::min(std::max(levels, BLOOM_MIN_LEVELS), BLOOM_MAX_LEVELS));
         }
-        virtual ~PostEffectBloom()
+
+        //Size of the pyramid level relative to the chain's resolution
+        //The levels of the scene pyramid don't depend on the quality tier
+        Ogre::Real GetLevelFactor(size_t levelIdx) const
         {
+            const Ogre::Real scale = IsScenePyramidUsed() ? 1.0f : GetCurrentQualitySettings().resolutionScale;
+            return 0.5f * scale * std::pow(0.5f, static_cast<Ogre::Real>(levelIdx));
+        }
 
+        //Number of the first levels read from the scene pyramid
+        size_t GetSharedLevelsNumber() const
+        {
+            return IsScenePyramidUsed() ? std::min(GetLevelsNumber(), PostEffectScenePyramid::LEVELS_NUMBER) : 0;
         }
 
-        virtual MaterialsVector CreateEffectMaterialPrototypes() override
+        //Graph resource of the level
+        Ogre::String GetLevelResource(size_t levelIdx) const
         {
-            Ogre::MaterialPtr materialThreshold = Ogre::MaterialManager::getSingleton().create(
-                "Material/PostEffect/" + GetUniquePostfix() + "/Threshold", Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+            if (levelIdx < GetSharedLevelsNumber())
             {
-                Ogre::Technique* techniqueGL = materialThreshold->getTechnique(0);
-                Ogre::Pass* pass = techniqueGL->getPass(0);
-                {
-                    auto vprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/V/Threshold/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_VERTEX_PROGRAM);
-                    vprogram->setSource(Shader_GL_Common_V);
-                    pass->setVertexProgram(vprogram->getName());
-                }
-                {
-                    auto fprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/F/Threshold/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_FRAGMENT_PROGRAM);
-                    fprogram->setSource(Shader_GL_Threshold_F);
-
-                    auto unit0 = pass->createTextureUnitState(TEXTURE_MARKER_SCENE);
-                    unit0->setTextureAddressingMode(Ogre::TextureUnitState::TAM_CLAMP);
-                    unit0->setTextureFiltering(Ogre::TFO_NONE);
-
-                    pass->setFragmentProgram(fprogram->getName());
-                }
+                return PostEffectPassGraph::GetPyramidResource(levelIdx);
             }
-            auto outputThreshold = CreateOutputTexture(materialThreshold->getName(), mRenderWindow->getWidth() / 2, mRenderWindow->getHeight() / 2);
-            //-------------------------------------------------------
+            return "Level/" + Ogre::StringConverter::toString(levelIdx);
+        }
 
-            Ogre::MaterialPtr materialDownsample = Ogre::MaterialManager::getSingleton().create(
-                "Material/Downsample/" + GetUniquePostfix(), Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+        Ogre::MaterialPtr CreateBloomMaterial(const Ogre::String & passName, const Ogre::String & fragmentSource, const Ogre::String & defines, size_t unitsNumber)
+        {
+            Ogre::MaterialPtr material = Ogre::MaterialManager::getSingleton().create(
+                "Material/PostEffect/" + GetUniquePostfix() + "/" + passName, Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
 
+            Ogre::Technique* techniqueGL = material->getTechnique(0);
+            Ogre::Pass* pass = techniqueGL->getPass(0);
             {
-                Ogre::Technique* techniqueGL = materialDownsample->getTechnique(0);
-                Ogre::Pass* pass = techniqueGL->getPass(0);
+                auto vprogram = AcquireProgram(Ogre::GPT_VERTEX_PROGRAM, Shader_GL_Common_V);
+                pass->setVertexProgram(vprogram->getName());
+            }
+            {
+                auto fprogram = AcquireProgram(Ogre::GPT_FRAGMENT_PROGRAM, fragmentSource, defines);
+
+                //the filters fetch between texels
+                for (size_t unitIdx = 0; unitIdx < unitsNumber; ++unitIdx)
                 {
-                    auto vprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/V/DS/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_VERTEX_PROGRAM);
-                    vprogram->setSource(Shader_GL_Common_V);
-                    pass->setVertexProgram(vprogram->getName());
+                    auto unit = pass->createTextureUnitState();
+                    unit->setTextureAddressingMode(Ogre::TextureUnitState::TAM_CLAMP);
+                    unit->setTextureFiltering(Ogre::TFO_BILINEAR);
                 }
-                {
-                    auto fprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/F/DS/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_FRAGMENT_PROGRAM);
-                    fprogram->setSource(Shader_GL_Copy_F);
 
-                    auto unit0 = pass->createTextureUnitState(outputThreshold);
-                    unit0->setTextureAddressingMode(Ogre::TextureUnitState::TAM_CLAMP);
-                    unit0->setTextureFiltering(Ogre::TFO_BILINEAR);
-
-                    pass->setFragmentProgram(fprogram->getName());
-                }
+                pass->setFragmentProgram(fprogram->getName());
             }
-            auto outputDownsample = CreateOutputTexture(materialDownsample->getName(), mRenderWindow->getWidth() / 4, mRenderWindow->getHeight() / 4);
-            //-------------------------------------------------------
-
-            Ogre::MaterialPtr materialDownsample2 = Ogre::MaterialManager::getSingleton().create(
-                "Material/Downsample2/" + GetUniquePostfix(), Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+            return material;
+        }
 
-            {
-                Ogre::Technique* techniqueGL = materialDownsample2->getTechnique(0);
-                Ogre::Pass* pass = techniqueGL->getPass(0);
-                {
-                    auto vprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/V/DS2/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_VERTEX_PROGRAM);
-                    vprogram->setSource(Shader_GL_Common_V);
-                    pass->setVertexProgram(vprogram->getName());
-                }
-                {
-                    auto fprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/F/DS2/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_FRAGMENT_PROGRAM);
-                    fprogram->setSource(Shader_GL_Copy_F);
+    public:
+        PostEffectBloom(const Ogre::String& name, size_t id) :
+            PostEffect(name, id),
+            mLevelsParameter(AddParameter("levels", "Number of the pyramid levels, 1..8; 0 - defined by the quality tier", VT_INT, true))
+        {
 
-                    auto unit0 = pass->createTextureUnitState(outputDownsample);
-                    unit0->setTextureAddressingMode(Ogre::TextureUnitState::TAM_CLAMP);
-                    unit0->setTextureFiltering(Ogre::TFO_BILINEAR);
+        }
+        virtual ~PostEffectBloom()
+        {
 
-                    pass->setFragmentProgram(fprogram->getName());
-                }
-            }
-            auto outputDownsample2 = CreateOutputTexture(materialDownsample2->getName(), mRenderWindow->getWidth() / 8, mRenderWindow->getHeight() / 8);
-            //-------------------------------------------------------
+        }
 
-            Ogre::MaterialPtr materialHorz = Ogre::MaterialManager::getSingleton().create(
-                "Material/PostEffect/" + GetUniquePostfix() + "/Horz", Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+        virtual QualitySettings GetQualitySettings(QualityTier tier) const override
+        {
+            QualitySettings settings;
+            switch (tier)
             {
-                Ogre::Technique* techniqueGL = materialHorz->getTechnique(0);
-                Ogre::Pass* pass = techniqueGL->getPass(0);
-                {
-                    auto vprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/V/H/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_VERTEX_PROGRAM);
-                    vprogram->setSource(Shader_GL_Common_V);
-                    pass->setVertexProgram(vprogram->getName());
-                }
-                {
-                    auto fprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/F/H/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_FRAGMENT_PROGRAM);
-                    fprogram->setSource(Shader_GL_Blur_Horz_F);
+            case QT_LOW:
+                settings.resolutionScale = 0.5f;
+                settings.pyramidDepth = 3;
+                break;
+            case QT_MEDIUM:
+                settings.resolutionScale = 0.5f;
+                settings.pyramidDepth = 4;
+                break;
+            case QT_HIGH:
+                settings.resolutionScale = 1.0f;
+                settings.pyramidDepth = 5;
+                break;
+            case QT_ULTRA:
+                settings.resolutionScale = 2.0f;
+                settings.pyramidDepth = 6;
+                break;
+            }
+            return settings;
+        }
 
-                    auto unit0 = pass->createTextureUnitState(outputDownsample2);
-                    unit0->setTextureAddressingMode(Ogre::TextureUnitState::TAM_CLAMP);
-                    unit0->setTextureFiltering(Ogre::TFO_BILINEAR);
+        virtual Ogre::String GetPrototypesVariant() const override
+        {
+            return "l" + Ogre::StringConverter::toString(GetLevelsNumber()) + (IsScenePyramidUsed() ? "/p" : "");
+        }
 
-                    pass->setFragmentProgram(fprogram->getName());
+        virtual MaterialsVector CreateEffectMaterialPrototypes() override
+        {
+            const size_t levelsNumber = GetLevelsNumber();
+            const size_t sharedNumber = GetSharedLevelsNumber();
+            MaterialsVector materials;
 
-                    auto fparams = pass->getFragmentProgramParameters();
-                    fparams->setNamedConstant("texture", 0);
-                    fparams->setNamedAutoConstant("offset", Ogre::GpuProgramParameters::ACT_VIEWPORT_SIZE);
-                }
+            //Downsampling; The first level extracts bright pixels from the prefiltered scene
+            //Levels of the scene pyramid and the ones downsampled from them are not thresholded, so the threshold is applied on reading them
+            for (size_t levelIdx = sharedNumber; levelIdx < levelsNumber; ++levelIdx)
+            {
+                const Ogre::String defines = (0 == levelIdx) ? Ogre::String("BLOOM_THRESHOLD=" THRESHOLD) : Ogre::StringUtil::BLANK;
+                Ogre::MaterialPtr material = CreateBloomMaterial("Down/" + Ogre::StringConverter::toString(levelIdx), Shader_GL_Downsample_F, defines, 1);
+                auto fparams = material->getTechnique(0)->getPass(0)->getFragmentProgramParameters();
+                fparams->setNamedConstant("texture", 0);
+                fparams->setNamedConstant("levelScale", (0 == levelIdx) ? 1.0f : 1.0f / GetLevelFactor(levelIdx - 1));
+                materials.push_back(material.get());
             }
-            auto outputHorz = CreateOutputTexture(materialHorz->getName(), mRenderWindow->getWidth() / 8, mRenderWindow->getHeight() / 8);
             //-------------------------------------------------------
-            Ogre::MaterialPtr materialVert = Ogre::MaterialManager::getSingleton().create(
-                "Material/PostEffect/" + GetUniquePostfix() + "/Vert", Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+
+            //Upsampling from the smallest level; Level i gets the mean of the levels i..N-1
+            for (size_t levelIdx = levelsNumber - 1; levelIdx > 0; --levelIdx)
             {
-                Ogre::Technique* techniqueGL = materialVert->getTechnique(0);
-                Ogre::Pass* pass = techniqueGL->getPass(0);
+                Ogre::String defines;
+                if (sharedNumber > 0)
                 {
-                    auto vprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/V/V/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_VERTEX_PROGRAM);
-                    vprogram->setSource(Shader_GL_Common_V);
-
-                    pass->setVertexProgram(vprogram->getName());
-                }
-                {
-                    auto fprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/F/V/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_FRAGMENT_PROGRAM);
-                    fprogram->setSource(Shader_GL_Blur_Vert_F);
-
-                    auto unit0 = pass->createTextureUnitState(outputHorz);
-                    unit0->setTextureAddressingMode(Ogre::TextureUnitState::TAM_CLAMP);
-                    unit0->setTextureFiltering(Ogre::TFO_BILINEAR);
-
-                    pass->setFragmentProgram(fprogram->getName());
-
-                    auto fparams = pass->getFragmentProgramParameters();
-                    fparams->setNamedConstant("texture", 0);
-                    fparams->setNamedAutoConstant("offset", Ogre::GpuProgramParameters::ACT_VIEWPORT_SIZE);
+                    defines = "BLOOM_THRESHOLD=" THRESHOLD;
+                    if (levelIdx == levelsNumber - 1)
+                    {
+                        defines += ";BLOOM_THRESHOLD_SOURCE";
+                    }
                 }
+                Ogre::MaterialPtr material = CreateBloomMaterial("Up/" + Ogre::StringConverter::toString(levelIdx - 1), Shader_GL_Upsample_F, defines, 2);
+                auto fparams = material->getTechnique(0)->getPass(0)->getFragmentProgramParameters();
+                fparams->setNamedConstant("texture", 0);
+                fparams->setNamedConstant("texlevel", 1);
+                fparams->setNamedConstant("levelScale", 1.0f / GetLevelFactor(levelIdx));
+                fparams->setNamedConstant("levelWeight", 1.0f / static_cast<Ogre::Real>(levelsNumber - levelIdx + 1));
+                materials.push_back(material.get());
             }
-            auto outputVert = CreateOutputTexture(materialVert->getName(), mRenderWindow->getWidth() / 8, mRenderWindow->getHeight() / 8);
             //-------------------------------------------------------
+
             Ogre::MaterialPtr materialBlend = Ogre::MaterialManager::getSingleton().create(
                 "Material/Blend/" + GetUniquePostfix(), Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
             {
                 Ogre::Technique* techniqueGL = materialBlend->getTechnique(0);
                 Ogre::Pass* pass = techniqueGL->getPass(0);
                 {
-                    auto vprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/V/Blend/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_VERTEX_PROGRAM);
-                    vprogram->setSource(Shader_GL_Common_V);
+                    auto vprogram = AcquireProgram(Ogre::GPT_VERTEX_PROGRAM, Shader_GL_Common_V);
                     pass->setVertexProgram(vprogram->getName());
                 }
                 {
-                    auto fprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/F/Blend/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_FRAGMENT_PROGRAM);
-                    fprogram->setSource(Shader_GL_Blend_F);
+                    //a single level of the pyramid is read as is
+                    const Ogre::String defines = ((1 == levelsNumber) && (1 == sharedNumber)) ? Ogre::String("BLOOM_THRESHOLD=" THRESHOLD) : Ogre::StringUtil::BLANK;
+                    auto fprogram = AcquireProgram(Ogre::GPT_FRAGMENT_PROGRAM, Shader_GL_Blend_F, defines);
 
-                    auto unit0 = pass->createTextureUnitState(TEXTURE_MARKER_SCENE);
+                    auto unit0 = pass->createTextureUnitState();
                     unit0->setTextureAddressingMode(Ogre::TextureUnitState::TAM_CLAMP);
                     unit0->setTextureFiltering(Ogre::TFO_NONE);
 
-                    auto unit1 = pass->createTextureUnitState(outputVert);
+                    auto unit1 = pass->createTextureUnitState();
                     unit1->setTextureAddressingMode(Ogre::TextureUnitState::TAM_CLAMP);
                     unit1->setTextureFiltering(Ogre::TFO_BILINEAR);
 
@@ -301,15 +325,46 @@ namespace OgreEffect
                     fparams->setNamedConstant("texbloom", 1);
                 }
             }
+            materials.push_back(materialBlend.get());
 
             //-------------------------------------------------------
-            return{ materialThreshold.get(), materialDownsample.get(), materialDownsample2.get(), materialHorz.get(), materialVert.get(), materialBlend.get() };
+            return materials;
+        }
+
+        virtual void CreatePassGraph(PostEffectPassGraph & graph, const MaterialsVector & materials) override
+        {
+            //materials: N - S downsampling, N - 1 upsampling, blending; S first levels are read from the scene pyramid
+            const size_t levelsNumber = GetLevelsNumber();
+            const size_t sharedNumber = GetSharedLevelsNumber();
+            const size_t downsamplesNumber = levelsNumber - sharedNumber;
+            assert(materials.size() == downsamplesNumber + levelsNumber);
+
+            Ogre::String level = (0 == sharedNumber) ? PostEffectPassGraph::RESOURCE_SCENE : GetLevelResource(sharedNumber - 1);
+            for (size_t levelIdx = sharedNumber; levelIdx < levelsNumber; ++levelIdx)
+            {
+                const Ogre::Real factor = GetLevelFactor(levelIdx);
+                const Ogre::String nextLevel = GetLevelResource(levelIdx);
+                graph.AddRelativeResource(nextLevel, factor, factor);
+                graph.AddPass(materials[levelIdx - sharedNumber]->getName(), { level }, nextLevel);
+                level = nextLevel;
+            }
+
+            //Accumulate the levels from the smallest one
+            for (size_t levelIdx = levelsNumber - 1; levelIdx > 0; --levelIdx)
+            {
+                const Ogre::Real factor = GetLevelFactor(levelIdx - 1);
+                const Ogre::String accumulated = "Up/" + Ogre::StringConverter::toString(levelIdx - 1);
+                graph.AddRelativeResource(accumulated, factor, factor);
+                graph.AddPass(materials[downsamplesNumber + levelsNumber - 1 - levelIdx]->getName(), { level, GetLevelResource(levelIdx - 1) }, accumulated);
+                level = accumulated;
+            }
+            graph.AddPass(materials.back()->getName(), { PostEffectPassGraph::RESOURCE_SCENE, level }, PostEffectPassGraph::RESOURCE_OUTPUT);
         }
     };
 
     IMPLEMENT_REGISTRATION_FUNCTION(EffectBloom)
     {
-        Ogre::SharedPtr<PostEffectFactory> factory(new DefaultPostEffectFactory<PostEffectBloom>(PostEffectManager::PE_BLOOM));
+        Ogre::SharedPtr<PostEffectFactory> factory(new DefaultPostEffectFactory<PostEffectBloom>(PostEffectManager::PE_BLOOM, 2));
         manager->RegisterPostEffectFactory(factory);
     }
 
@@ -14,9 +14,14 @@
 #include <OgreMaterial.h>
 #include <OgreMaterialManager.h>
 #include <OgreHighLevelGpuProgram.h>
-#include <OgreHighLevelGpuProgramManager.h>
 #include <OgreTechnique.h>
 #include <OgrePass.h>
+#include <OgreStringConverter.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <utility>
 
 namespace
 {
@@ -31,53 +36,110 @@ namespace
         "}                                                                         \n"
         "";
 
-#if 0
-    //Gaussian values in points [-2, -1, 0, 1, 2] with sigma = 1.2
-#define GAUSS0 "0.343406"
-#define GAUSS1 "0.242667"
-#define GAUSS2 "0.085629"
-#else
-    //Gaussian values in points [-2, -1, 0, 1, 2] with sigma = 2.0
-#define GAUSS0 "0.251379"
-#define GAUSS1 "0.221841"
-#define GAUSS2 "0.152469"
-#endif
-
-    static const char Shader_GL_Blur_Horz_F[] = ""
+    //Limits of the kernel radius in pixels of the viewport
+    static const int BLUR_MIN_RADIUS = 1;
+    static const int BLUR_MAX_RADIUS = 32;
+    //Sigma is rounded to the step, so close values share programs and prototypes
+    static const double BLUR_SIGMA_STEP = 0.25;
+
+    int GetRadiusBucket(int radius)
+    {
+        return std::min(std::max(radius, BLUR_MIN_RADIUS), BLUR_MAX_RADIUS);
+    }
+
+    double GetSigmaBucket(Ogre::Real sigma)
+    {
+        return std::max(BLUR_SIGMA_STEP, std::floor(sigma / BLUR_SIGMA_STEP + 0.5) * BLUR_SIGMA_STEP);
+    }
+
+    //Generate a 1D Gaussian filter with 2 * radius + 1 taps
+    //Pairs of neighbouring taps are merged into a single bilinear fetch between them, so the filter makes
+    //2 * ceil(radius / 2) + 1 fetches instead of 2 * radius + 1; The texture should be linearly filtered
+    //The step is the texel of the chain's resolution multiplied by texelScale
+    Ogre::String CreateBlurShaderSource(int radius, double sigma, bool horizontal, Ogre::Real texelScale)
+    {
+        Ogre::vector<double>::type weights;
+        double sum = 0.0;
+        for (int offset = 0; offset <= radius + 1; ++offset)
+        {
+            //the extra zero weight pairs the last tap of an odd radius
+            weights.push_back((offset <= radius) ? std::exp(-(offset * offset) / (2.0 * sigma * sigma)) : 0.0);
+            sum += (offset > 0) ? 2.0 * weights.back() : weights.back();
+        }
+
+        Ogre::StringStream source;
+        source << std::fixed << std::setprecision(6);
+        source << "#version 120\n"
+            << "\n"
+            << "uniform sampler2D texture;\n"
+            << POSTEFFECT_FRAME_UNIFORMS
+            << "\n"
+            << "void main()\n"
+            << "{\n"
+            << "    vec2 coords  = gl_TexCoord[0].st;\n"
+            << "    float texel = " << (horizontal ? "pe_Resolution.z" : "pe_Resolution.w") << " * " << texelScale << ";\n"
+            << "    vec2 step = " << (horizontal ? "vec2(texel, 0.0)" : "vec2(0.0, texel)") << ";\n"
+            << "    gl_FragColor = " << (weights[0] / sum) << " * texture2D(texture, coords);\n";
+        for (int offset = 1; offset <= radius; offset += 2)
+        {
+            const double weight = weights[offset] + weights[offset + 1];
+            const double position = (offset * weights[offset] + (offset + 1) * weights[offset + 1]) / weight;
+            source << "    gl_FragColor += " << (weight / sum) << " * (texture2D(texture, coords + " << position << " * step) + "
+                << "texture2D(texture, coords - " << position << " * step));\n";
+        }
+        source << "}\n";
+        return source.str();
+    }
+
+    //Dual filter downsampling; Averages the center with 4 diagonal bilinear taps of the source level
+    static const char Shader_GL_Kawase_Down_F[] = ""
         "#version 120                                                                                       \n"
         "                                                                                                   \n"
         "uniform sampler2D texture;                                                                         \n"
-        "uniform vec4 offset;                                                                               \n"
+        POSTEFFECT_FRAME_UNIFORMS
+        "uniform float levelScale;  //ratio of the chain's resolution to the source level                   \n"
+        "uniform float offset;      //distance of the taps in half texels of the source level               \n"
         "                                                                                                   \n"
         "void main()                                                                                        \n"
         "{                                                                                                  \n"
-        "    vec2 coords  = gl_TexCoord[0].st;                                                              \n"
-        "    float step = offset.z;                                                                         \n"
-        "    gl_FragColor = "GAUSS2" * texture2D(texture, coords  - vec2(step + step, 0.0)) +               \n"
-        "                   "GAUSS1" * texture2D(texture, coords  - vec2(step, 0.0)) +                      \n"
-        "                   "GAUSS0" * texture2D(texture, coords) +                                         \n"
-        "                   "GAUSS1" * texture2D(texture, coords  + vec2(step, 0.0)) +                      \n"
-        "                   "GAUSS2" * texture2D(texture, coords  + vec2(step + step, 0.0));                \n"
+        "    vec2 coords = gl_TexCoord[0].st;                                                               \n"
+        "    vec2 h = pe_Resolution.zw * levelScale * 0.5 * offset;                                         \n"
+        "    vec4 sum = 4.0 * texture2D(texture, coords);                                                   \n"
+        "    sum += texture2D(texture, coords - h);                                                         \n"
+        "    sum += texture2D(texture, coords + h);                                                         \n"
+        "    sum += texture2D(texture, coords + vec2(h.x, -h.y));                                           \n"
+        "    sum += texture2D(texture, coords - vec2(h.x, -h.y));                                           \n"
+        "    gl_FragColor = sum / 8.0;                                                                      \n"
         "}                                                                                                  \n"
         "";
 
-    static const char Shader_GL_Blur_Vert_F[] = ""
+    //Dual filter upsampling; 8 bilinear taps on a diamond around the pixel
+    static const char Shader_GL_Kawase_Up_F[] = ""
         "#version 120                                                                                       \n"
         "                                                                                                   \n"
         "uniform sampler2D texture;                                                                         \n"
-        "uniform vec4 offset;                                                                               \n"
+        POSTEFFECT_FRAME_UNIFORMS
+        "uniform float levelScale;  //ratio of the chain's resolution to the source level                   \n"
+        "uniform float offset;      //distance of the taps in half texels of the source level               \n"
         "                                                                                                   \n"
         "void main()                                                                                        \n"
         "{                                                                                                  \n"
-        "    vec2 coords  = gl_TexCoord[0].st;                                                              \n"
-        "    float step = offset.w;                                                                         \n"
-        "    gl_FragColor = "GAUSS2" * texture2D(texture, coords  - vec2(0.0, step + step)) +               \n"
-        "                   "GAUSS1" * texture2D(texture, coords  - vec2(0.0, step)) +                      \n"
-        "                   "GAUSS0" * texture2D(texture, coords) +                                         \n"
-        "                   "GAUSS1" * texture2D(texture, coords  + vec2(0.0, step)) +                      \n"
-        "                   "GAUSS2" * texture2D(texture, coords  + vec2(0.0, step + step));                \n"
+        "    vec2 coords = gl_TexCoord[0].st;                                                               \n"
+        "    vec2 h = pe_Resolution.zw * levelScale * 0.5 * offset;                                         \n"
+        "    vec4 sum = texture2D(texture, coords + vec2(-2.0 * h.x, 0.0));                                 \n"
+        "    sum += texture2D(texture, coords + vec2(2.0 * h.x, 0.0));                                      \n"
+        "    sum += texture2D(texture, coords + vec2(0.0, -2.0 * h.y));                                     \n"
+        "    sum += texture2D(texture, coords + vec2(0.0, 2.0 * h.y));                                      \n"
+        "    sum += 2.0 * texture2D(texture, coords + vec2(-h.x, h.y));                                     \n"
+        "    sum += 2.0 * texture2D(texture, coords + vec2(h.x, h.y));                                      \n"
+        "    sum += 2.0 * texture2D(texture, coords + vec2(h.x, -h.y));                                     \n"
+        "    sum += 2.0 * texture2D(texture, coords + vec2(-h.x, -h.y));                                    \n"
+        "    gl_FragColor = sum / 12.0;                                                                     \n"
         "}                                                                                                  \n"
         "";
+
+    //Number of the dual filter pyramid levels; The smallest level is 1/8 of the internal resolution
+    static const size_t KAWASE_MAX_DEPTH = 3;
 }
 
 namespace OgreEffect
@@ -86,92 +148,239 @@ namespace OgreEffect
     class PostEffectBlur : public PostEffect
     {
     public:
-        PostEffectBlur(const Ogre::String& name, size_t id) :
-            PostEffect(name, id)
+        enum BlurMode
+        {
+            BM_GAUSSIAN = 0,    ///< separable Gaussian filter at the internal resolution; Cost grows with the radius
+            BM_DUAL_KAWASE      ///< downsample/upsample pyramid; Cost is nearly constant for any radius
+        };
+
+    private:
+        const ParameterId mRadiusParameter;
+        const ParameterId mSigmaParameter;
+        const ParameterId mModeParameter;
+
+        //Gaussian shader sources generated on the worker thread by the asynchronous creation
+        Ogre::String mPreparedKernel;
+        Ogre::String mPreparedSources[2];
+
+        BlurMode GetMode() const
         {
+            return (BM_DUAL_KAWASE == GetInt(mModeParameter)) ? BM_DUAL_KAWASE : BM_GAUSSIAN;
+        }
 
+        //Kernel in texels of a resolution scaled relative to the chain's one
+        void GetKernel(Ogre::Real scale, int & radius, double & sigma) const
+        {
+            radius = std::max(BLUR_MIN_RADIUS, static_cast<int>(std::ceil(GetRadiusBucket(GetInt(mRadiusParameter)) * scale)));
+            sigma = GetSigmaBucket(static_cast<Ogre::Real>(GetSigmaBucket(GetFloat(mSigmaParameter)) * scale));
         }
-        virtual ~PostEffectBlur()
+
+        //Kernel of the Gaussian sources; Identifies the sources generated in the background
+        Ogre::String GetKernelKey() const
         {
+            //the kernel of the internal resolution is derived from the full one
+            int radius;
+            double sigma;
+            GetKernel(1.0f, radius, sigma);
+            return Ogre::StringConverter::toString(radius) + "/" + Ogre::StringConverter::toString(static_cast<Ogre::Real>(sigma)) +
+                "/" + Ogre::StringConverter::toString(GetCurrentQualitySettings().resolutionScale);
+        }
 
+        //Sources of the horizontal and the vertical passes; Doesn't access the render system
+        void CreateGaussianSources(Ogre::String & horizontal, Ogre::String & vertical) const
+        {
+            const QualitySettings settings = GetCurrentQualitySettings();
+            //The horizontal pass reads the scene at the chain's resolution; Merged taps assume a step of one source texel,
+            //so its kernel is built in the source texels. The vertical pass reads the internal resolution
+            int radius;
+            double sigma;
+            GetKernel(1.0f, radius, sigma);
+            horizontal = CreateBlurShaderSource(radius, sigma, true, 1.0f);
+            GetKernel(settings.resolutionScale, radius, sigma);
+            vertical = CreateBlurShaderSource(radius, sigma, false, 1.0f / settings.resolutionScale);
         }
 
-        virtual MaterialsVector CreateEffectMaterialPrototypes() override
+        //Levels of the dual filter pyramid and the taps offset matching the radius approximately;
+        //Every level doubles the reach of the taps, the offset covers the rest
+        void GetPyramid(size_t & depth, Ogre::Real & offset) const
+        {
+            const int radius = GetRadiusBucket(GetInt(mRadiusParameter));
+            depth = (radius <= 4) ? 1 : ((radius <= 8) ? 2 : KAWASE_MAX_DEPTH);
+            offset = std::max(0.5f, static_cast<Ogre::Real>(radius) / static_cast<Ogre::Real>(2 << depth));
+        }
+
+        //Full screen material sampling the input with linear filtering
+        Ogre::MaterialPtr CreateBlurMaterial(const Ogre::String & passName, const Ogre::String & fragmentSource)
         {
-            Ogre::MaterialPtr material_horz = Ogre::MaterialManager::getSingleton().create(
-                "Material/PostEffect/" + GetUniquePostfix() + "/Horz", Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+            Ogre::MaterialPtr material = Ogre::MaterialManager::getSingleton().create(
+                "Material/PostEffect/" + GetUniquePostfix() + "/" + passName, Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
 
+            Ogre::Technique* techniqueGL = material->getTechnique(0);
+            Ogre::Pass* pass = techniqueGL->getPass(0);
             {
-                Ogre::Technique* techniqueGL = material_horz->getTechnique(0);
-                Ogre::Pass* pass = techniqueGL->getPass(0);
-
-                {
-                    auto vprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/V/H/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_VERTEX_PROGRAM);
-                    vprogram->setSource(Shader_GL_Blur_V);
+                auto vprogram = AcquireProgram(Ogre::GPT_VERTEX_PROGRAM, Shader_GL_Blur_V);
 
-                    pass->setVertexProgram(vprogram->getName());
-                }
+                pass->setVertexProgram(vprogram->getName());
+            }
+            {
+                auto fprogram = AcquireProgram(Ogre::GPT_FRAGMENT_PROGRAM, fragmentSource);
 
-                {
-                    auto fprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/F/H/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_FRAGMENT_PROGRAM);
-                    fprogram->setSource(Shader_GL_Blur_Horz_F);
+                //the taps are fetched between texels
+                auto unit0 = pass->createTextureUnitState();
+                unit0->setTextureAddressingMode(Ogre::TextureUnitState::TAM_CLAMP);
+                unit0->setTextureFiltering(Ogre::FO_LINEAR, Ogre::FO_LINEAR, Ogre::FO_NONE);
 
-                    auto unit0 = pass->createTextureUnitState(TEXTURE_MARKER_SCENE);
-                    unit0->setTextureAddressingMode(Ogre::TextureUnitState::TAM_CLAMP);
-                    unit0->setTextureFiltering(Ogre::TFO_NONE);
+                pass->setFragmentProgram(fprogram->getName());
 
-                    pass->setFragmentProgram(fprogram->getName());
+                auto fparams = pass->getFragmentProgramParameters();
+                fparams->setNamedConstant("texture", 0);
+            }
+            return material;
+        }
 
-                    auto fparams = pass->getFragmentProgramParameters();
-                    fparams->setNamedConstant("texture", 0);
-                    fparams->setNamedAutoConstant("offset", Ogre::GpuProgramParameters::ACT_VIEWPORT_SIZE);
-                }
+        MaterialsVector CreateGaussianMaterials()
+        {
+            Ogre::String sources[2];
+            if (mPreparedKernel == GetKernelKey())
+            {
+                //the sources are generated already by DoPrepareBackground()
+                std::swap(sources, mPreparedSources);
+            }
+            else
+            {
+                CreateGaussianSources(sources[0], sources[1]);
             }
+            mPreparedKernel.clear();
+
+            Ogre::MaterialPtr material_horz = CreateBlurMaterial("Horz", sources[0]);
             material_horz->load();
 
+            Ogre::MaterialPtr material_vert = CreateBlurMaterial("Vert", sources[1]);
+            material_vert->load();
+
+            return{ material_horz.get(), material_vert.get() };
+        }
 
-            Ogre::MaterialPtr material_vert = Ogre::MaterialManager::getSingleton().create(
-                "Material/PostEffect/" + GetUniquePostfix() + "/Vert", Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+        //Downsampling materials from the internal resolution to the smallest level, then upsampling ones back
+        MaterialsVector CreateKawaseMaterials()
+        {
+            const Ogre::Real scale = GetCurrentQualitySettings().resolutionScale;
+            size_t depth;
+            Ogre::Real offset;
+            GetPyramid(depth, offset);
 
+            MaterialsVector materials;
+            //the first level reads the scene at the chain's resolution
+            Ogre::Real sourceFactor = 1.0f;
+            for (size_t levelIdx = 0; levelIdx < depth; ++levelIdx)
             {
-                Ogre::Technique* techniqueGL = material_vert->getTechnique(0);
-                Ogre::Pass* pass = techniqueGL->getPass(0);
+                Ogre::MaterialPtr material = CreateBlurMaterial("Down/" + Ogre::StringConverter::toString(levelIdx), Shader_GL_Kawase_Down_F);
+                auto fparams = material->getTechnique(0)->getPass(0)->getFragmentProgramParameters();
+                fparams->setNamedConstant("levelScale", 1.0f / sourceFactor);
+                fparams->setNamedConstant("offset", offset);
+                material->load();
+                materials.push_back(material.get());
+                sourceFactor = scale * std::pow(0.5f, static_cast<Ogre::Real>(levelIdx + 1));
+            }
+            for (size_t levelIdx = depth; levelIdx > 0; --levelIdx)
+            {
+                Ogre::MaterialPtr material = CreateBlurMaterial("Up/" + Ogre::StringConverter::toString(levelIdx - 1), Shader_GL_Kawase_Up_F);
+                auto fparams = material->getTechnique(0)->getPass(0)->getFragmentProgramParameters();
+                fparams->setNamedConstant("levelScale", 1.0f / (scale * std::pow(0.5f, static_cast<Ogre::Real>(levelIdx))));
+                fparams->setNamedConstant("offset", offset);
+                material->load();
+                materials.push_back(material.get());
+            }
+            return materials;
+        }
+
+    public:
+        PostEffectBlur(const Ogre::String& name, size_t id) :
+            PostEffect(name, id),
+            mRadiusParameter(AddParameter("radius", "Radius of the blur in pixels, 1..32", VT_INT, true)),
+            mSigmaParameter(AddParameter("sigma", "Standard deviation of the Gaussian kernel in pixels", VT_FLOAT, true)),
+            mModeParameter(AddParameter("mode", "0 - separable Gaussian, 1 - dual Kawase pyramid", VT_INT, true))
+        {
+            SetInt(mRadiusParameter, 2);
+            SetFloat(mSigmaParameter, 2.0f);
+            SetInt(mModeParameter, BM_GAUSSIAN);
+        }
+        virtual ~PostEffectBlur()
+        {
 
-                {
-                    auto vprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/V/V/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_VERTEX_PROGRAM);
-                    vprogram->setSource(Shader_GL_Blur_V);
+        }
 
-                    pass->setVertexProgram(vprogram->getName());
-                }
+        virtual QualitySettings GetQualitySettings(QualityTier tier) const override
+        {
+            QualitySettings settings;
+            settings.resolutionScale = (QT_LOW == tier) ? 0.5f : ((QT_MEDIUM == tier) ? 0.75f : 1.0f);
+            return settings;
+        }
 
-                {
-                    auto fprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/F/V/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_FRAGMENT_PROGRAM);
-                    fprogram->setSource(Shader_GL_Blur_Vert_F);
+        virtual Ogre::String GetPrototypesVariant() const override
+        {
+            const Ogre::String radius = "r" + Ogre::StringConverter::toString(GetRadiusBucket(GetInt(mRadiusParameter)));
+            if (BM_DUAL_KAWASE == GetMode())
+            {
+                //the pyramid ignores sigma, so changing it should not rebuild the effect
+                return radius + "/m" + Ogre::StringConverter::toString(static_cast<int>(BM_DUAL_KAWASE));
+            }
+            return radius + "/s" + Ogre::StringConverter::toString(static_cast<Ogre::Real>(GetSigmaBucket(GetFloat(mSigmaParameter)))) +
+                "/m" + Ogre::StringConverter::toString(static_cast<int>(BM_GAUSSIAN));
+        }
 
-                    auto unit0 = pass->createTextureUnitState(TEXTURE_MARKER_PREVIOUS);
-                    unit0->setTextureAddressingMode(Ogre::TextureUnitState::TAM_CLAMP);
-                    unit0->setTextureFiltering(Ogre::TFO_NONE);
+        virtual void DoPrepareBackground() override
+        {
+            //the kernel generation is the only CPU heavy part of the blur
+            if (BM_GAUSSIAN == GetMode())
+            {
+                CreateGaussianSources(mPreparedSources[0], mPreparedSources[1]);
+                mPreparedKernel = GetKernelKey();
+            }
+        }
 
-                    pass->setFragmentProgram(fprogram->getName());
+        virtual MaterialsVector CreateEffectMaterialPrototypes() override
+        {
+            return (BM_DUAL_KAWASE == GetMode()) ? CreateKawaseMaterials() : CreateGaussianMaterials();
+        }
 
-                    auto fparams = pass->getFragmentProgramParameters();
-                    fparams->setNamedConstant("texture", 0);
-                    fparams->setNamedAutoConstant("offset", Ogre::GpuProgramParameters::ACT_VIEWPORT_SIZE);
-                }
+        virtual void CreatePassGraph(PostEffectPassGraph & graph, const MaterialsVector & materials) override
+        {
+            const Ogre::Real scale = GetCurrentQualitySettings().resolutionScale;
+            if (BM_GAUSSIAN == GetMode())
+            {
+                graph.AddRelativeResource("Horz", scale, scale);
+                graph.AddPass(materials[0]->getName(), { PostEffectPassGraph::RESOURCE_SCENE }, "Horz");
+                graph.AddPass(materials[1]->getName(), { "Horz" }, PostEffectPassGraph::RESOURCE_OUTPUT);
+                return;
             }
-            material_vert->load();
 
-            return{ material_horz.get(), material_vert.get() };
+            //Half, quarter and eighth of the internal resolution; Levels are aliased by the texture pool
+            const size_t depth = materials.size() / 2;
+            Ogre::String level = PostEffectPassGraph::RESOURCE_SCENE;
+            for (size_t levelIdx = 0; levelIdx < depth; ++levelIdx)
+            {
+                const Ogre::Real factor = scale * std::pow(0.5f, static_cast<Ogre::Real>(levelIdx + 1));
+                const Ogre::String nextLevel = "Down/" + Ogre::StringConverter::toString(levelIdx);
+                graph.AddRelativeResource(nextLevel, factor, factor);
+                graph.AddPass(materials[levelIdx]->getName(), { level }, nextLevel);
+                level = nextLevel;
+            }
+            for (size_t levelIdx = depth - 1; levelIdx > 0; --levelIdx)
+            {
+                const Ogre::Real factor = scale * std::pow(0.5f, static_cast<Ogre::Real>(levelIdx));
+                const Ogre::String nextLevel = "Up/" + Ogre::StringConverter::toString(levelIdx - 1);
+                graph.AddRelativeResource(nextLevel, factor, factor);
+                graph.AddPass(materials[2 * depth - 1 - levelIdx]->getName(), { level }, nextLevel);
+                level = nextLevel;
+            }
+            graph.AddPass(materials.back()->getName(), { level }, PostEffectPassGraph::RESOURCE_OUTPUT);
         }
     };
 
     IMPLEMENT_REGISTRATION_FUNCTION(EffectBlur)
     {
-        Ogre::SharedPtr<PostEffectFactory> factory(new DefaultPostEffectFactory<PostEffectBlur>(PostEffectManager::PE_BLUR));
+        Ogre::SharedPtr<PostEffectFactory> factory(new DefaultPostEffectFactory<PostEffectBlur>(PostEffectManager::PE_BLUR, 2));
         manager->RegisterPostEffectFactory(factory);
     }
 
@@ -22,9 +22,9 @@
 #include <OgreTechnique.h>
 #include <OgrePass.h>
 #include <OgreHighLevelGpuProgram.h>
-#include <OgreHighLevelGpuProgramManager.h>
 #include <OgreRenderWindow.h>
 #include <OgreViewport.h>
+#include <OgreTextureUnitState.h>
 
 
 namespace
@@ -67,8 +67,12 @@ namespace OgreEffect
             Ogre::PF_R8G8B8A8,
             Ogre::TU_RENDERTARGET);
 
-
-        Ogre::RenderTarget* renderTarget = rtTexture->getBuffer()->getRenderTarget();
+        return SetupRenderTarget(rtTexture, camera);
+    }
+    //-------------------------------------------------------
+    Ogre::RenderTarget* PostEffectComplex::SetupRenderTarget(Ogre::TexturePtr & texture, Ogre::Camera* camera)
+    {
+        Ogre::RenderTarget* renderTarget = texture->getBuffer()->getRenderTarget();
         renderTarget->addViewport(camera);
         renderTarget->setAutoUpdated(true);
 
@@ -91,25 +95,40 @@ namespace OgreEffect
     {     
         if(nullptr != Ogre::Root::getSingletonPtr())
         {
-            if (nullptr != mSceneManager)
+            ReleaseScene();
+        }
+    }
+    //-------------------------------------------------------
+    void PostEffectComplex::ReleaseScene()
+    {
+        if (nullptr != mSceneManager)
+        {
+            if (nullptr != mRenderTarget)
+            {
+                mRenderTarget->removeAllListeners();
+                mRenderTarget->removeAllViewports();
+                Ogre::TextureManager::getSingleton().remove(mRtName);
+            }
+            if (nullptr != mCamera)
             {
-                if (nullptr != mRenderTarget)
-                {
-                    mRenderTarget->removeAllListeners();
-                    mRenderTarget->removeAllViewports();
-                    Ogre::TextureManager::getSingleton().remove(mRtName);
-                }
-                if (nullptr != mCamera)
-                {
-                    mSceneManager->destroyCamera(mCamera);
-                }
-                if (nullptr != mRootNode)
-                {
-                    mRootNode->removeAndDestroyAllChildren();
-                }
-                Ogre::Root::getSingleton().destroySceneManager(mSceneManager);
+                mSceneManager->destroyCamera(mCamera);
             }
+            if (nullptr != mRootNode)
+            {
+                mRootNode->removeAndDestroyAllChildren();
+            }
+            Ogre::Root::getSingleton().destroySceneManager(mSceneManager);
         }
+        mSceneManager = nullptr;
+        mRenderTarget = nullptr;
+        mCamera = nullptr;
+        mViewport = nullptr;
+        mRootNode = nullptr;
+    }
+    //-------------------------------------------------------
+    void PostEffectComplex::DoRelease()
+    {
+        ReleaseScene();
     }
     //-------------------------------------------------------
     void PostEffectComplex::DoPrepare()
@@ -150,6 +169,31 @@ namespace OgreEffect
         DoSetupScene();
     }
     //-------------------------------------------------------
+    void PostEffectComplex::DoResize(size_t width, size_t height)
+    {
+        assert(nullptr != mRenderTarget);
+        mCamera->setAspectRatio(static_cast<Ogre::Real>(width) / height);
+
+        Ogre::TexturePtr rtTexture = Ogre::TextureManager::getSingleton().getByName(mRtName);
+        if ((rtTexture->getWidth() == width) && (rtTexture->getHeight() == height))
+        {
+            return;
+        }
+        //The texture object is kept, so materials referencing it by name stay valid
+        mRenderTarget->removeAllListeners();
+        mRenderTarget->removeAllViewports();
+        rtTexture->freeInternalResources();
+        rtTexture->setWidth(static_cast<Ogre::uint32>(width));
+        rtTexture->setHeight(static_cast<Ogre::uint32>(height));
+        rtTexture->createInternalResources();
+
+        mRenderTarget = SetupRenderTarget(rtTexture, mCamera);
+        mRenderTarget->addListener(this);
+
+        mViewport = mRenderTarget->getViewport(0);
+        mViewport->setBackgroundColour(Ogre::ColourValue(0.0f, 0.0f, 0.0f, 0.0f));
+    }
+    //-------------------------------------------------------
     PostEffect::MaterialsVector PostEffectComplex::CreateEffectMaterialPrototypes()
     {
         //Prepare material
@@ -161,17 +205,13 @@ namespace OgreEffect
             Ogre::Pass* pass = techniqueGL->getPass(0);
 
             {
-                auto vprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/V/ComplexEffectBlend/" + GetUniquePostfix(),
-                    Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_VERTEX_PROGRAM);
-                vprogram->setSource(Shader_GL_Blend_V);
+                auto vprogram = AcquireProgram(Ogre::GPT_VERTEX_PROGRAM, Shader_GL_Blend_V);
 
                 pass->setVertexProgram(vprogram->getName());
             }
 
             {
-                auto fprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/F/ComplexEffectBlend/" + GetUniquePostfix(),
-                    Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_FRAGMENT_PROGRAM);
-                fprogram->setSource(Shader_GL_Blend_F);
+                auto fprogram = AcquireProgram(Ogre::GPT_FRAGMENT_PROGRAM, Shader_GL_Blend_F);
 
                 auto unit0 = pass->createTextureUnitState(mRtName);
                 unit0->setTextureAddressingMode(Ogre::TextureUnitState::TAM_CLAMP);
@@ -193,13 +233,16 @@ namespace OgreEffect
 
     }
     //-------------------------------------------------------
-    void PostEffectComplex::DoInit(Ogre::MaterialPtr & material)
+    void PostEffectComplex::DoInit(size_t passId, Ogre::MaterialPtr & material)
     {
-        (void)material;
+        (void)passId;
+        //The prototype refers to the render target of the instance which created it
+        material->getTechnique(0)->getPass(0)->getTextureUnitState(0)->setTextureName(mRtName);
     }
     //-------------------------------------------------------
-    void PostEffectComplex::DoUpdate(Ogre::MaterialPtr & material, Ogre::Real time)
+    void PostEffectComplex::DoUpdate(size_t passId, Ogre::MaterialPtr & material, Ogre::Real time)
     {
+        (void)passId;
         (void)material;
         DoUpdateScene(time);
     }
@@ -32,28 +32,45 @@ namespace OgreEffect
     {
     private:
         static Ogre::RenderTarget* CreateRenderTarget(const Ogre::String & name, Ogre::Camera* camera, size_t width, size_t height);
+        //Add a viewport of the camera to the texture's render target
+        static Ogre::RenderTarget* SetupRenderTarget(Ogre::TexturePtr & texture, Ogre::Camera* camera);
         //-------------------------------------------------------
 
         Ogre::String mRtName;
-        Ogre::RenderTarget* mRenderTarget;
+        Ogre::RenderTarget* mRenderTarget = nullptr;
+
+        //Destroy the scene and the render target
+        void ReleaseScene();
 
         //The material will be created automatically
         //Derived classes should set up a scene in DoSetupScene()
         MaterialsVector CreateEffectMaterialPrototypes() override;
 
         //Override PostEffect methods
-        void DoInit(Ogre::MaterialPtr & material) override;
-        void DoUpdate(Ogre::MaterialPtr & material, Ogre::Real time) override;
+        void DoInit(size_t passId, Ogre::MaterialPtr & material) override;
+        void DoUpdate(size_t passId, Ogre::MaterialPtr & material, Ogre::Real time) override;
+
+        //The scene is updated with the only pass
+        bool IsDynamicPass(size_t passId) const override
+        {
+            return 0 == passId;
+        }
 
         void DoPrepare() override;
 
+        //Recreate the render target with the new size
+        void DoResize(size_t width, size_t height) override;
+
     protected:
-        Ogre::SceneManager* mSceneManager;
-        Ogre::Camera* mCamera;
-        Ogre::Viewport* mViewport;
-        Ogre::SceneNode* mRootNode;
+        Ogre::SceneManager* mSceneManager = nullptr;
+        Ogre::Camera* mCamera = nullptr;
+        Ogre::Viewport* mViewport = nullptr;
+        Ogre::SceneNode* mRootNode = nullptr;
         //-------------------------------------------------------
 
+        //Destroys the scene; Derived classes should call it if they override the method
+        void DoRelease() override;
+
         /**
          *	Set up a scene for the post effect
          *  Use local SceneManager, Camera, Viewport and SceneNode instead of calling Ogre Root
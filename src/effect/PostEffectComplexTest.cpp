@@ -20,7 +20,6 @@
 #include <OgreTechnique.h>
 #include <OgrePass.h>
 #include <OgreHighLevelGpuProgram.h>
-#include <OgreHighLevelGpuProgramManager.h>
 
 namespace
 {
@@ -78,17 +77,13 @@ namespace OgreEffect
                 Ogre::Pass* pass = techniqueGL->getPass(0);
 
                 {
-                    auto vprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/V/Trans/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_VERTEX_PROGRAM);
-                    vprogram->setSource(Shader_GL_Trans_V);
+                    auto vprogram = AcquireProgram(Ogre::GPT_VERTEX_PROGRAM, Shader_GL_Trans_V);
 
                     pass->setVertexProgram(vprogram->getName());
                 }
 
                 {
-                    auto fprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/F/Trans/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_FRAGMENT_PROGRAM);
-                    fprogram->setSource(Shader_GL_Trans_F);
+                    auto fprogram = AcquireProgram(Ogre::GPT_FRAGMENT_PROGRAM, Shader_GL_Trans_F);
 
                     pass->setFragmentProgram(fprogram->getName());
                 }
@@ -14,7 +14,6 @@
 #include <OgreMaterial.h>
 #include <OgreMaterialManager.h>
 #include <OgreHighLevelGpuProgram.h>
-#include <OgreHighLevelGpuProgramManager.h>
 #include <OgreTechnique.h>
 #include <OgrePass.h>
 #include <OgreRenderWindow.h>
@@ -70,17 +69,13 @@ namespace OgreEffect
                 Ogre::Pass* pass = techniqueGL->getPass(0);
 
                 {
-                    auto vprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/V/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_VERTEX_PROGRAM);
-                    vprogram->setSource(Shader_GL_Copy_V);
+                    auto vprogram = AcquireProgram(Ogre::GPT_VERTEX_PROGRAM, Shader_GL_Copy_V);
 
                     pass->setVertexProgram(vprogram->getName());
                 }
 
                 {
-                    auto fprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/F/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_FRAGMENT_PROGRAM);
-                    fprogram->setSource(Shader_GL_Copy_F);
+                    auto fprogram = AcquireProgram(Ogre::GPT_FRAGMENT_PROGRAM, Shader_GL_Copy_F);
 
                     auto unit0 = pass->createTextureUnitState(TEXTURE_MARKER_SCENE);
                     unit0->setTextureAddressingMode(Ogre::TextureUnitState::TAM_CLAMP);
@@ -90,7 +85,7 @@ namespace OgreEffect
                 }
             }
             
-            auto output1 = CreateOutputTexture(material1->getName(), mRenderWindow->getWidth() / 2, mRenderWindow->getHeight() / 2);
+            auto output1 = CreateRelativeOutputTexture(material1->getName(), 0.5f, 0.5f);
 
             Ogre::MaterialPtr material2 = Ogre::MaterialManager::getSingleton().create(
                 "Material/Downsample2/" + GetUniquePostfix(), Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
@@ -100,17 +95,13 @@ namespace OgreEffect
                 Ogre::Pass* pass = techniqueGL->getPass(0);
 
                 {
-                    auto vprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/V/2/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_VERTEX_PROGRAM);
-                    vprogram->setSource(Shader_GL_Copy_V);
+                    auto vprogram = AcquireProgram(Ogre::GPT_VERTEX_PROGRAM, Shader_GL_Copy_V);
 
                     pass->setVertexProgram(vprogram->getName());
                 }
 
                 {
-                    auto fprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/F/2/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_FRAGMENT_PROGRAM);
-                    fprogram->setSource(Shader_GL_Copy_F);
+                    auto fprogram = AcquireProgram(Ogre::GPT_FRAGMENT_PROGRAM, Shader_GL_Copy_F);
 
                     auto unit0 = pass->createTextureUnitState(output1);
                     unit0->setTextureAddressingMode(Ogre::TextureUnitState::TAM_CLAMP);
@@ -120,7 +111,7 @@ namespace OgreEffect
                 }
             }
 
-            auto output2 = CreateOutputTexture(material2->getName(), mRenderWindow->getWidth() / 4, mRenderWindow->getHeight() / 4);
+            auto output2 = CreateRelativeOutputTexture(material2->getName(), 0.25f, 0.25f);
 
             Ogre::MaterialPtr material3 = Ogre::MaterialManager::getSingleton().create(
                 "Material/Downsample3/" + GetUniquePostfix(), Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
@@ -130,17 +121,13 @@ namespace OgreEffect
                 Ogre::Pass* pass = techniqueGL->getPass(0);
 
                 {
-                    auto vprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/V/3/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_VERTEX_PROGRAM);
-                    vprogram->setSource(Shader_GL_Copy_V);
+                    auto vprogram = AcquireProgram(Ogre::GPT_VERTEX_PROGRAM, Shader_GL_Copy_V);
 
                     pass->setVertexProgram(vprogram->getName());
                 }
 
                 {
-                    auto fprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/F/3/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_FRAGMENT_PROGRAM);
-                    fprogram->setSource(Shader_GL_Copy_F);
+                    auto fprogram = AcquireProgram(Ogre::GPT_FRAGMENT_PROGRAM, Shader_GL_Copy_F);
 
                     auto unit0 = pass->createTextureUnitState(output2);
                     unit0->setTextureAddressingMode(Ogre::TextureUnitState::TAM_CLAMP);
@@ -150,7 +137,7 @@ namespace OgreEffect
                 }
             }
 
-            auto output3 = CreateOutputTexture(material3->getName(), mRenderWindow->getWidth() / 8, mRenderWindow->getHeight() / 8);
+            auto output3 = CreateRelativeOutputTexture(material3->getName(), 0.125f, 0.125f);
 
             Ogre::MaterialPtr material4 = Ogre::MaterialManager::getSingleton().create(
                 "Material/Downsample4/" + GetUniquePostfix(), Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
@@ -160,17 +147,13 @@ namespace OgreEffect
                 Ogre::Pass* pass = techniqueGL->getPass(0);
 
                 {
-                    auto vprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/V/4/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_VERTEX_PROGRAM);
-                    vprogram->setSource(Shader_GL_Copy_V);
+                    auto vprogram = AcquireProgram(Ogre::GPT_VERTEX_PROGRAM, Shader_GL_Copy_V);
 
                     pass->setVertexProgram(vprogram->getName());
                 }
 
                 {
-                    auto fprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/F/4/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_FRAGMENT_PROGRAM);
-                    fprogram->setSource(Shader_GL_Copy_F);
+                    auto fprogram = AcquireProgram(Ogre::GPT_FRAGMENT_PROGRAM, Shader_GL_Copy_F);
 
                     auto unit0 = pass->createTextureUnitState(output3);
                     unit0->setTextureAddressingMode(Ogre::TextureUnitState::TAM_CLAMP);
@@ -22,5 +22,11 @@ namespace OgreEffect
     {
     }
     //-------------------------------------------------------
+    void PostEffectFactory::DestroyInstance(PostEffect* effect)
+    {
+        effect->DestroyCompositor();
+        delete effect;
+    }
+    //-------------------------------------------------------
 
 }//namespace OgreEffect
\ No newline at end of file
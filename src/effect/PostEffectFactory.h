@@ -31,6 +31,10 @@ namespace OgreEffect
         const Ogre::String mName;
         //-------------------------------------------------------
 
+        //Destroy the compositor of the effect and delete it; Is used to free pooled instances
+        static void DestroyInstance(PostEffect* effect);
+        //-------------------------------------------------------
+
     public:
         /**
          *	@param name Name of creating effects
@@ -51,28 +55,84 @@ namespace OgreEffect
         virtual PostEffect* Create() const = 0;
         /**
          *	Destroy effect instance
+         *  If the factory is pooling, the instance comes with its compositor detached but not destroyed
          */
         virtual void Destroy(PostEffect* effect) const = 0;
+
+        /**
+         *  Check if the factory keeps destroyed instances for reuse
+         *  Created instances can be already built in this case
+         */
+        virtual bool IsPooling() const
+        {
+            return false;
+        }
+
+        /**
+         *  Free the pooled instances; Should be called while the render system is alive
+         */
+        virtual void ReleasePool() const
+        { }
     };
 
 
+    /**
+     *  Factory creating instances with the new operator
+     *  If the pool capacity is not zero, destroyed instances are kept with their built compositors and 
+     *  handed out by the next Create() calls, most recently destroyed first; The oldest instances above 
+     *  the capacity are freed. Reused instances get their initial parameters back, but keep their names
+     */
     template <class EffectType>
     class DefaultPostEffectFactory : public PostEffectFactory
     {
         mutable size_t mIdCounter = 0;
+        const size_t mPoolCapacity;
+        mutable Ogre::list<PostEffect*>::type mPool;
     public:
-        DefaultPostEffectFactory(const Ogre::String & name) :
-            PostEffectFactory(name)
+        DefaultPostEffectFactory(const Ogre::String & name, size_t poolCapacity = 0) :
+            PostEffectFactory(name), mPoolCapacity(poolCapacity)
         {
             assert(false == name.empty());
         }
+        virtual ~DefaultPostEffectFactory()
+        {
+            ReleasePool();
+        }
         virtual PostEffect* Create() const override
         {
+            if (false == mPool.empty())
+            {
+                PostEffect* effect = mPool.front();
+                mPool.pop_front();
+                return effect;
+            }
             return new EffectType(mName, mIdCounter++);
         }
         virtual void Destroy(PostEffect* effect) const override
         {
-            delete effect;
+            if (0 == mPoolCapacity)
+            {
+                delete effect;
+                return;
+            }
+            mPool.push_front(effect);
+            if (mPool.size() > mPoolCapacity)
+            {
+                DestroyInstance(mPool.back());
+                mPool.pop_back();
+            }
+        }
+        virtual bool IsPooling() const override
+        {
+            return 0 != mPoolCapacity;
+        }
+        virtual void ReleasePool() const override
+        {
+            for (PostEffect* effect : mPool)
+            {
+                DestroyInstance(effect);
+            }
+            mPool.clear();
         }
     };
 
@@ -12,11 +12,11 @@
 
 #include "PostEffectFactory.h"
 #include "PostEffectManager.h"
+#include "PostEffectUniform.h"
 
 #include <OgreMaterial.h>
 #include <OgreMaterialManager.h>
 #include <OgreHighLevelGpuProgram.h>
-#include <OgreHighLevelGpuProgramManager.h>
 #include <OgreTechnique.h>
 #include <OgrePass.h>
 
@@ -53,29 +53,20 @@ namespace OgreEffect
 
     class PostEffectFading : public PostEffect
     {
-        class CmdColourParameter : public Ogre::ParamCommand
-        {
-        public:
-            Ogre::String doGet(const void* target) const
-            {
-                return Ogre::StringConverter::toString(static_cast<const PostEffectFading*>(target)->mColor);
-            }
-            void doSet(void* target, const Ogre::String& val)
-            {
-                static_cast<PostEffectFading*>(target)->mColor = Ogre::StringConverter::parseColourValue(val);
-            }
-        };
-        //-------------------------------------------------------
-        static CmdColourParameter msColorParameter;
-        //-------------------------------------------------------
-
-        Ogre::ColourValue mColor = Ogre::ColourValue(0.0, 0.0, 0.5);
+        const ParameterId mColorParameter;
+        const ParameterId mPulseParameter;
+        PostEffectUniform mFadeColorUniform;
+        //the color in the program of the fusion the effect is a member of
+        PostEffectUniform mFusedFadeColorUniform;
 
     public:
         PostEffectFading(const Ogre::String& name, size_t id) :
-            PostEffect(name, id)
+            PostEffect(name, id),
+            mColorParameter(AddParameter("color", "Color of the fading effect", VT_COLOUR)),
+            mPulseParameter(AddParameter("pulse", "Animate the opacity automatically; Otherwise the color's alpha is used", VT_BOOL))
         {
-
+            SetColour(mColorParameter, Ogre::ColourValue(0.0, 0.0, 0.5));
+            SetBool(mPulseParameter, true);
         }
         virtual ~PostEffectFading()
         {
@@ -98,16 +89,12 @@ namespace OgreEffect
                 Ogre::Pass* pass = techniqueGL->getPass(0);
 
                 {
-                    auto vprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/V/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_VERTEX_PROGRAM);
-                    vprogram->setSource(Shader_GL_Fading_V);
+                    auto vprogram = AcquireProgram(Ogre::GPT_VERTEX_PROGRAM, Shader_GL_Fading_V);
                     pass->setVertexProgram(vprogram->getName());
                 }
 
                 {
-                    auto fprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/F/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_FRAGMENT_PROGRAM);
-                    fprogram->setSource(Shader_GL_Fading_F);
+                    auto fprogram = AcquireProgram(Ogre::GPT_FRAGMENT_PROGRAM, Shader_GL_Fading_F);
                     pass->setFragmentProgram(fprogram->getName());
 
                     auto unit0 = pass->createTextureUnitState(TEXTURE_MARKER_SCENE);
@@ -116,43 +103,67 @@ namespace OgreEffect
 
                     auto fparams = pass->getFragmentProgramParameters();
                     fparams->setNamedConstant("texture", 0);
-                    fparams->setNamedConstant("fadecolor", Ogre::Vector4(mColor[0], mColor[1], mColor[2], 0.5));
+                    const Ogre::ColourValue color = GetColour(mColorParameter);
+                    fparams->setNamedConstant("fadecolor", Ogre::Vector4(color.r, color.g, color.b, 0.5));
                 }
             }
             material->load();
             return { material.get() };
         }
 
-        virtual void DoCreateParametersDictionary(Ogre::ParamDictionary* dictionary) override
+        virtual void DoInit(size_t passId, Ogre::MaterialPtr & material) override
         {
-            assert(nullptr != dictionary);
-            dictionary->addParameter(
-                Ogre::ParameterDef("color", "Color of the fading effect", Ogre::PT_COLOURVALUE),
-                &msColorParameter);
+            if (0 == passId)
+            {
+                mFadeColorUniform.Bind(material->getBestTechnique()->getPass(0)->getFragmentProgramParameters(), "fadecolor");
+            }
         }
 
-        virtual void DoInit(Ogre::MaterialPtr & material)
+        Ogre::Vector4 GetFadeColor(Ogre::Real time) const
         {
-            (void)material;
+            const Ogre::ColourValue color = GetColour(mColorParameter);
+            if (false == GetBool(mPulseParameter))
+            {
+                return Ogre::Vector4(color.r, color.g, color.b, color.a);
+            }
+            Ogre::Real alpha = static_cast<Ogre::Real>(0.1 + std::fabs(std::sin(time)) * 0.5);
+            return Ogre::Vector4(color.r, color.g, color.b, alpha);
         }
 
-        virtual void DoUpdate(Ogre::MaterialPtr & material, Ogre::Real time)
+        virtual bool IsDynamicPass(size_t passId) const override
         {
+            return 0 == passId;
+        }
+
+        virtual void DoUpdate(size_t passId, Ogre::MaterialPtr & material, Ogre::Real time) override
+        {
+            (void)passId;
             (void)material;
-            (void)time;
+            mFadeColorUniform.Set(GetFadeColor(time));
+        }
 
-            Ogre::Real alpha = static_cast<Ogre::Real>(0.1 + std::fabs(std::sin(time)) * 0.5);
+        virtual bool GetPixelFunction(PixelFunction & function) const override
+        {
+            const Ogre::String fadecolor = PIXEL_FUNCTION_PREFIX + "fadecolor";
+            function.uniforms = "uniform vec4 " + fadecolor + ";";
+            function.body = "color = vec4(mix(color.rgb, " + fadecolor + ".rgb, " + fadecolor + ".a), 1.0);\n";
+            return true;
+        }
 
-            auto fparams = material->getBestTechnique()->getPass(0)->getFragmentProgramParameters();
-            fparams->setNamedConstant("fadecolor", Ogre::Vector4(mColor[0], mColor[1], mColor[2], alpha));
+        virtual void BindPixelFunction(const Ogre::GpuProgramParametersSharedPtr & params, const Ogre::String & prefix) override
+        {
+            mFusedFadeColorUniform.Bind(params, prefix + "fadecolor");
         }
-    };
 
-    PostEffectFading::CmdColourParameter PostEffectFading::msColorParameter;
+        virtual void UpdatePixelFunction(Ogre::Real time) override
+        {
+            mFusedFadeColorUniform.Set(GetFadeColor(time));
+        }
+    };
 
     IMPLEMENT_REGISTRATION_FUNCTION(EffectFading)
     {
-        Ogre::SharedPtr<PostEffectFactory> factory(new DefaultPostEffectFactory<PostEffectFading>(PostEffectManager::PE_FADING));
+        Ogre::SharedPtr<PostEffectFactory> factory(new DefaultPostEffectFactory<PostEffectFading>(PostEffectManager::PE_FADING, 2));
         manager->RegisterPostEffectFactory(factory);
     }
 
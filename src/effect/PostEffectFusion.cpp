@@ -0,0 +1,151 @@
+/**
+* @file PostEffectFusion.cpp
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+#include "PostEffectFusion.h"
+
+#include <OgreMaterial.h>
+#include <OgreMaterialManager.h>
+#include <OgreHighLevelGpuProgram.h>
+#include <OgreTechnique.h>
+#include <OgrePass.h>
+#include <OgreStringConverter.h>
+
+namespace
+{
+    static const char Shader_GL_Fusion_V[] = ""
+        "#version 120                                                              \n"
+        "                                                                          \n"
+        "                                                                          \n"
+        "void main()                                                               \n"
+        "{                                                                         \n"
+        "    gl_TexCoord[0] = gl_MultiTexCoord0;                                   \n"
+        "    gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;               \n"
+        "}                                                                         \n"
+        "";
+
+    static const char Shader_GL_Fusion_F_Header[] = ""
+        "#version 120                                                              \n"
+        "                                                                          \n"
+        "uniform sampler2D texture;                                                \n"
+        "";
+
+    static const char Shader_GL_Fusion_F_Begin[] = ""
+        "                                                                          \n"
+        "void main()                                                               \n"
+        "{                                                                         \n"
+        "    vec4 color = texture2D(texture, gl_TexCoord[0].st);                   \n"
+        "";
+
+    static const char Shader_GL_Fusion_F_End[] = ""
+        "    gl_FragColor = color;                                                 \n"
+        "}                                                                         \n"
+        "";
+}
+
+namespace OgreEffect
+{
+
+    Ogre::String PostEffectFusion::GetMemberPrefix(size_t memberIdx)
+    {
+        return "fused" + Ogre::StringConverter::toString(memberIdx) + "_";
+    }
+    //-------------------------------------------------------
+    Ogre::String PostEffectFusion::GetFusionTypeName(const EffectsVector & members)
+    {
+        Ogre::String name = "PostEffect/Fusion";
+        for (const PostEffect* member : members)
+        {
+            name += "/" + member->GetTypeName();
+        }
+        return name;
+    }
+    //-------------------------------------------------------
+    PostEffectFusion::PostEffectFusion(const EffectsVector & members, size_t id) :
+        PostEffect(GetFusionTypeName(members), id), mMembers(members)
+    {
+        assert(mMembers.size() > 1);
+    }
+    //-------------------------------------------------------
+    PostEffectFusion::~PostEffectFusion()
+    {
+
+    }
+    //-------------------------------------------------------
+    PostEffect::MaterialsVector PostEffectFusion::CreateEffectMaterialPrototypes()
+    {
+        //Generate the fragment program: every member modifies the color in its own scope
+        Ogre::String uniforms;
+        Ogre::String body;
+        for (size_t memberIdx = 0; memberIdx < mMembers.size(); ++memberIdx)
+        {
+            PixelFunction function;
+            if (false == mMembers[memberIdx]->GetPixelFunction(function))
+            {
+                OGRE_EXCEPT(Ogre::Exception::ERR_INVALIDPARAMS, "The effect " + mMembers[memberIdx]->GetTypeName() + " is not a per-pixel one", "PostEffectFusion[CreateEffectMaterialPrototypes]");
+            }
+            const Ogre::String prefix = GetMemberPrefix(memberIdx);
+            uniforms += Ogre::StringUtil::replaceAll(function.uniforms, PIXEL_FUNCTION_PREFIX, prefix) + "\n";
+            body += "    {\n" + Ogre::StringUtil::replaceAll(function.body, PIXEL_FUNCTION_PREFIX, prefix) + "\n    }\n";
+        }
+        const Ogre::String source = Ogre::String(Shader_GL_Fusion_F_Header) + uniforms + Shader_GL_Fusion_F_Begin + body + Shader_GL_Fusion_F_End;
+
+        Ogre::MaterialPtr material = Ogre::MaterialManager::getSingleton().create(
+            "Material/PostEffect/" + GetUniquePostfix(), Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+
+        {
+            Ogre::Technique* techniqueGL = material->getTechnique(0);
+            Ogre::Pass* pass = techniqueGL->getPass(0);
+
+            {
+                auto vprogram = AcquireProgram(Ogre::GPT_VERTEX_PROGRAM, Shader_GL_Fusion_V);
+                pass->setVertexProgram(vprogram->getName());
+            }
+
+            {
+                auto fprogram = AcquireProgram(Ogre::GPT_FRAGMENT_PROGRAM, source);
+                pass->setFragmentProgram(fprogram->getName());
+
+                auto unit0 = pass->createTextureUnitState(TEXTURE_MARKER_SCENE);
+                unit0->setTextureAddressingMode(Ogre::TextureUnitState::TAM_CLAMP);
+                unit0->setTextureFiltering(Ogre::TFO_NONE);
+
+                auto fparams = pass->getFragmentProgramParameters();
+                fparams->setNamedConstant("texture", 0);
+            }
+        }
+        material->load();
+        return { material.get() };
+    }
+    //-------------------------------------------------------
+    void PostEffectFusion::DoInit(size_t passId, Ogre::MaterialPtr & material)
+    {
+        if (0 == passId)
+        {
+            auto fparams = material->getBestTechnique()->getPass(0)->getFragmentProgramParameters();
+            for (size_t memberIdx = 0; memberIdx < mMembers.size(); ++memberIdx)
+            {
+                mMembers[memberIdx]->BindPixelFunction(fparams, GetMemberPrefix(memberIdx));
+            }
+        }
+    }
+    //-------------------------------------------------------
+    void PostEffectFusion::DoUpdate(size_t passId, Ogre::MaterialPtr & material, Ogre::Real time)
+    {
+        (void)passId;
+        (void)material;
+        //Members keep their own time, so it doesn't restart when the fusion is recreated
+        const Ogre::Real globalTime = mStartTime + time;
+        for (PostEffect* member : mMembers)
+        {
+            member->UpdatePixelFunction(member->GetEffectTime(globalTime));
+        }
+    }
+
+}//namespace OgreEffect
@@ -0,0 +1,69 @@
+/**
+* @file PostEffectFusion.h
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+#ifndef _POSTEFFECT_FUSION_H_
+#define _POSTEFFECT_FUSION_H_
+
+#include "PostEffect.h"
+
+namespace OgreEffect
+{
+
+    /**
+     * Single pass effect applying pixel functions of several per-pixel effects
+     * Is created by the PostEffectManager instead of consecutive enabled effects
+     */
+    class PostEffectFusion : public PostEffect
+    {
+    public:
+        using EffectsVector = Ogre::vector<PostEffect*>::type;
+        //-------------------------------------------------------
+
+    private:
+        const EffectsVector mMembers;
+        //-------------------------------------------------------
+
+        //Prefix of the member uniforms in the fused program
+        static Ogre::String GetMemberPrefix(size_t memberIdx);
+
+        MaterialsVector CreateEffectMaterialPrototypes() override;
+
+        bool IsDynamicPass(size_t passId) const override
+        {
+            return 0 == passId;
+        }
+
+        void DoInit(size_t passId, Ogre::MaterialPtr & material) override;
+
+        void DoUpdate(size_t passId, Ogre::MaterialPtr & material, Ogre::Real time) override;
+
+    public:
+        /**
+         * Get type name of a fusion of the effects
+         * Fusions of the same effect types share materials
+         */
+        static Ogre::String GetFusionTypeName(const EffectsVector & members);
+
+        /**
+         * @param members effects to fuse; all of them should provide a pixel function
+         */
+        PostEffectFusion(const EffectsVector & members, size_t id);
+
+        virtual ~PostEffectFusion();
+
+        const EffectsVector & GetMembers() const
+        {
+            return mMembers;
+        }
+    };
+
+}//namespace OgreEffect
+
+#endif //_POSTEFFECT_FUSION_H_
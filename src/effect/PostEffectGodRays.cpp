@@ -10,14 +10,22 @@
 
 #include "PostEffectFactory.h"
 #include "PostEffectManager.h"
+#include "PostEffectUniform.h"
+#include "PostEffectScenePyramid.h"
 
 #include <OgreMaterial.h>
 #include <OgreMaterialManager.h>
 #include <OgreHighLevelGpuProgram.h>
-#include <OgreHighLevelGpuProgramManager.h>
 #include <OgreTechnique.h>
 #include <OgrePass.h>
 #include <OgreRenderWindow.h>
+#include <OgreViewport.h>
+#include <OgreCamera.h>
+#include <OgreLight.h>
+#include <OgreSceneManager.h>
+#include <OgreStringInterface.h>
+
+#include <algorithm>
 
 namespace
 {
@@ -72,6 +80,7 @@ namespace
         "                                                                                                   \n"
         "uniform sampler2D texture;                                                                         \n"
         "uniform vec2 lightPosition;  //from [0,1] in screen space                                          \n"
+        "uniform float intensity;     //fades the rays of the light leaving the screen                      \n"
         "                                                                                                   \n"
         "void main()                                                                                        \n"
         "{                                                                                                  \n"
@@ -87,7 +96,7 @@ namespace
         "        color += sample;                                                                           \n"
         "        illuminationDecay *= decay;                                                                \n"
         "    }                                                                                              \n"
-        "    gl_FragColor = vec4(exposure * color, 1.0);                                                    \n"
+        "    gl_FragColor = vec4(intensity * exposure * color, 1.0);                                        \n"
         "}                                                                                                  \n"
         "";
 
@@ -104,6 +113,9 @@ namespace
         "    gl_FragColor = vec4(clamp(rgb + 0.7 * bloom.rgb, 0.0, 1.0), 1.0);           \n"
         "}                                                                         \n"
         "";
+
+    //Intensity of the rays unculling the effect
+    static const Ogre::Real GODRAYS_UNCULL_INTENSITY = 0.05f;
 }
 
 namespace OgreEffect
@@ -111,213 +123,311 @@ namespace OgreEffect
 
     class PostEffectGodRays : public PostEffect
     {
-        Ogre::String blurName1;
-        Ogre::String blurName2;
-    public:
-        PostEffectGodRays(const Ogre::String& name, size_t id) :
-            PostEffect(name, id)
+        //Index of the first radial blur pass without and with the scene pyramid; The second one follows it
+        static const size_t PASS_BLUR = 3;
+        static const size_t PYRAMID_PASS_BLUR = 1;
+
+        PostEffectUniform mLightPositionUniforms[2];
+        //the rays are faded by the first blur pass only
+        PostEffectUniform mIntensityUniform;
+
+        const ParameterId mLightPositionParameter;
+        const ParameterId mLightDirectionParameter;
+        const ParameterId mFadeDistanceParameter;
+
+        //Name of the Ogre::Light of the camera's scene; Is exposed as the string parameter "light"
+        Ogre::String mLightName;
+
+        //StringInterface command of the light name
+        class CmdLight : public Ogre::ParamCommand
         {
+        public:
+            Ogre::String doGet(const void* target) const override
+            {
+                return static_cast<const PostEffectGodRays*>(static_cast<const Ogre::StringInterface*>(target))->mLightName;
+            }
 
-        }
-        virtual ~PostEffectGodRays()
+            void doSet(void* target, const Ogre::String& val) override
+            {
+                static_cast<PostEffectGodRays*>(static_cast<Ogre::StringInterface*>(target))->mLightName = val;
+            }
+        };
+
+        //Screen space state of the light in the current frame
+        struct LightState
         {
+            Ogre::Vector2 position; ///< in [0,1] if the light is on the screen
+            Ogre::Real intensity;   ///< 0 if the rays are not visible
+        };
 
-        }
+        //The light is projected once per frame and shared by the culling and both blur passes
+        LightState mLightState;
+        unsigned long mLightStateFrame = static_cast<unsigned long>(-1);
 
-        virtual MaterialsVector CreateEffectMaterialPrototypes() override
+        //Texture unit of a material; Empty name is bound by the pass graph
+        struct Unit
         {
-            Ogre::MaterialPtr materialThreshold = Ogre::MaterialManager::getSingleton().create(
-                "Material/PostEffect/" + GetUniquePostfix() + "/Threshold", Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+            Ogre::String texture;
+            Ogre::TextureFilterOptions filtering;
+        };
+
+        //Homogeneous world position of the light; w is 0 for the directional ones
+        //Returns false if no world space light is set
+        bool GetWorldLight(const Ogre::Camera* camera, Ogre::Vector4 & light) const
+        {
+            Ogre::SceneManager* sceneManager = camera->getSceneManager();
+            if ((false == mLightName.empty()) && (nullptr != sceneManager) && (true == sceneManager->hasLight(mLightName)))
             {
-                Ogre::Technique* techniqueGL = materialThreshold->getTechnique(0);
-                Ogre::Pass* pass = techniqueGL->getPass(0);
+                const Ogre::Light* sceneLight = sceneManager->getLight(mLightName);
+                if (Ogre::Light::LT_DIRECTIONAL == sceneLight->getType())
                 {
-                    auto vprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/V/Threshold/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_VERTEX_PROGRAM);
-                    vprogram->setSource(Shader_GL_Common_V);
-                    pass->setVertexProgram(vprogram->getName());
+                    const Ogre::Vector3 direction = -sceneLight->getDerivedDirection();
+                    light = Ogre::Vector4(direction.x, direction.y, direction.z, 0.0f);
                 }
+                else
                 {
-                    auto fprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/F/Threshold/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_FRAGMENT_PROGRAM);
-                    fprogram->setSource(Shader_GL_Threshold_F);
-
-                    auto unit0 = pass->createTextureUnitState(TEXTURE_MARKER_SCENE);
-                    unit0->setTextureAddressingMode(Ogre::TextureUnitState::TAM_CLAMP);
-                    unit0->setTextureFiltering(Ogre::TFO_NONE);
-
-                    pass->setFragmentProgram(fprogram->getName());
+                    const Ogre::Vector3 position = sceneLight->getDerivedPosition();
+                    light = Ogre::Vector4(position.x, position.y, position.z, 1.0f);
                 }
+                return true;
             }
-            auto outputThreshold = CreateOutputTexture(materialThreshold->getName(), mRenderWindow->getWidth() / 2, mRenderWindow->getHeight() / 2);
-            //-------------------------------------------------------
+            const Ogre::Vector3 direction = GetVector3(mLightDirectionParameter);
+            if (false == direction.isZeroLength())
+            {
+                light = Ogre::Vector4(direction.x, direction.y, direction.z, 0.0f);
+                return true;
+            }
+            return false;
+        }
 
-            Ogre::MaterialPtr materialDownsample = Ogre::MaterialManager::getSingleton().create(
-                "Material/Downsample/" + GetUniquePostfix(), Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+        //Project the world space light through the viewport's camera
+        //Without a world space light the screen space position is used as is
+        LightState ComputeLightState() const
+        {
+            LightState state = { GetVector2(mLightPositionParameter), 1.0f };
+            const Ogre::Viewport* viewport = GetViewport();
+            const Ogre::Camera* camera = (nullptr != viewport) ? viewport->getCamera() : nullptr;
+            Ogre::Vector4 light;
+            if ((nullptr == camera) || (false == GetWorldLight(camera, light)))
+            {
+                return state;
+            }
+            const Ogre::Vector4 clip = camera->getProjectionMatrix() * (camera->getViewMatrix() * light);
+            if (clip.w <= 0.0f)
+            {
+                //behind the camera
+                state.intensity = 0.0f;
+                return state;
+            }
+            state.position = Ogre::Vector2(0.5f + 0.5f * clip.x / clip.w, 0.5f - 0.5f * clip.y / clip.w);
 
+            //The rays fade out with the distance of the light from the screen; in the screen sizes
+            const Ogre::Real distance = std::max(std::max(-state.position.x, state.position.x - 1.0f), std::max(-state.position.y, state.position.y - 1.0f));
+            const Ogre::Real fadeDistance = GetFloat(mFadeDistanceParameter);
+            if (distance > 0.0f)
             {
-                Ogre::Technique* techniqueGL = materialDownsample->getTechnique(0);
-                Ogre::Pass* pass = techniqueGL->getPass(0);
-                {
-                    auto vprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/V/DS/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_VERTEX_PROGRAM);
-                    vprogram->setSource(Shader_GL_Common_V);
-                    pass->setVertexProgram(vprogram->getName());
-                }
-                {
-                    auto fprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/F/DS/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_FRAGMENT_PROGRAM);
-                    fprogram->setSource(Shader_GL_Copy_F);
+                state.intensity = (fadeDistance > 0.0f) ? std::max(1.0f - distance / fadeDistance, 0.0f) : 0.0f;
+            }
+            return state;
+        }
 
-                    auto unit0 = pass->createTextureUnitState(outputThreshold);
-                    unit0->setTextureAddressingMode(Ogre::TextureUnitState::TAM_CLAMP);
-                    unit0->setTextureFiltering(Ogre::TFO_BILINEAR);
+        const LightState & GetLightState()
+        {
+            const unsigned long frame = Ogre::Root::getSingleton().getNextFrameNumber();
+            if (frame != mLightStateFrame)
+            {
+                mLightState = ComputeLightState();
+                mLightStateFrame = frame;
+            }
+            return mLightState;
+        }
 
-                    pass->setFragmentProgram(fprogram->getName());
-                }
+        size_t GetBlurPass() const
+        {
+            if (true == IsScenePyramidUsed())
+            {
+                return PYRAMID_PASS_BLUR;
             }
-            auto outputDownsample = CreateOutputTexture(materialDownsample->getName(), mRenderWindow->getWidth() / 4, mRenderWindow->getHeight() / 4);
-            //-------------------------------------------------------
+            return PASS_BLUR;
+        }
 
-            Ogre::MaterialPtr materialDownsample2 = Ogre::MaterialManager::getSingleton().create(
-                "Material/Downsample2/" + GetUniquePostfix(), Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+        Ogre::MaterialPtr CreateGodRaysMaterial(const Ogre::String & materialName, const Ogre::String & fragmentSource, const Ogre::vector<Unit>::type & units)
+        {
+            Ogre::MaterialPtr material = Ogre::MaterialManager::getSingleton().create(materialName, Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
 
+            Ogre::Technique* techniqueGL = material->getTechnique(0);
+            Ogre::Pass* pass = techniqueGL->getPass(0);
+            {
+                auto vprogram = AcquireProgram(Ogre::GPT_VERTEX_PROGRAM, Shader_GL_Common_V);
+                pass->setVertexProgram(vprogram->getName());
+            }
             {
-                Ogre::Technique* techniqueGL = materialDownsample2->getTechnique(0);
-                Ogre::Pass* pass = techniqueGL->getPass(0);
+                auto fprogram = AcquireProgram(Ogre::GPT_FRAGMENT_PROGRAM, fragmentSource);
+
+                for (const Unit & unit : units)
                 {
-                    auto vprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/V/DS2/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_VERTEX_PROGRAM);
-                    vprogram->setSource(Shader_GL_Common_V);
-                    pass->setVertexProgram(vprogram->getName());
+                    auto unitState = pass->createTextureUnitState(unit.texture);
+                    unitState->setTextureAddressingMode(Ogre::TextureUnitState::TAM_CLAMP);
+                    unitState->setTextureFiltering(unit.filtering);
                 }
-                {
-                    auto fprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/F/DS2/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_FRAGMENT_PROGRAM);
-                    fprogram->setSource(Shader_GL_Copy_F);
-
-                    auto unit0 = pass->createTextureUnitState(outputDownsample);
-                    unit0->setTextureAddressingMode(Ogre::TextureUnitState::TAM_CLAMP);
-                    unit0->setTextureFiltering(Ogre::TFO_BILINEAR);
 
-                    pass->setFragmentProgram(fprogram->getName());
-                }
+                pass->setFragmentProgram(fprogram->getName());
             }
-            auto outputDownsample2 = CreateOutputTexture(materialDownsample2->getName(), mRenderWindow->getWidth() / 8, mRenderWindow->getHeight() / 8);
-            //-------------------------------------------------------
+            return material;
+        }
 
-            Ogre::MaterialPtr materialBlur = Ogre::MaterialManager::getSingleton().create(
-                "Material/PostEffect/" + GetUniquePostfix() + "/Blur", Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
-            blurName1 = materialBlur->getName();
-            {
-                Ogre::Technique* techniqueGL = materialBlur->getTechnique(0);
-                Ogre::Pass* pass = techniqueGL->getPass(0);
-                {
-                    auto vprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/V/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_VERTEX_PROGRAM);
-                    vprogram->setSource(Shader_GL_Common_V);
-                    pass->setVertexProgram(vprogram->getName());
-                }
-                {
-                    auto fprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/F/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_FRAGMENT_PROGRAM);
-                    fprogram->setSource(Shader_GL_Blur_F);
+    public:
+        PostEffectGodRays(const Ogre::String& name, size_t id) :
+            PostEffect(name, id),
+            mLightPositionParameter(AddParameter("light_position", "Position of the light in [0,1] screen space; Is used if no world space light is set", VT_VECTOR2)),
+            mLightDirectionParameter(AddParameter("light_direction", "World space direction to an infinitely distant light; Zero vector is not used", VT_VECTOR3)),
+            mFadeDistanceParameter(AddParameter("fade_distance", "Distance of the light from the screen, in the screen sizes, where the rays vanish", VT_FLOAT))
+        {
+            SetVector2(mLightPositionParameter, Ogre::Vector2(0.05f, 0.05f));
+            SetFloat(mFadeDistanceParameter, 0.5f);
+        }
+        virtual ~PostEffectGodRays()
+        {
+
+        }
 
-                    auto unit0 = pass->createTextureUnitState(outputDownsample2);
-                    unit0->setTextureAddressingMode(Ogre::TextureUnitState::TAM_CLAMP);
-                    unit0->setTextureFiltering(Ogre::TFO_BILINEAR);
+        virtual QualitySettings GetQualitySettings(QualityTier tier) const override
+        {
+            QualitySettings settings;
+            settings.resolutionScale = (QT_LOW == tier) ? 0.5f : ((QT_MEDIUM == tier) ? 0.75f : 1.0f);
+            return settings;
+        }
 
-                    pass->setFragmentProgram(fprogram->getName());
+        virtual void DoCreateParametersDictionary(Ogre::ParamDictionary* dictionary) override
+        {
+            //commands should live as long as the dictionaries
+            static CmdLight cmdLight;
+            dictionary->addParameter(Ogre::ParameterDef("light", "Name of a light of the camera's scene; Overrides the light direction", Ogre::PT_STRING), &cmdLight);
+        }
 
-                    auto fparams = pass->getFragmentProgramParameters();
-                    fparams->setNamedConstant("texture", 0);
-                    fparams->setNamedConstant("lightPosition", Ogre::Vector2(0.5f, 0.5f));
-                }
+        virtual void DoReset() override
+        {
+            mLightName.clear();
+            mLightStateFrame = static_cast<unsigned long>(-1);
+        }
+
+        virtual bool DoCull() override
+        {
+            //a culled light comes back only when the rays are noticeable, so the light on the boundary doesn't toggle the chain
+            const Ogre::Real intensity = GetLightState().intensity;
+            return (true == IsCulled()) ? (intensity < GODRAYS_UNCULL_INTENSITY) : (intensity <= 0.0f);
+        }
+
+        virtual Ogre::String GetPrototypesVariant() const override
+        {
+            return IsScenePyramidUsed() ? "p" : Ogre::StringUtil::BLANK;
+        }
+
+        virtual MaterialsVector CreateEffectMaterialPrototypes() override
+        {
+            const Ogre::Real scale = GetCurrentQualitySettings().resolutionScale;
+            MaterialsVector materials;
+
+            if (true == IsScenePyramidUsed())
+            {
+                //The scene pyramid provides the downsampled scene; It is thresholded at the 1/8 level, inputs are bound by the pass graph
+                materials.push_back(CreateGodRaysMaterial("Material/PostEffect/" + GetUniquePostfix() + "/Threshold", Shader_GL_Threshold_F, { { Ogre::StringUtil::BLANK, Ogre::TFO_BILINEAR } }).get());
+                materials.push_back(CreateGodRaysMaterial("Material/PostEffect/" + GetUniquePostfix() + "/Blur", Shader_GL_Blur_F, { { Ogre::StringUtil::BLANK, Ogre::TFO_BILINEAR } }).get());
+                materials.push_back(CreateGodRaysMaterial("Material/PostEffect/" + GetUniquePostfix() + "/Blur2", Shader_GL_Blur_F, { { Ogre::StringUtil::BLANK, Ogre::TFO_BILINEAR } }).get());
+                materials.push_back(CreateGodRaysMaterial("Material/Blend/" + GetUniquePostfix(), Shader_GL_Blend_F,
+                    { { Ogre::StringUtil::BLANK, Ogre::TFO_NONE }, { Ogre::StringUtil::BLANK, Ogre::TFO_BILINEAR } }).get());
             }
-            auto outputBlur = CreateOutputTexture(materialBlur->getName(), mRenderWindow->getWidth() / 8, mRenderWindow->getHeight() / 8);
-            //-------------------------------------------------------
-            Ogre::MaterialPtr materialBlur2 = Ogre::MaterialManager::getSingleton().create(
-                "Material/PostEffect/" + GetUniquePostfix() + "/Blur2", Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
-            blurName2 = materialBlur2->getName();
+            else
             {
-                Ogre::Technique* techniqueGL = materialBlur2->getTechnique(0);
-                Ogre::Pass* pass = techniqueGL->getPass(0);
-                {
-                    auto vprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/V/b2/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_VERTEX_PROGRAM);
-                    vprogram->setSource(Shader_GL_Common_V);
-                    pass->setVertexProgram(vprogram->getName());
-                }
-                {
-                    auto fprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/F/b2/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_FRAGMENT_PROGRAM);
-                    fprogram->setSource(Shader_GL_Blur_F);
+                Ogre::MaterialPtr materialThreshold = CreateGodRaysMaterial("Material/PostEffect/" + GetUniquePostfix() + "/Threshold", Shader_GL_Threshold_F, { { TEXTURE_MARKER_SCENE, Ogre::TFO_NONE } });
+                auto outputThreshold = CreateRelativeOutputTexture(materialThreshold->getName(), 0.5f * scale, 0.5f * scale);
 
-                    auto unit0 = pass->createTextureUnitState(outputBlur);
-                    unit0->setTextureAddressingMode(Ogre::TextureUnitState::TAM_CLAMP);
-                    unit0->setTextureFiltering(Ogre::TFO_BILINEAR);
+                Ogre::MaterialPtr materialDownsample = CreateGodRaysMaterial("Material/Downsample/" + GetUniquePostfix(), Shader_GL_Copy_F, { { outputThreshold, Ogre::TFO_BILINEAR } });
+                auto outputDownsample = CreateRelativeOutputTexture(materialDownsample->getName(), 0.25f * scale, 0.25f * scale);
 
-                    pass->setFragmentProgram(fprogram->getName());
+                Ogre::MaterialPtr materialDownsample2 = CreateGodRaysMaterial("Material/Downsample2/" + GetUniquePostfix(), Shader_GL_Copy_F, { { outputDownsample, Ogre::TFO_BILINEAR } });
+                auto outputDownsample2 = CreateRelativeOutputTexture(materialDownsample2->getName(), 0.125f * scale, 0.125f * scale);
 
-                    auto fparams = pass->getFragmentProgramParameters();
-                    fparams->setNamedConstant("texture", 0);
-                    fparams->setNamedConstant("lightPosition", Ogre::Vector2(0.5f, 0.5f));
-                }
+                Ogre::MaterialPtr materialBlur = CreateGodRaysMaterial("Material/PostEffect/" + GetUniquePostfix() + "/Blur", Shader_GL_Blur_F, { { outputDownsample2, Ogre::TFO_BILINEAR } });
+                auto outputBlur = CreateRelativeOutputTexture(materialBlur->getName(), 0.125f * scale, 0.125f * scale);
+
+                Ogre::MaterialPtr materialBlur2 = CreateGodRaysMaterial("Material/PostEffect/" + GetUniquePostfix() + "/Blur2", Shader_GL_Blur_F, { { outputBlur, Ogre::TFO_BILINEAR } });
+                auto outputBlur2 = CreateRelativeOutputTexture(materialBlur2->getName(), 0.125f * scale, 0.125f * scale);
+
+                Ogre::MaterialPtr materialBlend = CreateGodRaysMaterial("Material/Blend/" + GetUniquePostfix(), Shader_GL_Blend_F,
+                    { { TEXTURE_MARKER_SCENE, Ogre::TFO_NONE }, { outputBlur2, Ogre::TFO_BILINEAR } });
+
+                materials = { materialThreshold.get(), materialDownsample.get(), materialDownsample2.get(), materialBlur.get(), materialBlur2.get(), materialBlend.get() };
+            }
+
+            for (size_t passId = GetBlurPass(); passId <= GetBlurPass() + 1; ++passId)
+            {
+                auto fparams = materials[passId]->getTechnique(0)->getPass(0)->getFragmentProgramParameters();
+                fparams->setNamedConstant("texture", 0);
+                fparams->setNamedConstant("lightPosition", Ogre::Vector2(0.5f, 0.5f));
+                fparams->setNamedConstant("intensity", 1.0f);
             }
-            auto outputBlur2 = CreateOutputTexture(materialBlur2->getName(), mRenderWindow->getWidth() / 8, mRenderWindow->getHeight() / 8);
-            //-------------------------------------------------------
-            Ogre::MaterialPtr materialBlend = Ogre::MaterialManager::getSingleton().create(
-                "Material/Blend/" + GetUniquePostfix(), Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
             {
-                Ogre::Technique* techniqueGL = materialBlend->getTechnique(0);
-                Ogre::Pass* pass = techniqueGL->getPass(0);
-                {
-                    auto vprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/V/Blend/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_VERTEX_PROGRAM);
-                    vprogram->setSource(Shader_GL_Common_V);
-                    pass->setVertexProgram(vprogram->getName());
-                }
-                {
-                    auto fprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/F/Blend/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_FRAGMENT_PROGRAM);
-                    fprogram->setSource(Shader_GL_Blend_F);
-
-                    auto unit0 = pass->createTextureUnitState(TEXTURE_MARKER_SCENE);
-                    unit0->setTextureAddressingMode(Ogre::TextureUnitState::TAM_CLAMP);
-                    unit0->setTextureFiltering(Ogre::TFO_NONE);
-
-                    auto unit1 = pass->createTextureUnitState(outputBlur2);
-                    unit1->setTextureAddressingMode(Ogre::TextureUnitState::TAM_CLAMP);
-                    unit1->setTextureFiltering(Ogre::TFO_BILINEAR);
-
-                    pass->setFragmentProgram(fprogram->getName());
-                    auto fparams = pass->getFragmentProgramParameters();
-                    fparams->setNamedConstant("texture", 0);
-                    fparams->setNamedConstant("texbloom", 1);
-                }
+                auto fparams = materials.back()->getTechnique(0)->getPass(0)->getFragmentProgramParameters();
+                fparams->setNamedConstant("texture", 0);
+                fparams->setNamedConstant("texbloom", 1);
             }
+            return materials;
+        }
 
-            //-------------------------------------------------------
-            return{ materialThreshold.get(), materialDownsample.get(), materialDownsample2.get(), materialBlur.get(), materialBlur2.get(), materialBlend.get() };
+        virtual void CreatePassGraph(PostEffectPassGraph & graph, const MaterialsVector & materials) override
+        {
+            if (false == IsScenePyramidUsed())
+            {
+                //the materials are chained through the texture markers
+                PostEffect::CreatePassGraph(graph, materials);
+                return;
+            }
+            //materials: threshold, blur, blur2, blending
+            const Ogre::Real factor = 0.125f * GetCurrentQualitySettings().resolutionScale;
+            graph.AddRelativeResource("Threshold", factor, factor);
+            graph.AddRelativeResource("Blur", factor, factor);
+            graph.AddRelativeResource("Blur2", factor, factor);
+            graph.AddPass(materials[0]->getName(), { PostEffectPassGraph::GetPyramidResource(PostEffectScenePyramid::LEVELS_NUMBER - 1) }, "Threshold");
+            graph.AddPass(materials[1]->getName(), { "Threshold" }, "Blur");
+            graph.AddPass(materials[2]->getName(), { "Blur" }, "Blur2");
+            graph.AddPass(materials[3]->getName(), { PostEffectPassGraph::RESOURCE_SCENE, "Blur2" }, PostEffectPassGraph::RESOURCE_OUTPUT);
         }
         //-------------------------------------------------------
-        void DoUpdate(Ogre::MaterialPtr & material, Ogre::Real time)
+        bool IsDynamicPass(size_t passId) const override
+        {
+            return (GetBlurPass() == passId) || (GetBlurPass() + 1 == passId);
+        }
+
+        void DoInit(size_t passId, Ogre::MaterialPtr & material) override
+        {
+            if (true == IsDynamicPass(passId))
+            {
+                auto fparams = material->getBestTechnique()->getPass(0)->getFragmentProgramParameters();
+                mLightPositionUniforms[passId - GetBlurPass()].Bind(fparams, "lightPosition");
+                if (GetBlurPass() == passId)
+                {
+                    mIntensityUniform.Bind(fparams, "intensity");
+                }
+            }
+        }
+
+        void DoUpdate(size_t passId, Ogre::MaterialPtr & material, Ogre::Real time) override
         {
-            //checking htis way because all materials are local copies of the created prototypes
-            if (Ogre::StringUtil::endsWith(material->getName(), blurName1) || Ogre::StringUtil::endsWith(material->getName(), blurName2))
+            (void)material;
+            (void)time;
+            const LightState & state = GetLightState();
+            mLightPositionUniforms[passId - GetBlurPass()].Set(state.position);
+            if (GetBlurPass() == passId)
             {
-                Ogre::Vector2 sunPosition = Ogre::Vector2(0.05f, 0.05f);
-                sunPosition[0] += std::sin(time / 2.0f) * 0.05f;
-                auto pass = material->getBestTechnique()->getPass(0);
-                auto fparams = pass->getFragmentProgramParameters();
-                fparams->setNamedConstant("lightPosition", sunPosition);
+                mIntensityUniform.Set(state.intensity);
             }
         }
     };
 
     IMPLEMENT_REGISTRATION_FUNCTION(EffectGodRays)
     {
-        Ogre::SharedPtr<PostEffectFactory> factory(new DefaultPostEffectFactory<PostEffectGodRays>(PostEffectManager::PE_GODRAYS));
+        Ogre::SharedPtr<PostEffectFactory> factory(new DefaultPostEffectFactory<PostEffectGodRays>(PostEffectManager::PE_GODRAYS, 2));
         manager->RegisterPostEffectFactory(factory);
     }
 
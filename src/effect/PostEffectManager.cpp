@@ -9,13 +9,24 @@
 */
 
 #include <assert.h>
+#include <algorithm>
 
 #include <OgreCompositorChain.h>
 #include <OgreCompositorManager.h>
+#include <OgreLogManager.h>
+#include <OgreRenderWindow.h>
+#include <OgreRoot.h>
+#include <OgreViewport.h>
 
 #include "PostEffect.h"
 #include "PostEffectManager.h"
 #include "PostEffectFactory.h"
+#include "PostEffectTexturePool.h"
+#include "PostEffectScenePyramid.h"
+#include "PostEffectFusion.h"
+#include "PostEffectProgramCache.h"
+#include "PostEffectAnimator.h"
+#include "PostEffectPrototypeRegistry.h"
 
 namespace OgreEffect
 {
@@ -68,8 +79,15 @@ namespace OgreEffect
         return sPostEffectsManager::Instance();
     }
     //-------------------------------------------------------
-    PostEffectManager::PostEffectManager()
+    PostEffectManager::PostEffectManager():
+        mProgramCache(new PostEffectProgramCache("Shader/Cache")), mAnimator(new PostEffectAnimator())
     {
+        Ogre::StringVector markers;
+        markers.push_back(PostEffect::TEXTURE_MARKER_SCENE);
+        markers.push_back(PostEffect::TEXTURE_MARKER_PREVIOUS);
+        mPrototypeRegistry.bind(new PostEffectPrototypeRegistry(mProgramCache.get(), markers));
+        mScenePyramid.bind(new PostEffectScenePyramid(mProgramCache.get()));
+
         if (true == mFactories.empty())
         {
             RegisterDefaultFactories();
@@ -79,6 +97,12 @@ namespace OgreEffect
     PostEffectManager::~PostEffectManager()
     {
         Shutdown();
+        Ogre::Root* root = Ogre::Root::getSingletonPtr();
+        if ((true == mWorkQueueRegistered) && (nullptr != root))
+        {
+            root->getWorkQueue()->removeRequestHandler(mWorkQueueChannel, this);
+            root->getWorkQueue()->removeResponseHandler(mWorkQueueChannel, this);
+        }
     }
     //-------------------------------------------------------
     void PostEffectManager::Shutdown()
@@ -88,6 +112,36 @@ namespace OgreEffect
             RemoveImpl(effect);
         }
         mEffects.clear();
+        for (auto & chainEntry : mChains)
+        {
+            for (auto & fusionEntry : chainEntry.second.fusions)
+            {
+                DestroyFusion(fusionEntry.second);
+            }
+            DetachScenePyramid(chainEntry.second);
+        }
+        mChains.clear();
+        mPendingChains.clear();
+        mScenePyramid->Release();
+        //pooled instances hold compositors and materials, so they are freed with the render system alive
+        for (auto & factoryEntry : mFactories)
+        {
+            factoryEntry.second->ReleasePool();
+        }
+
+        for (auto taskIt = mAsyncTasks.begin(); taskIt != mAsyncTasks.end(); )
+        {
+            if (AS_PENDING == taskIt->second.state)
+            {
+                //the effect can be used by a worker thread; It will be destroyed when the response is received
+                taskIt->second.cancelled = true;
+                ++taskIt;
+            }
+            else
+            {
+                taskIt = mAsyncTasks.erase(taskIt);
+            }
+        }
     }
     //-------------------------------------------------------
     void PostEffectManager::RegisterPostEffectFactory(Ogre::SharedPtr<PostEffectFactory> factory)
@@ -112,17 +166,47 @@ namespace OgreEffect
         }
     }
     //-------------------------------------------------------
-    PostEffect* PostEffectManager::CreatePostEffectImpl(const Ogre::String & effectType, Ogre::RenderWindow* window, Ogre::CompositorChain* chain)
+    PostEffect* PostEffectManager::CreateInstance(const PostEffectFactory & factory, const Ogre::RenderWindow* window)
+    {
+        PostEffect* effect = factory.Create();
+        effect->mManager = this;
+        //parameters are available before the effect is built
+        effect->CreateParametersDictionary();
+        effect->ResetInstance();
+        effect->mQualityTier = mQualityTier;
+        effect->mScenePyramidUsed = mScenePyramidEnabled;
+        effect->mDisabledTime = Ogre::Root::getSingleton().getTimer()->getMilliseconds();
+        if ((true == effect->IsBuilt()) && ((effect->mRenderWindow != window) || (effect->GetPrototypesKey() != effect->mPrototypesKey)))
+        {
+            //the pooled compositor doesn't match; The instance is built again
+            effect->DestroyCompositor();
+        }
+        return effect;
+    }
+    //-------------------------------------------------------
+    PostEffect* PostEffectManager::CreatePostEffectImpl(const Ogre::String & effectType, Ogre::RenderWindow* window)
     {
         PostEffect* effect = nullptr;
         auto factIt = mFactories.find(effectType);
         if (factIt != mFactories.cend())
         {
             assert(nullptr != factIt->second.get());
-            //Create effect instance
-            effect = factIt->second->Create();
-            //Prepare materials and compositor
-            effect->Prepare(window, chain);
+            //Create effect instance or take a pooled one
+            effect = CreateInstance(*factIt->second, window);
+            //Reused instance can keep the compositor and the materials
+            if (false == effect->IsBuilt())
+            {
+                if (true == mLazyBuild)
+                {
+                    //The compositor will be built on the first enabling
+                    effect->mRenderWindow = window;
+                }
+                else
+                {
+                    //Prepare materials and compositor
+                    effect->BuildCompositor(window);
+                }
+            }
 
             //save the effect instance
             mEffects.push_back(effect);
@@ -130,11 +214,698 @@ namespace OgreEffect
         return effect;
     }
     //-------------------------------------------------------
+    void PostEffectManager::AttachEffects(const EffectsVector & effects, Ogre::RenderWindow* window, Ogre::Viewport* viewport, Ogre::CompositorChain* chain)
+    {
+        Ogre::SharedPtr<PostEffectTexturePool> pool;
+        const bool anyBuilt = std::any_of(effects.cbegin(), effects.cend(), [](const PostEffect* effect) { return effect->IsBuilt(); });
+        if ((true == mTextureAliasing) && (true == anyBuilt))
+        {
+            pool.bind(new PostEffectTexturePool("PostEffect/Pool/" + Ogre::StringConverter::toString(mPoolsCounter++), mZeroCopyInput));
+            for (PostEffect* effect : effects)
+            {
+                if (true == effect->IsBuilt())
+                {
+                    pool->AddEffect(effect);
+                }
+            }
+            //All definitions should be redirected before the compositors are loaded by the chain
+            pool->Allocate(window->getWidth(), window->getHeight());
+        }
+        ChainInfo & info = mChains[viewport];
+        if (true == info.frameParameters.isNull())
+        {
+            info.frameParameters.bind(OGRE_NEW Ogre::GpuSharedParameters("PostEffect/Frame/" + Ogre::StringConverter::toString(mChainsCounter++)));
+            info.frameParameters->addConstantDefinition(PostEffect::FRAME_TIME_UNIFORM, Ogre::GCT_FLOAT4);
+            info.frameParameters->addConstantDefinition(PostEffect::RESOLUTION_UNIFORM, Ogre::GCT_FLOAT4);
+            UpdateFrameParameters(viewport, info, static_cast<Ogre::Real>(Ogre::Root::getSingleton().getTimer()->getMilliseconds() / 1000.0), 0.0f);
+        }
+        //Materials are copied when the chain is compiled, so the uniforms are linked later
+        for (PostEffect* effect : effects)
+        {
+            effect->mFrameParameters = info.frameParameters;
+            if (true == effect->IsBuilt())
+            {
+                effect->AttachCompositor(chain);
+            }
+        }
+
+        info.window = window;
+        info.chain = chain;
+        info.effects = effects;
+        info.pool = pool;
+
+        //The pyramid is computed once in front of the first effect reading it
+        auto readerIt = std::find_if(effects.cbegin(), effects.cend(), [](const PostEffect* effect) { return effect->GetPyramidLevelsNumber() > 0; });
+        if (readerIt != effects.cend())
+        {
+            size_t position = 0;
+            while (chain->getCompositor(position) != (*readerIt)->mCompositorInstance)
+            {
+                ++position;
+            }
+            info.pyramid = mScenePyramid->Attach(chain, position);
+        }
+
+        if (false == pool.isNull())
+        {
+            pool->Attach(chain);
+
+            const PostEffectTexturePool::MemoryReport & report = pool->GetMemoryReport();
+            Ogre::LogManager::getSingleton().logMessage("PostEffectManager: " + pool->GetName() + " aliased " +
+                Ogre::StringConverter::toString(report.texturesNumber) + " textures to " + Ogre::StringConverter::toString(report.slotsNumber) + 
+                "; naive " + Ogre::StringConverter::toString(report.naiveBytes / 1024) + " KB, pooled " + Ogre::StringConverter::toString(report.pooledBytes / 1024) +
+                " KB, peak " + Ogre::StringConverter::toString(report.peakBytes / 1024) + " KB; scene copies " + Ogre::StringConverter::toString(report.sceneCopiesNumber));
+        }
+
+        const PostEffectProgramCache::Statistics & statistics = mProgramCache->GetStatistics();
+        Ogre::LogManager::getSingleton().logMessage("PostEffectManager: " + Ogre::StringConverter::toString(mProgramCache->GetProgramsNumber()) + " shared programs; cache hits " +
+            Ogre::StringConverter::toString(statistics.hits) + ", misses " + Ogre::StringConverter::toString(statistics.misses));
+    }
+    //-------------------------------------------------------
+    const PostEffectTexturePool* PostEffectManager::GetTexturePool(Ogre::Viewport* viewport) const
+    {
+        auto chainIt = mChains.find(viewport);
+        if (chainIt != mChains.cend())
+        {
+            return chainIt->second.pool.get();
+        }
+        return nullptr;
+    }
+    //-------------------------------------------------------
+    size_t PostEffectManager::GetSceneCopiesNumber(Ogre::Viewport* viewport) const
+    {
+        size_t copiesNumber = 0;
+        auto chainIt = mChains.find(viewport);
+        if (chainIt != mChains.cend())
+        {
+            for (const PostEffect* effect : chainIt->second.effects)
+            {
+                if (true == effect->IsSceneCopyRequired())
+                {
+                    ++copiesNumber;
+                }
+            }
+        }
+        return copiesNumber;
+    }
+    //-------------------------------------------------------
+    PostEffectManager::ChainInfo* PostEffectManager::FindChain(const PostEffect* effect)
+    {
+        for (auto & chainEntry : mChains)
+        {
+            const EffectsVector & effects = chainEntry.second.effects;
+            if (std::find(effects.cbegin(), effects.cend(), effect) != effects.cend())
+            {
+                return &chainEntry.second;
+            }
+        }
+        return nullptr;
+    }
+    //-------------------------------------------------------
+    void PostEffectManager::DestroyFusion(PostEffectFusion* fusion)
+    {
+        fusion->DestroyCompositor();
+        delete fusion;
+    }
+    //-------------------------------------------------------
+    void PostEffectManager::RebuildChain(Ogre::Viewport* viewport, ChainInfo & info, const EffectsVector & rebuiltEffects, const EffectsVector & releasedEffects)
+    {
+        //Fusions refer to the chain positions of the effects; they will be created again
+        for (auto & fusionEntry : info.fusions)
+        {
+            DestroyFusion(fusionEntry.second);
+        }
+        info.fusions.clear();
+
+        for (PostEffect* effect : info.effects)
+        {
+            effect->DetachCompositor();
+        }
+        //The pyramid is placed before the first reader, which can change
+        DetachScenePyramid(info);
+        //Aliasing depends on all effects of the chain, so the pool is allocated again
+        if (false == info.pool.isNull())
+        {
+            info.pool->Release();
+            info.pool.setNull();
+        }
+
+        for (PostEffect* effect : releasedEffects)
+        {
+            effect->DestroyCompositor();
+        }
+        for (PostEffect* effect : rebuiltEffects)
+        {
+            effect->DestroyCompositor();
+            effect->BuildCompositor(info.window);
+        }
+
+        const EffectsVector effects = info.effects;
+        AttachEffects(effects, info.window, viewport, info.chain);
+        UpdateChainState(mChains[viewport]);
+    }
+    //-------------------------------------------------------
+    void PostEffectManager::SetQualityTier(PostEffect::QualityTier tier)
+    {
+        if (mQualityTier == tier)
+        {
+            return;
+        }
+        mQualityTier = tier;
+        for (auto & chainEntry : mChains)
+        {
+            ChainInfo & info = chainEntry.second;
+            EffectsVector rebuiltEffects;
+            for (PostEffect* effect : info.effects)
+            {
+                //effects which are not built yet will use the new tier on building
+                if ((true == effect->IsBuilt()) && (effect->GetQualitySettings(effect->GetQualityTier()) != effect->GetQualitySettings(tier)))
+                {
+                    rebuiltEffects.push_back(effect);
+                }
+                effect->mQualityTier = tier;
+            }
+            if (false == rebuiltEffects.empty())
+            {
+                RebuildChain(chainEntry.first, info, rebuiltEffects);
+            }
+        }
+        Ogre::LogManager::getSingleton().logMessage("PostEffectManager: quality tier is set to " + Ogre::StringConverter::toString(static_cast<int>(tier)));
+    }
+    //-------------------------------------------------------
+    void PostEffectManager::SetEffectQualityTier(PostEffect* effect, PostEffect::QualityTier tier)
+    {
+        if (nullptr == effect)
+        {
+            OGRE_EXCEPT(Ogre::Exception::ERR_INVALIDPARAMS, "Effect is null", "PostEffectManager[SetEffectQualityTier]");
+        }
+        if (effect->GetQualityTier() == tier)
+        {
+            return;
+        }
+        const bool rebuild = (true == effect->IsBuilt()) && (effect->GetQualitySettings(effect->GetQualityTier()) != effect->GetQualitySettings(tier));
+        effect->mQualityTier = tier;
+        if (true == rebuild)
+        {
+            for (auto & chainEntry : mChains)
+            {
+                ChainInfo & info = chainEntry.second;
+                if (info.effects.end() != std::find(info.effects.begin(), info.effects.end(), effect))
+                {
+                    RebuildChain(chainEntry.first, info, EffectsVector(1, effect));
+                    break;
+                }
+            }
+        }
+        Ogre::LogManager::getSingleton().logMessage("PostEffectManager: quality tier of " + effect->GetName() + " is set to " + Ogre::StringConverter::toString(static_cast<int>(tier)));
+    }
+    //-------------------------------------------------------
+    bool PostEffectManager::IsRendered(const PostEffect* effect)
+    {
+        return (true == effect->IsEnabled()) && (false == effect->IsCulled());
+    }
+    //-------------------------------------------------------
+    void PostEffectManager::UpdateChainState(ChainInfo & info)
+    {
+        //Split enabled effects into groups of consecutive per-pixel ones
+        Ogre::vector<EffectsVector>::type groups;
+        if (true == mFusion)
+        {
+            EffectsVector group;
+            for (PostEffect* effect : info.effects)
+            {
+                if (false == IsRendered(effect))
+                {
+                    //disabled effects are not rendered, so their neighbours are consecutive
+                    continue;
+                }
+                PostEffect::PixelFunction function;
+                if (true == effect->GetPixelFunction(function))
+                {
+                    group.push_back(effect);
+                    continue;
+                }
+                if (group.size() > 1)
+                {
+                    groups.push_back(group);
+                }
+                group.clear();
+            }
+            if (group.size() > 1)
+            {
+                groups.push_back(group);
+            }
+        }
+
+        //Enable fusions of the found groups; Create missing ones in front of the first group member
+        Ogre::set<PostEffect*>::type fusedEffects;
+        Ogre::set<PostEffectFusion*>::type activeFusions;
+        for (const EffectsVector & group : groups)
+        {
+            Ogre::String key;
+            for (const PostEffect* effect : group)
+            {
+                key += effect->GetName() + ";";
+            }
+            PostEffectFusion* & fusion = info.fusions[key];
+            if (nullptr == fusion)
+            {
+                size_t position = 0;
+                while (info.chain->getCompositor(position) != group.front()->mCompositorInstance)
+                {
+                    ++position;
+                }
+                fusion = new PostEffectFusion(group, mFusionsCounter++);
+                //the fusion is updated in the manager's frame phase only, like the other effects
+                fusion->mManager = this;
+                fusion->mFrameParameters = info.frameParameters;
+                fusion->BuildCompositor(info.window);
+                fusion->AttachCompositor(info.chain, position);
+            }
+            activeFusions.insert(fusion);
+            fusedEffects.insert(group.cbegin(), group.cend());
+        }
+
+        for (auto & fusionEntry : info.fusions)
+        {
+            PostEffectFusion* fusion = fusionEntry.second;
+            fusion->SetInstanceEnabled(activeFusions.end() != activeFusions.find(fusion));
+        }
+        bool pyramidRead = false;
+        for (PostEffect* effect : info.effects)
+        {
+            if (true == effect->IsBuilt())
+            {
+                effect->SetInstanceEnabled(IsRendered(effect) && (fusedEffects.end() == fusedEffects.find(effect)));
+                pyramidRead = pyramidRead || (IsRendered(effect) && (effect->GetPyramidLevelsNumber() > 0));
+            }
+        }
+        //The referenced textures are available only while the pyramid instance is enabled; Idle pyramid costs nothing
+        if ((nullptr != info.pyramid) && (info.pyramid->getEnabled() != pyramidRead))
+        {
+            info.pyramid->setEnabled(pyramidRead);
+        }
+    }
+    //-------------------------------------------------------
+    void PostEffectManager::SetFusionEnabled(bool enabled)
+    {
+        if (mFusion != enabled)
+        {
+            mFusion = enabled;
+            for (auto & chainEntry : mChains)
+            {
+                UpdateChainState(chainEntry.second);
+            }
+        }
+    }
+    //-------------------------------------------------------
+    void PostEffectManager::NotifyEnabledChanged(PostEffect* effect)
+    {
+        if (false == effect->IsEnabled())
+        {
+            effect->mDisabledTime = Ogre::Root::getSingleton().getTimer()->getMilliseconds();
+        }
+        if (mChainUpdateDepth > 0)
+        {
+            for (auto & chainEntry : mChains)
+            {
+                const EffectsVector & effects = chainEntry.second.effects;
+                if (effects.end() != std::find(effects.begin(), effects.end(), effect))
+                {
+                    //will be applied by CommitChainUpdate(); The order flag is kept
+                    mPendingChains.insert(std::make_pair(chainEntry.first, false));
+                    return;
+                }
+            }
+        }
+        ChainInfo* info = FindChain(effect);
+        if ((nullptr != info) && (true == effect->IsEnabled()) && (false == effect->IsBuilt()))
+        {
+            //Lazy building; The chain is reattached in order to alias the new textures
+            for (auto & chainEntry : mChains)
+            {
+                if (&chainEntry.second == info)
+                {
+                    RebuildChain(chainEntry.first, *info, EffectsVector(1, effect));
+                    break;
+                }
+            }
+        }
+        else if (nullptr != info)
+        {
+            UpdateChainState(*info);
+        }
+        else if (true == effect->IsBuilt())
+        {
+            effect->SetInstanceEnabled(effect->IsEnabled());
+        }
+    }
+    //-------------------------------------------------------
+    void PostEffectManager::BeginChainUpdate()
+    {
+        ++mChainUpdateDepth;
+    }
+    //-------------------------------------------------------
+    void PostEffectManager::CommitChainUpdate()
+    {
+        if (0 == mChainUpdateDepth)
+        {
+            OGRE_EXCEPT(Ogre::Exception::ERR_INVALID_STATE, "Chain update was not started", "PostEffectManager[CommitChainUpdate]");
+        }
+        if (--mChainUpdateDepth > 0)
+        {
+            return;
+        }
+        Ogre::map<Ogre::Viewport*, bool>::type pendingChains;
+        pendingChains.swap(mPendingChains);
+        for (const auto & pendingEntry : pendingChains)
+        {
+            auto chainIt = mChains.find(pendingEntry.first);
+            if (chainIt != mChains.end())
+            {
+                ApplyChainChanges(chainIt->first, chainIt->second, pendingEntry.second);
+            }
+        }
+    }
+    //-------------------------------------------------------
+    void PostEffectManager::ApplyChainChanges(Ogre::Viewport* viewport, ChainInfo & info, bool reordered)
+    {
+        //Lazily built effects enabled inside the update are built together
+        EffectsVector builtEffects;
+        for (PostEffect* effect : info.effects)
+        {
+            if ((true == effect->IsEnabled()) && (false == effect->IsBuilt()))
+            {
+                builtEffects.push_back(effect);
+            }
+        }
+        if ((true == reordered) && (true == builtEffects.empty()) && (true == info.pool.isNull()) && (nullptr == info.pyramid))
+        {
+            //Nothing is aliased, so the instances are only moved
+            for (auto & fusionEntry : info.fusions)
+            {
+                DestroyFusion(fusionEntry.second);
+            }
+            info.fusions.clear();
+            RepositionInstances(info);
+            UpdateChainState(info);
+        }
+        else if ((true == reordered) || (false == builtEffects.empty()))
+        {
+            RebuildChain(viewport, info, builtEffects);
+        }
+        else
+        {
+            UpdateChainState(info);
+        }
+    }
+    //-------------------------------------------------------
+    void PostEffectManager::RepositionInstances(ChainInfo & info)
+    {
+        size_t position = 0;
+        for (PostEffect* effect : info.effects)
+        {
+            if (nullptr == effect->mCompositorInstance)
+            {
+                continue;
+            }
+            //The previous instances are in place, so the effect is either here or after the position
+            if (info.chain->getCompositor(position) != effect->mCompositorInstance)
+            {
+                effect->DetachCompositor();
+                effect->AttachCompositor(info.chain, position);
+            }
+            ++position;
+        }
+    }
+    //-------------------------------------------------------
+    void PostEffectManager::CheckChainOrder(const ChainInfo & info, const EffectsVector & effects, const Ogre::String & source)
+    {
+        bool valid = (effects.size() == info.effects.size());
+        for (auto effectIt = effects.cbegin(); (true == valid) && (effectIt != effects.cend()); ++effectIt)
+        {
+            valid = (info.effects.cend() != std::find(info.effects.cbegin(), info.effects.cend(), *effectIt)) &&
+                (effectIt == std::find(effects.cbegin(), effectIt, *effectIt));
+        }
+        if (false == valid)
+        {
+            OGRE_EXCEPT(Ogre::Exception::ERR_INVALIDPARAMS, "Every effect of the chain should be passed exactly once", source);
+        }
+    }
+    //-------------------------------------------------------
+    void PostEffectManager::ReorderChain(Ogre::Viewport* viewport, const EffectsVector & effects)
+    {
+        auto chainIt = mChains.find(viewport);
+        if (chainIt == mChains.end())
+        {
+            OGRE_EXCEPT(Ogre::Exception::ERR_ITEM_NOT_FOUND, "The viewport has no effects chain", "PostEffectManager[ReorderChain]");
+        }
+        ChainInfo & info = chainIt->second;
+        CheckChainOrder(info, effects, "PostEffectManager[ReorderChain]");
+        if (effects != info.effects)
+        {
+            BeginChainUpdate();
+            info.effects = effects;
+            mPendingChains[viewport] = true;
+            CommitChainUpdate();
+        }
+    }
+    //-------------------------------------------------------
+    void PostEffectManager::MoveEffect(PostEffect* effect, size_t position)
+    {
+        for (auto & chainEntry : mChains)
+        {
+            EffectsVector effects = chainEntry.second.effects;
+            auto effectIt = std::find(effects.begin(), effects.end(), effect);
+            if (effectIt != effects.end())
+            {
+                if (position >= effects.size())
+                {
+                    OGRE_EXCEPT(Ogre::Exception::ERR_INVALIDPARAMS, "Position is out of the chain", "PostEffectManager[MoveEffect]");
+                }
+                effects.erase(effectIt);
+                effects.insert(effects.begin() + position, effect);
+                ReorderChain(chainEntry.first, effects);
+                return;
+            }
+        }
+        OGRE_EXCEPT(Ogre::Exception::ERR_ITEM_NOT_FOUND, "The effect is not attached to a chain", "PostEffectManager[MoveEffect]");
+    }
+    //-------------------------------------------------------
+    void PostEffectManager::SetChainState(Ogre::Viewport* viewport, const ChainState & state)
+    {
+        auto chainIt = mChains.find(viewport);
+        if (chainIt == mChains.end())
+        {
+            OGRE_EXCEPT(Ogre::Exception::ERR_ITEM_NOT_FOUND, "The viewport has no effects chain", "PostEffectManager[SetChainState]");
+        }
+        ChainInfo & info = chainIt->second;
+        EffectsVector effects;
+        effects.reserve(state.size());
+        for (const ChainEntry & entry : state)
+        {
+            effects.push_back(entry.effect);
+        }
+        CheckChainOrder(info, effects, "PostEffectManager[SetChainState]");
+
+        BeginChainUpdate();
+        if (effects != info.effects)
+        {
+            info.effects = effects;
+            mPendingChains[viewport] = true;
+        }
+        for (const ChainEntry & entry : state)
+        {
+            if (entry.effect->IsEnabled() != entry.enabled)
+            {
+                entry.effect->SetEnabled(entry.enabled);
+            }
+        }
+        CommitChainUpdate();
+    }
+    //-------------------------------------------------------
+    PostEffectManager::ChainState PostEffectManager::GetChainState(Ogre::Viewport* viewport) const
+    {
+        ChainState state;
+        auto chainIt = mChains.find(viewport);
+        if (chainIt != mChains.cend())
+        {
+            for (PostEffect* effect : chainIt->second.effects)
+            {
+                state.push_back({ effect, effect->IsEnabled() });
+            }
+        }
+        return state;
+    }
+    //-------------------------------------------------------
+    void PostEffectManager::Update()
+    {
+        const unsigned long now = Ogre::Root::getSingleton().getTimer()->getMilliseconds();
+        if (mReleaseTimeout > 0.0f)
+        {
+            ReleaseIdleEffects(now);
+        }
+
+        //The time is taken once for all effects of the frame
+        const Ogre::Real time = static_cast<Ogre::Real>(now / 1000.0);
+        const Ogre::Real delta = (mLastUpdateTime < 0.0f) ? 0.0f : time - mLastUpdateTime;
+        mLastUpdateTime = time;
+        const PostEffectUniform::Statistics uniformStatistics = PostEffectUniform::GetStatistics();
+        //parameters are animated before the effects read them
+        mAnimator->Evaluate(time);
+        for (auto & chainEntry : mChains)
+        {
+            //Effects with changed rebuild parameters are rebuilt together
+            EffectsVector rebuiltEffects;
+            for (PostEffect* effect : chainEntry.second.effects)
+            {
+                if (true == effect->IsRebuildRequired())
+                {
+                    rebuiltEffects.push_back(effect);
+                }
+            }
+            if (false == rebuiltEffects.empty())
+            {
+                RebuildChain(chainEntry.first, chainEntry.second, rebuiltEffects);
+            }
+        }
+        for (auto & chainEntry : mChains)
+        {
+            //Culled effects are skipped like disabled ones; The chain is updated only when the culling changes
+            //Updating the chain recompiles it, so an effect is culled after a delay and is unculled at once
+            bool cullingChanged = false;
+            for (PostEffect* effect : chainEntry.second.effects)
+            {
+                bool culled = false;
+                if ((true == effect->IsEnabled()) && (true == effect->IsBuilt()) && (true == effect->DoCull()))
+                {
+                    ++effect->mCullRequests;
+                    culled = (true == effect->mCulled) || (effect->mCullRequests >= CULL_DELAY_FRAMES);
+                }
+                else
+                {
+                    effect->mCullRequests = 0;
+                }
+                if (effect->mCulled != culled)
+                {
+                    effect->mCulled = culled;
+                    cullingChanged = true;
+                }
+            }
+            if (true == cullingChanged)
+            {
+                UpdateChainState(chainEntry.second);
+            }
+        }
+        for (auto & chainEntry : mChains)
+        {
+            ChainInfo & info = chainEntry.second;
+            UpdateFrameParameters(chainEntry.first, info, time, delta);
+            for (PostEffect* effect : info.effects)
+            {
+                //disabled and fused effects are not rendered
+                if ((nullptr != effect->mCompositorInstance) && (true == effect->mCompositorInstance->getEnabled()))
+                {
+                    const size_t callbacksNumber = effect->GetUpdateCallbacksNumber();
+                    effect->UpdateFrame(time);
+                    mUpdateCallbacksCounter += effect->GetUpdateCallbacksNumber() - callbacksNumber;
+                }
+            }
+            for (auto & fusionEntry : info.fusions)
+            {
+                PostEffectFusion* fusion = fusionEntry.second;
+                if ((nullptr != fusion->mCompositorInstance) && (true == fusion->mCompositorInstance->getEnabled()))
+                {
+                    const size_t callbacksNumber = fusion->GetUpdateCallbacksNumber();
+                    fusion->UpdateFrame(time);
+                    mUpdateCallbacksCounter += fusion->GetUpdateCallbacksNumber() - callbacksNumber;
+                }
+            }
+        }
+        mFrameUniformStatistics.uploads = PostEffectUniform::GetStatistics().uploads - uniformStatistics.uploads;
+        mFrameUniformStatistics.skips = PostEffectUniform::GetStatistics().skips - uniformStatistics.skips;
+    }
+    //-------------------------------------------------------
+    void PostEffectManager::UpdateFrameParameters(const Ogre::Viewport* viewport, ChainInfo & info, Ogre::Real time, Ogre::Real delta)
+    {
+        if (true == info.frameParameters.isNull())
+        {
+            return;
+        }
+        const Ogre::Real width = static_cast<Ogre::Real>(std::max(viewport->getActualWidth(), 1));
+        const Ogre::Real height = static_cast<Ogre::Real>(std::max(viewport->getActualHeight(), 1));
+        const Ogre::Real frame = static_cast<Ogre::Real>(Ogre::Root::getSingleton().getNextFrameNumber());
+        info.frameParameters->setNamedConstant(PostEffect::FRAME_TIME_UNIFORM, Ogre::Vector4(time, delta, frame, 0.0f));
+        info.frameParameters->setNamedConstant(PostEffect::RESOLUTION_UNIFORM, Ogre::Vector4(width, height, 1.0f / width, 1.0f / height));
+    }
+    //-------------------------------------------------------
+    void PostEffectManager::ReleaseIdleEffects(unsigned long now)
+    {
+        const unsigned long timeout = static_cast<unsigned long>(mReleaseTimeout * 1000.0f);
+        for (auto & chainEntry : mChains)
+        {
+            ChainInfo & info = chainEntry.second;
+            EffectsVector releasedEffects;
+            for (PostEffect* effect : info.effects)
+            {
+                if ((true == effect->IsBuilt()) && (false == effect->IsEnabled()) && (now - effect->mDisabledTime >= timeout))
+                {
+                    releasedEffects.push_back(effect);
+                }
+            }
+            if (false == releasedEffects.empty())
+            {
+                RebuildChain(chainEntry.first, info, EffectsVector(), releasedEffects);
+                Ogre::LogManager::getSingleton().logMessage("PostEffectManager: released " + Ogre::StringConverter::toString(releasedEffects.size()) + " idle effects");
+            }
+        }
+    }
+    //-------------------------------------------------------
+    void PostEffectManager::NotifyWindowResized(Ogre::RenderWindow* window)
+    {
+        assert(nullptr != window);
+        for (auto & chainEntry : mChains)
+        {
+            ChainInfo & info = chainEntry.second;
+            if (info.window != window)
+            {
+                continue;
+            }
+            for (PostEffect* effect : info.effects)
+            {
+                if (true == effect->IsBuilt())
+                {
+                    effect->NotifyResized();
+                }
+            }
+            for (auto & fusionEntry : info.fusions)
+            {
+                fusionEntry.second->NotifyResized();
+            }
+            if (false == info.pool.isNull())
+            {
+                info.pool->NotifyResized(window->getWidth(), window->getHeight());
+            }
+        }
+    }
+    //-------------------------------------------------------
     void PostEffectManager::RemoveImpl(PostEffect* effect)
     {
+        mAnimator->DestroyTracks(effect);
         auto factIt = mFactories.find(effect->GetTypeName());
         if (factIt != mFactories.cend())
         {
+            if (true == factIt->second->IsPooling())
+            {
+                //the pooled instance keeps its compositor and the reference to the material prototypes
+                effect->DetachCompositor();
+                effect->mEnabled = false;
+            }
+            else
+            {
+                //releases the effect's reference to the material prototypes
+                effect->DestroyCompositor();
+            }
             factIt->second->Destroy(effect);
         }
         else
@@ -143,6 +914,15 @@ namespace OgreEffect
         }
     }
     //-------------------------------------------------------
+    void PostEffectManager::DetachScenePyramid(ChainInfo & info)
+    {
+        if (nullptr != info.pyramid)
+        {
+            mScenePyramid->Detach(info.pyramid);
+            info.pyramid = nullptr;
+        }
+    }
+    //-------------------------------------------------------
     void PostEffectManager::Remove(PostEffect* effect)
     {
         auto effectIt = std::find(mEffects.begin(), mEffects.end(), effect);
@@ -150,8 +930,35 @@ namespace OgreEffect
         {
             OGRE_EXCEPT(Ogre::Exception::ERR_INTERNAL_ERROR, "Failed to find effect instance", "PostEffectManager[Remove]");
         }
+        ChainInfo* info = FindChain(effect);
+        if (nullptr != info)
+        {
+            info->effects.erase(std::find(info->effects.begin(), info->effects.end(), effect));
+            //fusions containing the effect are not valid anymore
+            for (auto fusionIt = info->fusions.begin(); fusionIt != info->fusions.end(); )
+            {
+                const EffectsVector & members = fusionIt->second->GetMembers();
+                if (std::find(members.cbegin(), members.cend(), effect) != members.cend())
+                {
+                    DestroyFusion(fusionIt->second);
+                    fusionIt = info->fusions.erase(fusionIt);
+                }
+                else
+                {
+                    ++fusionIt;
+                }
+            }
+        }
         RemoveImpl(effect);
         mEffects.erase(effectIt);
+        for (auto taskIt = mAsyncTasks.begin(); taskIt != mAsyncTasks.end(); )
+        {
+            taskIt = (taskIt->second.effect == effect) ? mAsyncTasks.erase(taskIt) : std::next(taskIt);
+        }
+        if (nullptr != info)
+        {
+            UpdateChainState(*info);
+        }
     }
     //-------------------------------------------------------
     PostEffect* PostEffectManager::CreatePostEffect(const Ogre::String & effectType, Ogre::RenderWindow* window, Ogre::Viewport* viewport)
@@ -162,7 +969,168 @@ namespace OgreEffect
             //throw std::logic_error("PostEffectManager[CreatePostEffect]: The viewport has already compositors");
             OGRE_EXCEPT(Ogre::Exception::ERR_INVALIDPARAMS, "The viewport has already compositors", "PostEffectManager[CreatePostEffect]");
         }
-        return CreatePostEffectImpl(effectType, window, chain);
+        PostEffect* effect = CreatePostEffectImpl(effectType, window);
+        if (nullptr != effect)
+        {
+            AttachEffects({ effect }, window, viewport, chain);
+        }
+        return effect;
+    }
+    //-------------------------------------------------------
+    void PostEffectManager::AppendEffect(PostEffect* effect, Ogre::RenderWindow* window, Ogre::Viewport* viewport)
+    {
+        auto chainIt = mChains.find(viewport);
+        if (chainIt == mChains.end())
+        {
+            Ogre::CompositorChain* chain = Ogre::CompositorManager::getSingleton().getCompositorChain(viewport); //returns not null
+            if (chain->getNumCompositors() > 0)
+            {
+                OGRE_EXCEPT(Ogre::Exception::ERR_INVALIDPARAMS, "The viewport has already compositors", "PostEffectManager[AppendEffect]");
+            }
+            AttachEffects({ effect }, window, viewport, chain);
+        }
+        else
+        {
+            ChainInfo & info = chainIt->second;
+            info.effects.push_back(effect);
+            //Nothing is rebuilt, the chain is only reattached with the new effect
+            RebuildChain(viewport, info, EffectsVector());
+        }
+    }
+    //-------------------------------------------------------
+    PostEffectManager::AsyncHandle PostEffectManager::CreatePostEffectAsync(const Ogre::String & effectType, Ogre::RenderWindow* window, Ogre::Viewport* viewport, bool enableWhenReady /* = true */)
+    {
+        auto factIt = mFactories.find(effectType);
+        if (factIt == mFactories.cend())
+        {
+            OGRE_EXCEPT(Ogre::Exception::ERR_ITEM_NOT_FOUND, "Effect type " + effectType + " is not registered", "PostEffectManager[CreatePostEffectAsync]");
+        }
+
+        Ogre::WorkQueue* workQueue = Ogre::Root::getSingleton().getWorkQueue();
+        if (false == mWorkQueueRegistered)
+        {
+            mWorkQueueChannel = workQueue->getChannel("OgreEffect/PostEffectManager");
+            workQueue->addRequestHandler(mWorkQueueChannel, this);
+            workQueue->addResponseHandler(mWorkQueueChannel, this);
+            mWorkQueueRegistered = true;
+        }
+
+        AsyncTask task;
+        task.effect = CreateInstance(*factIt->second, window);
+        task.window = window;
+        task.viewport = viewport;
+        task.enableWhenReady = enableWhenReady;
+
+        const AsyncHandle handle = ++mAsyncCounter;
+        mAsyncTasks[handle] = task;
+
+        AsyncRequest request;
+        request.handle = handle;
+        request.effect = task.effect;
+        workQueue->addRequest(mWorkQueueChannel, ASYNC_REQUEST_PREPARE, Ogre::Any(request));
+        return handle;
+    }
+    //-------------------------------------------------------
+    Ogre::WorkQueue::Response* PostEffectManager::handleRequest(const Ogre::WorkQueue::Request* req, const Ogre::WorkQueue* srcQ)
+    {
+        (void)srcQ;
+        const AsyncRequest request = Ogre::any_cast<AsyncRequest>(req->getData());
+        try
+        {
+            //a reused pooled instance is already prepared
+            if (false == request.effect->IsBuilt())
+            {
+                request.effect->DoPrepareBackground();
+            }
+        }
+        catch (const Ogre::Exception & e)
+        {
+            return OGRE_NEW Ogre::WorkQueue::Response(req, false, Ogre::Any(), e.getFullDescription());
+        }
+        return OGRE_NEW Ogre::WorkQueue::Response(req, true, Ogre::Any());
+    }
+    //-------------------------------------------------------
+    void PostEffectManager::handleResponse(const Ogre::WorkQueue::Response* res, const Ogre::WorkQueue* srcQ)
+    {
+        (void)srcQ;
+        const AsyncRequest request = Ogre::any_cast<AsyncRequest>(res->getRequest()->getData());
+        auto taskIt = mAsyncTasks.find(request.handle);
+        if (taskIt == mAsyncTasks.end())
+        {
+            return;
+        }
+        AsyncTask & task = taskIt->second;
+        if (true == task.cancelled)
+        {
+            RemoveImpl(task.effect);
+            mAsyncTasks.erase(taskIt);
+            return;
+        }
+
+        bool succeeded = res->succeeded();
+        if (true == succeeded)
+        {
+            try
+            {
+                //Render system dependent part of the preparation
+                if (false == task.effect->IsBuilt())
+                {
+                    task.effect->BuildCompositor(task.window);
+                }
+                AppendEffect(task.effect, task.window, task.viewport);
+            }
+            catch (const Ogre::Exception & e)
+            {
+                Ogre::LogManager::getSingleton().logMessage("PostEffectManager: failed to build " + task.effect->GetName() + ": " + e.getFullDescription());
+                succeeded = false;
+            }
+        }
+        else
+        {
+            Ogre::LogManager::getSingleton().logMessage("PostEffectManager: failed to prepare " + task.effect->GetName() + ": " + res->getMessages());
+        }
+
+        if (false == succeeded)
+        {
+            ChainInfo* info = FindChain(task.effect);
+            if (nullptr != info)
+            {
+                info->effects.erase(std::find(info->effects.begin(), info->effects.end(), task.effect));
+            }
+            //the partially built compositor must not get into a pool
+            task.effect->DestroyCompositor();
+            RemoveImpl(task.effect);
+            task.effect = nullptr;
+            task.state = AS_FAILED;
+            return;
+        }
+
+        mEffects.push_back(task.effect);
+        task.state = AS_READY;
+        if (true == task.enableWhenReady)
+        {
+            task.effect->SetEnabled(true);
+        }
+    }
+    //-------------------------------------------------------
+    PostEffectManager::AsyncState PostEffectManager::GetAsyncState(AsyncHandle handle) const
+    {
+        auto taskIt = mAsyncTasks.find(handle);
+        if (taskIt == mAsyncTasks.cend())
+        {
+            return AS_UNKNOWN;
+        }
+        return taskIt->second.state;
+    }
+    //-------------------------------------------------------
+    PostEffect* PostEffectManager::GetAsyncPostEffect(AsyncHandle handle) const
+    {
+        auto taskIt = mAsyncTasks.find(handle);
+        if ((taskIt == mAsyncTasks.cend()) || (AS_READY != taskIt->second.state))
+        {
+            return nullptr;
+        }
+        return taskIt->second.effect;
     }
     //-------------------------------------------------------
     Ogre::vector<PostEffect*>::type PostEffectManager::CreatePostEffectsChain(const Ogre::vector<Ogre::String>::type & effectTypes, Ogre::RenderWindow* window, Ogre::Viewport* viewport, bool enableAll /* = false */)
@@ -176,16 +1144,24 @@ namespace OgreEffect
         Ogre::vector<PostEffect*>::type effects;
         for (const auto & effectType : effectTypes)
         {
-            PostEffect* effect = CreatePostEffectImpl(effectType, window, chain);
+            PostEffect* effect = CreatePostEffectImpl(effectType, window);
             if (nullptr != effect)
             {
-                if (true == enableAll)
-                {
-                    effect->SetEnabled(true);
-                }
                 effects.push_back(effect);
             }
         }
+        //Attach all at once in order to alias textures across the whole chain
+        AttachEffects(effects, window, viewport, chain);
+        if (true == enableAll)
+        {
+            //the chain is updated once for all effects
+            BeginChainUpdate();
+            for (PostEffect* effect : effects)
+            {
+                effect->SetEnabled(true);
+            }
+            CommitChainUpdate();
+        }
         return effects;
     }
 
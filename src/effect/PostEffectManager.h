@@ -17,6 +17,10 @@
 
 #include <OgrePrerequisites.h>
 #include <OgreSharedPtr.h>
+#include <OgreWorkQueue.h>
+
+#include "PostEffect.h"
+#include "PostEffectUniform.h"
 
 #define DECLARE_REGISTRATION_FUNCTION(EffectName) void GlobalRegisterPostEffect_##EffectName(PostEffectManager* manager);
 #define IMPLEMENT_REGISTRATION_FUNCTION(EffectName) void GlobalRegisterPostEffect_##EffectName(PostEffectManager* manager)
@@ -34,8 +38,16 @@ namespace OgreEffect
 
     class PostEffect;
     class PostEffectFactory;
+    class PostEffectTexturePool;
+    class PostEffectScenePyramid;
+    class PostEffectFusion;
+    class PostEffectProgramCache;
+    class PostEffectAnimator;
+    class PostEffectPrototypeRegistry;
 
-    class PostEffectManager
+    class PostEffectManager:
+        public Ogre::WorkQueue::RequestHandler,
+        public Ogre::WorkQueue::ResponseHandler
     {
     public:
         //Default post effects
@@ -49,9 +61,64 @@ namespace OgreEffect
         static const Ogre::String PE_RAIN;
         //-------------------------------------------------------
 
+        using AsyncHandle = size_t;
+
+        enum AsyncState
+        {
+            AS_UNKNOWN = 0, ///< the handle was not issued
+            AS_PENDING,     ///< the effect is being prepared
+            AS_READY,       ///< the effect is attached to the chain
+            AS_FAILED
+        };
+
+        //State of an effect in a chain
+        struct ChainEntry
+        {
+            PostEffect* effect;
+            bool enabled;
+        };
+        using ChainState = Ogre::vector<ChainEntry>::type;
+        //-------------------------------------------------------
+
     private:
         using FactoriesMap = OGRE_HashMap<Ogre::String, Ogre::SharedPtr<PostEffectFactory> >;
         using EffectsVector = Ogre::vector<PostEffect*>::type;
+        using FusionsMap = Ogre::map<Ogre::String, PostEffectFusion*>::type;
+
+        //Effects attached to a viewport
+        struct ChainInfo
+        {
+            Ogre::RenderWindow* window = nullptr;
+            Ogre::CompositorChain* chain = nullptr;
+            EffectsVector effects; ///< effects in the same order as in the chain
+            Ogre::SharedPtr<PostEffectTexturePool> pool;
+            FusionsMap fusions; ///< fused effects created for groups of the chain effects
+            Ogre::CompositorInstance* pyramid = nullptr; ///< scene pyramid instance; null if no built effect reads the pyramid
+            Ogre::GpuSharedParametersPtr frameParameters; ///< per-frame uniforms of all programs of the chain
+        };
+        using ChainsMap = Ogre::map<Ogre::Viewport*, ChainInfo>::type;
+
+        //Effect created asynchronously
+        struct AsyncTask
+        {
+            PostEffect* effect = nullptr;
+            Ogre::RenderWindow* window = nullptr;
+            Ogre::Viewport* viewport = nullptr;
+            bool enableWhenReady = false;
+            bool cancelled = false;
+            AsyncState state = AS_PENDING;
+        };
+        using AsyncTasksMap = Ogre::map<AsyncHandle, AsyncTask>::type;
+
+        //Data passed to the worker thread
+        struct AsyncRequest
+        {
+            AsyncHandle handle;
+            PostEffect* effect;
+        };
+        static const Ogre::uint16 ASYNC_REQUEST_PREPARE = 1;
+        //An effect is culled only after requesting it for the number of consecutive frames
+        static const size_t CULL_DELAY_FRAMES = 8;
         //-------------------------------------------------------
 
         void RegisterDefaultFactories();
@@ -59,11 +126,85 @@ namespace OgreEffect
 
         FactoriesMap mFactories;
         EffectsVector mEffects;
+
+        bool mTextureAliasing = true;
+        bool mZeroCopyInput = true;
+        size_t mPoolsCounter = 0;
+        size_t mChainsCounter = 0;
+
+        size_t mUpdateCallbacksCounter = 0;
+        Ogre::Real mLastUpdateTime = -1.0f;
+        PostEffectUniform::Statistics mFrameUniformStatistics;
+
+        bool mLazyBuild = false;
+        Ogre::Real mReleaseTimeout = 0.0f;
+
+        bool mFusion = false;
+        size_t mFusionsCounter = 0;
+
+        bool mScenePyramidEnabled = false;
+
+        PostEffect::QualityTier mQualityTier = PostEffect::QT_HIGH;
+
+        Ogre::SharedPtr<PostEffectProgramCache> mProgramCache;
+        //is destroyed before the program cache
+        Ogre::SharedPtr<PostEffectPrototypeRegistry> mPrototypeRegistry;
+        Ogre::SharedPtr<PostEffectAnimator> mAnimator;
+        //uses programs of the cache
+        Ogre::SharedPtr<PostEffectScenePyramid> mScenePyramid;
+
+        ChainsMap mChains;
+
+        //Nesting level of BeginChainUpdate() calls
+        size_t mChainUpdateDepth = 0;
+        //Chains changed inside the update; The value is true if the order of the effects was changed
+        Ogre::map<Ogre::Viewport*, bool>::type mPendingChains;
+
+        AsyncTasksMap mAsyncTasks;
+        AsyncHandle mAsyncCounter = 0;
+        Ogre::uint16 mWorkQueueChannel = 0;
+        bool mWorkQueueRegistered = false;
         //-------------------------------------------------------
-        //Creating effect implementation
-        PostEffect* CreatePostEffectImpl(const Ogre::String & effectType, Ogre::RenderWindow* window, Ogre::CompositorChain* chain);
+        //Get an instance from the factory and set it up for this manager; A reused pooled instance keeps its
+        //compositor only if it was built for the same window and settings
+        PostEffect* CreateInstance(const PostEffectFactory & factory, const Ogre::RenderWindow* window);
+        //Creating effect implementation; The effect's compositor is built but not attached to a chain
+        PostEffect* CreatePostEffectImpl(const Ogre::String & effectType, Ogre::RenderWindow* window);
+        //Share textures between the effects and attach them to the chain in the same order
+        void AttachEffects(const EffectsVector & effects, Ogre::RenderWindow* window, Ogre::Viewport* viewport, Ogre::CompositorChain* chain);
+        //Find the chain containing the effect; Returns nullptr if it is not found
+        ChainInfo* FindChain(const PostEffect* effect);
+        //Apply effects' states to the compositor instances; Fuse per-pixel effects if it is enabled
+        void UpdateChainState(ChainInfo & info);
+        //Check if the effect is enabled and not culled in the current frame
+        static bool IsRendered(const PostEffect* effect);
+        //Destroy the fused effect
+        void DestroyFusion(PostEffectFusion* fusion);
+        //Rebuild compositors of the effects and reattach the chain; Other effects are only reattached
+        //Released effects are destroyed and stay in the chain unbuilt
+        void RebuildChain(Ogre::Viewport* viewport, ChainInfo & info, const EffectsVector & rebuiltEffects, const EffectsVector & releasedEffects = EffectsVector());
         //Removing effect implementation
         void RemoveImpl(PostEffect* effect);
+        //Remove the scene pyramid instance from the chain
+        void DetachScenePyramid(ChainInfo & info);
+        //Destroy compositors of the effects disabled longer than the release timeout
+        void ReleaseIdleEffects(unsigned long now);
+        //Apply the pending changes of the chain; The chain is rebuilt at most once
+        void ApplyChainChanges(Ogre::Viewport* viewport, ChainInfo & info, bool reordered);
+        //Move compositor instances to the order of the chain's effects; Only moved instances are recreated
+        //Fusions should be destroyed and the chain should have no texture pool and no scene pyramid
+        void RepositionInstances(ChainInfo & info);
+        //Throw if the effects are not a permutation of the chain's effects
+        static void CheckChainOrder(const ChainInfo & info, const EffectsVector & effects, const Ogre::String & source);
+        //Fill the chain's per-frame uniforms
+        void UpdateFrameParameters(const Ogre::Viewport* viewport, ChainInfo & info, Ogre::Real time, Ogre::Real delta);
+        //Attach a built effect to the end of the viewport's chain; The chain's textures are aliased again
+        void AppendEffect(PostEffect* effect, Ogre::RenderWindow* window, Ogre::Viewport* viewport);
+
+        //Is called on a worker thread
+        Ogre::WorkQueue::Response* handleRequest(const Ogre::WorkQueue::Request* req, const Ogre::WorkQueue* srcQ) override;
+        //Is called on the main thread; Builds the prepared effect
+        void handleResponse(const Ogre::WorkQueue::Response* res, const Ogre::WorkQueue* srcQ) override;
 
         PostEffectManager(const PostEffectManager&) = delete;
         PostEffectManager(const PostEffectManager&&) = delete;
@@ -93,6 +234,28 @@ namespace OgreEffect
          */
         Ogre::vector<PostEffect*>::type CreatePostEffectsChain(const Ogre::vector<Ogre::String>::type & effectTypes, Ogre::RenderWindow* window, Ogre::Viewport* viewport, bool enableAll = false);
 
+        /**
+         *  Create a post effect without stalling the calling thread
+         *  Only the CPU side preparation of PostEffect::DoPrepareBackground() runs on the Ogre work queue, e.g. image
+         *  decoding or generation of shader sources. Creation of the materials, the GPU programs and the compositor
+         *  needs the render system, so it runs on the main thread when the work queue responses are processed;
+         *  Then the effect is added to the end of the viewport's chain
+         *
+         *  WARNING! The viewport should have no compositors attached not by the manager
+         *
+         *  @param enableWhenReady enable the effect as soon as it is attached
+         *  @return handle to query the state and the created effect
+         */
+        AsyncHandle CreatePostEffectAsync(const Ogre::String & effectType, Ogre::RenderWindow* window, Ogre::Viewport* viewport, bool enableWhenReady = true);
+
+        AsyncState GetAsyncState(AsyncHandle handle) const;
+
+        /**
+         *  Get the effect created asynchronously
+         *  Returns nullptr until the effect is ready
+         */
+        PostEffect* GetAsyncPostEffect(AsyncHandle handle) const;
+
         /**
          *	Free resources and destroy the post effect
          */
@@ -108,6 +271,242 @@ namespace OgreEffect
          */
         void UnregisterPostEffectFactory(Ogre::SharedPtr<PostEffectFactory> factory);
 
+        /**
+         * Enable/disable aliasing of the effects' render targets
+         * Affects only chains created after the call; Enabled by default
+         */
+        void SetTextureAliasingEnabled(bool enabled)
+        {
+            mTextureAliasing = enabled;
+        }
+
+        bool IsTextureAliasingEnabled() const
+        {
+            return mTextureAliasing;
+        }
+
+        /**
+         * Enable/disable zero-copy scene input
+         * If enabled then an effect's input receiving the previous compositor's output is kept alive only
+         * until the last pass reading it, so transient inputs share memory with the previous effects' textures;
+         * A persistent copy is kept only by effects reading the scene after their first pass
+         * Affects only chains created after the call with the texture aliasing enabled; Enabled by default
+         */
+        void SetZeroCopyInputEnabled(bool enabled)
+        {
+            mZeroCopyInput = enabled;
+        }
+
+        bool IsZeroCopyInputEnabled() const
+        {
+            return mZeroCopyInput;
+        }
+
+        /**
+         * Get number of effects attached to the viewport which keep a copy of the input scene
+         * after their first material pass
+         */
+        size_t GetSceneCopiesNumber(Ogre::Viewport* viewport) const;
+
+        /**
+         * Get the pool of render targets shared by effects attached to the viewport
+         * Use it to get statistics of the used memory
+         * Returns nullptr if the textures of the viewport's effects were not aliased
+         */
+        const PostEffectTexturePool* GetTexturePool(Ogre::Viewport* viewport) const;
+
+        /**
+         * Enable/disable fusion of per-pixel effects
+         * Consecutive enabled effects providing a pixel function will be replaced with
+         * a single generated compositor pass
+         */
+        void SetFusionEnabled(bool enabled);
+
+        bool IsFusionEnabled() const
+        {
+            return mFusion;
+        }
+
+        /**
+         * Enable/disable the scene pyramid shared by the glow effects of a chain
+         * If enabled then one set of downsampled scene copies is computed per chain and frame in front of
+         * the first effect reading it; Bloom and GodRays read the pyramid levels instead of downsampling
+         * their inputs and apply their thresholds at the levels. The effects see the input of the first
+         * of them, so effects placed between them are not visible in the glow
+         * Affects only effects created after the call; Disabled by default
+         */
+        void SetScenePyramidEnabled(bool enabled)
+        {
+            mScenePyramidEnabled = enabled;
+        }
+
+        bool IsScenePyramidEnabled() const
+        {
+            return mScenePyramidEnabled;
+        }
+
+        /**
+         * Set quality tier of all effects
+         * Only effects having different settings for the new tier are rebuilt;
+         * Materials of every tier are created once and cached
+         */
+        void SetQualityTier(PostEffect::QualityTier tier);
+
+        PostEffect::QualityTier GetQualityTier() const
+        {
+            return mQualityTier;
+        }
+
+        /**
+         * Set quality tier of a single effect
+         * The effect's chain is rebuilt only if the effect has different settings for the new tier;
+         * The tier is overridden by the next SetQualityTier() call
+         */
+        void SetEffectQualityTier(PostEffect* effect, PostEffect::QualityTier tier);
+
+        /**
+         * Get all created effects in the order of creation
+         */
+        const Ogre::vector<PostEffect*>::type & GetPostEffects() const
+        {
+            return mEffects;
+        }
+
+        /**
+         * Enable/disable lazy building of the effects
+         * In the lazy mode materials, textures and the compositor of an effect are created on its first enabling
+         * Affects only effects created after the call; Disabled by default
+         */
+        void SetLazyBuildEnabled(bool enabled)
+        {
+            mLazyBuild = enabled;
+        }
+
+        bool IsLazyBuildEnabled() const
+        {
+            return mLazyBuild;
+        }
+
+        /**
+         * Set time in seconds after which a disabled effect releases its compositor and textures
+         * The effect is built again when it is enabled; 0 disables releasing. Requires calling Update()
+         */
+        void SetReleaseTimeout(Ogre::Real seconds)
+        {
+            mReleaseTimeout = seconds;
+        }
+
+        Ogre::Real GetReleaseTimeout() const
+        {
+            return mReleaseTimeout;
+        }
+
+        /**
+         * Should be called once per frame before rendering
+         * Updates dynamic passes of the rendered effects with the same frame time and fills the chains'
+         * per-frame uniforms, see POSTEFFECT_FRAME_UNIFORMS; Rebuilds effects whose material parameters were changed;
+         * Releases effects which have been disabled longer than the release timeout
+         */
+        void Update();
+
+        /**
+         * Number of the effects' pass update callbacks made by Update()
+         */
+        size_t GetUpdateCallbacksNumber() const
+        {
+            return mUpdateCallbacksCounter;
+        }
+
+        /**
+         * Uniform values written and skipped as unchanged by the last Update()
+         */
+        const PostEffectUniform::Statistics & GetFrameUniformStatistics() const
+        {
+            return mFrameUniformStatistics;
+        }
+
+        /**
+         * Get the storage of GPU programs shared by all effects
+         * Use it to get statistics of the programs reuse
+         */
+        PostEffectProgramCache & GetProgramCache()
+        {
+            return *mProgramCache;
+        }
+
+        const PostEffectProgramCache & GetProgramCache() const
+        {
+            return *mProgramCache;
+        }
+
+        /**
+         * Get the material prototypes shared by the effects
+         */
+        PostEffectPrototypeRegistry & GetPrototypeRegistry()
+        {
+            return *mPrototypeRegistry;
+        }
+
+        /**
+         * Get the keyframe animator of the effects' parameters
+         * Tracks are evaluated by Update() before the effects are updated; Tracks of a removed effect are destroyed
+         */
+        PostEffectAnimator & GetAnimator()
+        {
+            return *mAnimator;
+        }
+
+        /**
+         * Should be called when the render window has been resized
+         * The effects' textures with relative sizes are reallocated by the compositor chains;
+         * The effects update only resources created manually, materials and shaders are not rebuilt
+         */
+        void NotifyWindowResized(Ogre::RenderWindow* window);
+
+        /**
+         * Start a group of chain changes
+         * Enabling, disabling and reordering of the effects are collected until the matching CommitChainUpdate(),
+         * then every changed chain is rebuilt or updated once; Calls can be nested
+         */
+        void BeginChainUpdate();
+
+        /**
+         * Apply the changes made since the matching BeginChainUpdate()
+         */
+        void CommitChainUpdate();
+
+        /**
+         * Set order and enabled states of all effects of the viewport's chain at once
+         * The chain is rebuilt at most once; Effects are rendered in the order of the entries
+         * @param state entries for every effect of the chain, each effect exactly once
+         */
+        void SetChainState(Ogre::Viewport* viewport, const ChainState & state);
+
+        /**
+         * Change order of the effects of the viewport's chain
+         * Effects keep their compositors, materials and programs; Without a texture pool only the moved
+         * compositor instances are recreated, otherwise the chain's textures are aliased again for the new order
+         * @param effects all effects of the chain in the new order
+         */
+        void ReorderChain(Ogre::Viewport* viewport, const Ogre::vector<PostEffect*>::type & effects);
+
+        /**
+         * Move the effect to the position within its chain
+         * @param position index among the chain's effects, the effect is rendered after 'position' others
+         */
+        void MoveEffect(PostEffect* effect, size_t position);
+
+        /**
+         * Get order and enabled states of the effects of the viewport's chain
+         * Returns an empty state if the viewport has no chain
+         */
+        ChainState GetChainState(Ogre::Viewport* viewport) const;
+
+        /**
+         * Is called by an effect when its state has been changed
+         */
+        void NotifyEnabledChanged(PostEffect* effect);
+
         /**
          *	Syntax sugar to fit OGRE style
          */
@@ -14,7 +14,6 @@
 #include <OgreMaterial.h>
 #include <OgreMaterialManager.h>
 #include <OgreHighLevelGpuProgram.h>
-#include <OgreHighLevelGpuProgramManager.h>
 #include <OgreTechnique.h>
 #include <OgrePass.h>
 
@@ -75,17 +74,13 @@ namespace OgreEffect
                 Ogre::Pass* pass = techniqueGL->getPass(0);
 
                 {
-                    auto vprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/V/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_VERTEX_PROGRAM);
-                    vprogram->setSource(Shader_GL_Copy_V);
+                    auto vprogram = AcquireProgram(Ogre::GPT_VERTEX_PROGRAM, Shader_GL_Copy_V);
 
                     pass->setVertexProgram(vprogram->getName());
                 }
 
                 {
-                    auto fprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/F/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_FRAGMENT_PROGRAM);
-                    fprogram->setSource(Shader_GL_Copy_F);
+                    auto fprogram = AcquireProgram(Ogre::GPT_FRAGMENT_PROGRAM, Shader_GL_Copy_F);
 
                     auto unit0 = pass->createTextureUnitState(TEXTURE_MARKER_SCENE);
                     unit0->setTextureAddressingMode(Ogre::TextureUnitState::TAM_CLAMP);
@@ -97,6 +92,14 @@ namespace OgreEffect
             material->load();
             return { material.get() };
         }
+
+        virtual bool GetPixelFunction(PixelFunction & function) const override
+        {
+            //copy the pixel as is
+            function.uniforms = "";
+            function.body = "";
+            return true;
+        }
     };
 
     IMPLEMENT_REGISTRATION_FUNCTION(EffectNull)
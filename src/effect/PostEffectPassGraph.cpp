@@ -0,0 +1,325 @@
+/**
+* @file PostEffectPassGraph.cpp
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+#include <assert.h>
+#include <algorithm>
+#include <limits>
+
+#include "PostEffectPassGraph.h"
+
+#include <OgreException.h>
+#include <OgreStringConverter.h>
+
+namespace OgreEffect
+{
+
+    const Ogre::String PostEffectPassGraph::RESOURCE_SCENE = "Scene";
+    const Ogre::String PostEffectPassGraph::RESOURCE_OUTPUT = "Output";
+    const Ogre::String PostEffectPassGraph::RESOURCE_PYRAMID = "Pyramid/";
+
+    namespace
+    {
+        const size_t INVALID_INDEX = std::numeric_limits<size_t>::max();
+    }
+
+    //-------------------------------------------------------
+    Ogre::String PostEffectPassGraph::GetPyramidResource(size_t level)
+    {
+        return RESOURCE_PYRAMID + Ogre::StringConverter::toString(level);
+    }
+    //-------------------------------------------------------
+    bool PostEffectPassGraph::IsPyramidResource(const Ogre::String & name)
+    {
+        return 0 == name.compare(0, RESOURCE_PYRAMID.size(), RESOURCE_PYRAMID);
+    }
+    //-------------------------------------------------------
+    bool PostEffectPassGraph::IsExternalResource(const Ogre::String & name)
+    {
+        return (RESOURCE_SCENE == name) || (true == IsPyramidResource(name));
+    }
+    //-------------------------------------------------------
+    size_t PostEffectPassGraph::FindResource(const Ogre::String & name) const
+    {
+        auto resourceIt = std::find_if(mResources.cbegin(), mResources.cend(), [&name](const Resource & resource) { return resource.name == name; });
+        return static_cast<size_t>(resourceIt - mResources.cbegin());
+    }
+    //-------------------------------------------------------
+    void PostEffectPassGraph::AddResourceImpl(const Resource & resource)
+    {
+        if ((true == resource.name.empty()) || (true == IsExternalResource(resource.name)) || (RESOURCE_OUTPUT == resource.name))
+        {
+            OGRE_EXCEPT(Ogre::Exception::ERR_INVALIDPARAMS, "Invalid resource name '" + resource.name + "'", "PostEffectPassGraph[AddResource]");
+        }
+        if (FindResource(resource.name) != mResources.size())
+        {
+            OGRE_EXCEPT(Ogre::Exception::ERR_DUPLICATE_ITEM, "The resource '" + resource.name + "' is declared already", "PostEffectPassGraph[AddResource]");
+        }
+        mResources.push_back(resource);
+    }
+    //-------------------------------------------------------
+    void PostEffectPassGraph::AddResource(const Ogre::String & name, size_t width, size_t height, Ogre::PixelFormat format /* = Ogre::PF_R8G8B8A8 */)
+    {
+        if ((0 == width) || (0 == height))
+        {
+            OGRE_EXCEPT(Ogre::Exception::ERR_INVALIDPARAMS, "The resource '" + name + "' has zero size", "PostEffectPassGraph[AddResource]");
+        }
+        AddResourceImpl(Resource{ name, width, height, 0.0f, 0.0f, format });
+    }
+    //-------------------------------------------------------
+    void PostEffectPassGraph::AddRelativeResource(const Ogre::String & name, Ogre::Real widthFactor, Ogre::Real heightFactor, Ogre::PixelFormat format /* = Ogre::PF_R8G8B8A8 */)
+    {
+        if ((widthFactor <= 0.0f) || (heightFactor <= 0.0f))
+        {
+            OGRE_EXCEPT(Ogre::Exception::ERR_INVALIDPARAMS, "The resource '" + name + "' has invalid size factors", "PostEffectPassGraph[AddRelativeResource]");
+        }
+        AddResourceImpl(Resource{ name, 0, 0, widthFactor, heightFactor, format });
+    }
+    //-------------------------------------------------------
+    size_t PostEffectPassGraph::AddPass(const Ogre::String & material, const Ogre::vector<Ogre::String>::type & inputs, const Ogre::String & output)
+    {
+        mPasses.push_back(Pass{ material, inputs, output });
+        return mPasses.size() - 1;
+    }
+    //-------------------------------------------------------
+    Ogre::vector<size_t>::type PostEffectPassGraph::Validate(size_t & outputPass) const
+    {
+        Ogre::vector<size_t>::type writers(mResources.size(), INVALID_INDEX);
+        outputPass = INVALID_INDEX;
+        for (size_t passIdx = 0; passIdx < mPasses.size(); ++passIdx)
+        {
+            const Pass & pass = mPasses[passIdx];
+            const Ogre::String passName = "The pass " + Ogre::StringConverter::toString(passIdx) + " (" + pass.material + ")";
+            if (true == pass.material.empty())
+            {
+                OGRE_EXCEPT(Ogre::Exception::ERR_INVALIDPARAMS, passName + " has no material", "PostEffectPassGraph[Compile]");
+            }
+            for (const Ogre::String & input : pass.inputs)
+            {
+                if ((true == input.empty()) || (true == IsExternalResource(input)))
+                {
+                    continue;
+                }
+                if ((RESOURCE_OUTPUT == input) || (FindResource(input) == mResources.size()))
+                {
+                    OGRE_EXCEPT(Ogre::Exception::ERR_ITEM_NOT_FOUND, passName + " reads unknown resource '" + input + "'", "PostEffectPassGraph[Compile]");
+                }
+                if (pass.output == input)
+                {
+                    OGRE_EXCEPT(Ogre::Exception::ERR_INVALIDPARAMS, passName + " reads its own output", "PostEffectPassGraph[Compile]");
+                }
+            }
+            if (RESOURCE_OUTPUT == pass.output)
+            {
+                if (INVALID_INDEX != outputPass)
+                {
+                    OGRE_EXCEPT(Ogre::Exception::ERR_DUPLICATE_ITEM, passName + " writes the output written already", "PostEffectPassGraph[Compile]");
+                }
+                outputPass = passIdx;
+                continue;
+            }
+            size_t resourceIdx = FindResource(pass.output);
+            if ((true == IsExternalResource(pass.output)) || (resourceIdx == mResources.size()))
+            {
+                OGRE_EXCEPT(Ogre::Exception::ERR_ITEM_NOT_FOUND, passName + " writes invalid resource '" + pass.output + "'", "PostEffectPassGraph[Compile]");
+            }
+            if (INVALID_INDEX != writers[resourceIdx])
+            {
+                OGRE_EXCEPT(Ogre::Exception::ERR_DUPLICATE_ITEM, passName + " writes the resource '" + pass.output + "' written already", "PostEffectPassGraph[Compile]");
+            }
+            writers[resourceIdx] = passIdx;
+        }
+        if (INVALID_INDEX == outputPass)
+        {
+            OGRE_EXCEPT(Ogre::Exception::ERR_INVALID_STATE, "No pass writes the output", "PostEffectPassGraph[Compile]");
+        }
+        //every read resource should be written
+        for (const Pass & pass : mPasses)
+        {
+            for (const Ogre::String & input : pass.inputs)
+            {
+                if ((false == input.empty()) && (false == IsExternalResource(input)) && (INVALID_INDEX == writers[FindResource(input)]))
+                {
+                    OGRE_EXCEPT(Ogre::Exception::ERR_INVALID_STATE, "The resource '" + input + "' is read but never written", "PostEffectPassGraph[Compile]");
+                }
+            }
+        }
+        return writers;
+    }
+    //-------------------------------------------------------
+    PostEffectPassGraph::CompiledGraph PostEffectPassGraph::Compile(const Ogre::String & texturePrefix) const
+    {
+        size_t outputPass = INVALID_INDEX;
+        const Ogre::vector<size_t>::type writers = Validate(outputPass);
+
+        //Producers of the pass inputs
+        Ogre::vector<Ogre::vector<size_t>::type>::type producers(mPasses.size());
+        for (size_t passIdx = 0; passIdx < mPasses.size(); ++passIdx)
+        {
+            for (const Ogre::String & input : mPasses[passIdx].inputs)
+            {
+                if ((false == input.empty()) && (false == IsExternalResource(input)))
+                {
+                    size_t writer = writers[FindResource(input)];
+                    Ogre::vector<size_t>::type & passProducers = producers[passIdx];
+                    if (std::find(passProducers.cbegin(), passProducers.cend(), writer) == passProducers.cend())
+                    {
+                        passProducers.push_back(writer);
+                    }
+                }
+            }
+        }
+
+        //Cull passes which the output doesn't depend on
+        Ogre::vector<bool>::type needed(mPasses.size(), false);
+        {
+            Ogre::vector<size_t>::type stack = { outputPass };
+            while (false == stack.empty())
+            {
+                size_t passIdx = stack.back();
+                stack.pop_back();
+                if (true == needed[passIdx])
+                {
+                    continue;
+                }
+                needed[passIdx] = true;
+                stack.insert(stack.end(), producers[passIdx].cbegin(), producers[passIdx].cend());
+            }
+        }
+
+        //Schedule the needed passes in a topological order
+        //Among the ready passes prefer the one consuming the most recently produced data to shorten textures lifetimes
+        Ogre::vector<size_t>::type schedule;
+        Ogre::vector<size_t>::type position(mPasses.size(), INVALID_INDEX);
+        size_t neededNumber = static_cast<size_t>(std::count(needed.cbegin(), needed.cend(), true));
+        while (schedule.size() < neededNumber)
+        {
+            size_t bestPass = INVALID_INDEX;
+            size_t bestLatest = 0;
+            for (size_t passIdx = 0; passIdx < mPasses.size(); ++passIdx)
+            {
+                if ((false == needed[passIdx]) || (INVALID_INDEX != position[passIdx]))
+                {
+                    continue;
+                }
+                bool ready = true;
+                size_t latest = 0;
+                for (size_t producer : producers[passIdx])
+                {
+                    if (INVALID_INDEX == position[producer])
+                    {
+                        ready = false;
+                        break;
+                    }
+                    latest = std::max(latest, position[producer] + 1);
+                }
+                if ((true == ready) && ((INVALID_INDEX == bestPass) || (latest > bestLatest)))
+                {
+                    bestPass = passIdx;
+                    bestLatest = latest;
+                }
+            }
+            if (INVALID_INDEX == bestPass)
+            {
+                OGRE_EXCEPT(Ogre::Exception::ERR_INVALID_STATE, "The passes have a cyclic dependency", "PostEffectPassGraph[Compile]");
+            }
+            position[bestPass] = schedule.size();
+            schedule.push_back(bestPass);
+        }
+        assert(schedule.back() == outputPass);
+
+        //Lifetimes of the resources in terms of the scheduled passes
+        Ogre::vector<size_t>::type firstUse(mResources.size(), INVALID_INDEX);
+        Ogre::vector<size_t>::type lastUse(mResources.size(), 0);
+        for (size_t resourceIdx = 0; resourceIdx < mResources.size(); ++resourceIdx)
+        {
+            if ((INVALID_INDEX != writers[resourceIdx]) && (true == needed[writers[resourceIdx]]))
+            {
+                firstUse[resourceIdx] = lastUse[resourceIdx] = position[writers[resourceIdx]];
+            }
+        }
+        for (size_t passIdx : schedule)
+        {
+            for (const Ogre::String & input : mPasses[passIdx].inputs)
+            {
+                if ((false == input.empty()) && (false == IsExternalResource(input)))
+                {
+                    size_t resourceIdx = FindResource(input);
+                    lastUse[resourceIdx] = std::max(lastUse[resourceIdx], position[passIdx]);
+                }
+            }
+        }
+
+        //Place resources into textures; a texture can't be read and written in the same pass, so the lifetimes should not touch
+        CompiledGraph result;
+        Ogre::vector<size_t>::type resourceTextures(mResources.size(), INVALID_INDEX);
+        Ogre::vector<size_t>::type order;
+        for (size_t resourceIdx = 0; resourceIdx < mResources.size(); ++resourceIdx)
+        {
+            if (INVALID_INDEX != firstUse[resourceIdx])
+            {
+                order.push_back(resourceIdx);
+            }
+        }
+        std::stable_sort(order.begin(), order.end(), [&firstUse](size_t lhs, size_t rhs) { return firstUse[lhs] < firstUse[rhs]; });
+        for (size_t resourceIdx : order)
+        {
+            const Resource & resource = mResources[resourceIdx];
+            auto textureIt = std::find_if(result.textures.begin(), result.textures.end(), [&resource, &firstUse, resourceIdx](const CompiledTexture & texture)
+            {
+                return (texture.width == resource.width) && (texture.height == resource.height) && (texture.widthFactor == resource.widthFactor) && (texture.heightFactor == resource.heightFactor) &&
+                    (texture.format == resource.format) && (texture.lastPass < firstUse[resourceIdx]);
+            });
+            if (textureIt == result.textures.end())
+            {
+                CompiledTexture texture;
+                texture.name = texturePrefix + "/" + Ogre::StringConverter::toString(result.textures.size());
+                texture.width = resource.width;
+                texture.height = resource.height;
+                texture.widthFactor = resource.widthFactor;
+                texture.heightFactor = resource.heightFactor;
+                texture.format = resource.format;
+                texture.firstPass = firstUse[resourceIdx];
+                result.textures.push_back(texture);
+                textureIt = result.textures.end() - 1;
+            }
+            else
+            {
+                ++result.sharedResourcesNumber;
+            }
+            textureIt->lastPass = lastUse[resourceIdx];
+            resourceTextures[resourceIdx] = static_cast<size_t>(textureIt - result.textures.begin());
+        }
+
+        //Resolve resource names
+        for (size_t passIdx : schedule)
+        {
+            const Pass & pass = mPasses[passIdx];
+            CompiledPass compiled;
+            compiled.pass = passIdx;
+            compiled.material = pass.material;
+            for (const Ogre::String & input : pass.inputs)
+            {
+                if ((true == input.empty()) || (true == IsExternalResource(input)))
+                {
+                    compiled.inputs.push_back(input);
+                }
+                else
+                {
+                    compiled.inputs.push_back(result.textures[resourceTextures[FindResource(input)]].name);
+                }
+            }
+            compiled.output = (RESOURCE_OUTPUT == pass.output) ? RESOURCE_OUTPUT : result.textures[resourceTextures[FindResource(pass.output)]].name;
+            result.passes.push_back(compiled);
+        }
+        result.culledPassesNumber = mPasses.size() - neededNumber;
+        return result;
+    }
+
+}//namespace OgreEffect
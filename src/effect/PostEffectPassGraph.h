@@ -0,0 +1,164 @@
+/**
+* @file PostEffectPassGraph.h
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+#ifndef _POSTEFFECT_PASS_GRAPH_H_
+#define _POSTEFFECT_PASS_GRAPH_H_
+
+#include <OgrePrerequisites.h>
+#include <OgrePixelFormat.h>
+
+namespace OgreEffect
+{
+
+    /**
+     * Declarative description of an effect pipeline
+     * Nodes are full screen passes rendered with a material, edges are named textures
+     * The graph is validated, culled and scheduled by Compile(); the result is a linear list of passes
+     * with intermediate textures shared between passes where their lifetimes don't overlap
+     *
+     * The class doesn't touch any render system objects, so it can be used without a GPU
+     */
+    class PostEffectPassGraph
+    {
+    public:
+        static const Ogre::String RESOURCE_SCENE;  ///< reserved name of the previous compositor's output
+        static const Ogre::String RESOURCE_OUTPUT; ///< reserved name of the effect's output
+        static const Ogre::String RESOURCE_PYRAMID; ///< reserved prefix of the levels of the chain's scene pyramid
+
+        /**
+         * Texture size is either absolute or relative to the target; 
+         * In the second case width and height are 0
+         */
+        struct Resource
+        {
+            Ogre::String name;
+            size_t width;
+            size_t height;
+            Ogre::Real widthFactor;
+            Ogre::Real heightFactor;
+            Ogre::PixelFormat format;
+        };
+
+        struct Pass
+        {
+            Ogre::String material;
+            Ogre::vector<Ogre::String>::type inputs; ///< resources bound to the texture units; empty names keep the material's textures
+            Ogre::String output;
+        };
+
+        struct CompiledTexture
+        {
+            Ogre::String name;   ///< name of the texture definition
+            size_t width;
+            size_t height;
+            Ogre::Real widthFactor;
+            Ogre::Real heightFactor;
+            Ogre::PixelFormat format;
+            size_t firstPass;    ///< index of the first compiled pass using the texture
+            size_t lastPass;     ///< index of the last compiled pass using the texture
+        };
+
+        struct CompiledPass
+        {
+            size_t pass;         ///< index of the declared pass
+            Ogre::String material;
+            Ogre::vector<Ogre::String>::type inputs; ///< texture definitions or external resources; empty names are not bound
+            Ogre::String output; ///< texture definition or RESOURCE_OUTPUT
+        };
+
+        struct CompiledGraph
+        {
+            Ogre::vector<CompiledPass>::type passes;        ///< passes in the execution order; the last one writes RESOURCE_OUTPUT
+            Ogre::vector<CompiledTexture>::type textures;
+            size_t culledPassesNumber = 0;  ///< passes not contributing to the output
+            size_t sharedResourcesNumber = 0; ///< resources placed into already used textures
+        };
+        //-------------------------------------------------------
+
+    private:
+        Ogre::vector<Resource>::type mResources;
+        Ogre::vector<Pass>::type mPasses;
+        //-------------------------------------------------------
+
+        //Returns index of the resource or mResources.size() if it is not found
+        size_t FindResource(const Ogre::String & name) const;
+
+        void AddResourceImpl(const Resource & resource);
+
+        //Throws if the graph is inconsistent; returns index of the pass writing each resource
+        Ogre::vector<size_t>::type Validate(size_t & outputPass) const;
+
+    public:
+        /**
+         * Name of a level of the scene pyramid shared by the effects of a chain
+         * Level 0 is a half of the target size, every next level halves the previous one
+         * The levels are not thresholded; they are provided only if the manager has the scene pyramid enabled
+         */
+        static Ogre::String GetPyramidResource(size_t level);
+
+        static bool IsPyramidResource(const Ogre::String & name);
+
+        /**
+         * Check if the resource is provided outside of the effect, i.e. is the scene or a pyramid level
+         */
+        static bool IsExternalResource(const Ogre::String & name);
+
+        /**
+         * Declare an intermediate texture of the fixed size
+         */
+        void AddResource(const Ogre::String & name, size_t width, size_t height, Ogre::PixelFormat format = Ogre::PF_R8G8B8A8);
+
+        /**
+         * Declare an intermediate texture with the size relative to the render target
+         * Such textures are reallocated by the compositor when the target is resized
+         */
+        void AddRelativeResource(const Ogre::String & name, Ogre::Real widthFactor, Ogre::Real heightFactor, Ogre::PixelFormat format = Ogre::PF_R8G8B8A8);
+
+        /**
+         * Declare a pass
+         * @param material name of the material rendered by the pass
+         * @param inputs resources bound to the material texture units in the same order
+         * @param output resource written by the pass; Every resource should be written only once
+         * @return index of the pass
+         */
+        size_t AddPass(const Ogre::String & material, const Ogre::vector<Ogre::String>::type & inputs, const Ogre::String & output);
+
+        /**
+         * Validate the graph, cull passes not contributing to the output,
+         * order passes respecting dependencies and assign textures to the resources
+         * @param texturePrefix prefix of the compiled texture names
+         */
+        CompiledGraph Compile(const Ogre::String & texturePrefix) const;
+
+        const Ogre::vector<Resource>::type & GetResources() const
+        {
+            return mResources;
+        }
+
+        const Ogre::vector<Pass>::type & GetPasses() const
+        {
+            return mPasses;
+        }
+
+        bool IsEmpty() const
+        {
+            return mPasses.empty();
+        }
+
+        void Clear()
+        {
+            mResources.clear();
+            mPasses.clear();
+        }
+    };
+
+}//namespace OgreEffect
+
+#endif //_POSTEFFECT_PASS_GRAPH_H_
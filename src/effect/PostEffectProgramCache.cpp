@@ -0,0 +1,228 @@
+/**
+* @file PostEffectProgramCache.cpp
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+#include "PostEffectProgramCache.h"
+
+#include <algorithm>
+#include <fstream>
+
+#include <OgreCommon.h>
+#include <OgreDataStream.h>
+#include <OgreGpuProgramManager.h>
+#include <OgreHighLevelGpuProgramManager.h>
+#include <OgreLogManager.h>
+#include <OgreRenderSystem.h>
+#include <OgreRenderSystemCapabilities.h>
+#include <OgreResourceGroupManager.h>
+#include <OgreRoot.h>
+#include <OgreStringConverter.h>
+
+namespace OgreEffect
+{
+
+    PostEffectProgramCache::PostEffectProgramCache(const Ogre::String & name):
+        mName(name)
+    { }
+    //-------------------------------------------------------
+    Ogre::String PostEffectProgramCache::GetStageName(Ogre::GpuProgramType type)
+    {
+        switch (type)
+        {
+        case Ogre::GPT_VERTEX_PROGRAM:
+            return "V";
+        case Ogre::GPT_FRAGMENT_PROGRAM:
+            return "F";
+        case Ogre::GPT_GEOMETRY_PROGRAM:
+            return "G";
+        default:
+            return Ogre::StringConverter::toString(static_cast<int>(type));
+        }
+    }
+    //-------------------------------------------------------
+    Ogre::HighLevelGpuProgramPtr PostEffectProgramCache::Acquire(const Ogre::String & language, Ogre::GpuProgramType type, const Ogre::String & source, const Ogre::String & defines)
+    {
+        const Ogre::uint32 hash = Ogre::FastHash(source.c_str(), static_cast<int>(source.size()));
+        const Ogre::String key = language + "/" + GetStageName(type) + "/" + Ogre::StringConverter::toString(hash) + "/" + defines;
+
+        Ogre::vector<Entry>::type & entries = mEntries[key];
+        for (const Entry & entry : entries)
+        {
+            if (entry.source == source)
+            {
+                ++mStatistics.hits;
+                return entry.program;
+            }
+        }
+
+        ++mStatistics.misses;
+        //The name depends only on the program content, so binaries saved by the previous runs can be matched by it
+        const Ogre::uint32 keyHash = Ogre::FastHash(key.c_str(), static_cast<int>(key.size()));
+        Ogre::String name = mName + "/" + GetStageName(type) + "/" + Ogre::StringConverter::toString(keyHash);
+        if (false == entries.empty())
+        {
+            //entries with the same key can be destroyed, so the index is checked for uniqueness
+            size_t collisionIdx = entries.size();
+            while (mProgramKeys.end() != mProgramKeys.find(name + "/" + Ogre::StringConverter::toString(collisionIdx)))
+            {
+                ++collisionIdx;
+            }
+            name += "/" + Ogre::StringConverter::toString(collisionIdx);
+        }
+
+        Entry entry;
+        entry.source = source;
+        entry.program = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram(name,
+            Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, language, type);
+        entry.program->setSource(source);
+        if (false == defines.empty())
+        {
+            entry.program->setParameter("preprocessor_defines", defines);
+        }
+        entries.push_back(entry);
+        mProgramKeys[name] = key;
+        ++mProgramsCounter;
+        return entry.program;
+    }
+    //-------------------------------------------------------
+    bool PostEffectProgramCache::AddProgramUser(const Ogre::String & programName)
+    {
+        auto keyIt = mProgramKeys.find(programName);
+        if (mProgramKeys.end() == keyIt)
+        {
+            return false;
+        }
+        for (Entry & entry : mEntries[keyIt->second])
+        {
+            if (entry.program->getName() == programName)
+            {
+                ++entry.users;
+                return true;
+            }
+        }
+        return false;
+    }
+    //-------------------------------------------------------
+    void PostEffectProgramCache::RemoveProgramUser(const Ogre::String & programName)
+    {
+        auto keyIt = mProgramKeys.find(programName);
+        if (mProgramKeys.end() == keyIt)
+        {
+            return;
+        }
+        auto entriesIt = mEntries.find(keyIt->second);
+        if (mEntries.end() == entriesIt)
+        {
+            return;
+        }
+        Ogre::vector<Entry>::type & entries = entriesIt->second;
+        for (auto entryIt = entries.begin(); entryIt != entries.end(); ++entryIt)
+        {
+            if ((entryIt->program->getName() == programName) && (entryIt->users > 0) && (0 == --entryIt->users))
+            {
+                Ogre::HighLevelGpuProgramManager* programManager = Ogre::HighLevelGpuProgramManager::getSingletonPtr();
+                if (nullptr != programManager)
+                {
+                    programManager->remove(programName);
+                }
+                entries.erase(entryIt);
+                if (true == entries.empty())
+                {
+                    mEntries.erase(entriesIt);
+                }
+                mProgramKeys.erase(keyIt);
+                --mProgramsCounter;
+                return;
+            }
+        }
+    }
+    //-------------------------------------------------------
+    Ogre::String PostEffectProgramCache::GetRendererIdentity()
+    {
+        const Ogre::RenderSystem* renderSystem = Ogre::Root::getSingleton().getRenderSystem();
+        if (nullptr == renderSystem)
+        {
+            return Ogre::StringUtil::BLANK;
+        }
+        const Ogre::RenderSystemCapabilities* capabilities = renderSystem->getCapabilities();
+        Ogre::String identity = renderSystem->getName();
+        if (nullptr != capabilities)
+        {
+            identity += "|" + capabilities->getDeviceName() + "|" + capabilities->getDriverVersion().toString() + "|" + 
+                Ogre::RenderSystemCapabilities::vendorToString(capabilities->getVendor());
+        }
+        //the identity is stored as a single line
+        Ogre::StringUtil::trim(identity);
+        std::replace(identity.begin(), identity.end(), '\n', ' ');
+        return identity;
+    }
+    //-------------------------------------------------------
+    bool PostEffectProgramCache::LoadBinaries(const Ogre::String & fileName)
+    {
+        Ogre::GpuProgramManager & programManager = Ogre::GpuProgramManager::getSingleton();
+        if (false == programManager.canGetCompiledShaderBuffer())
+        {
+            Ogre::LogManager::getSingleton().logMessage("PostEffectProgramCache: the render system doesn't support program binaries");
+            return false;
+        }
+        //Programs linked during this run will be stored for saving
+        programManager.setSaveMicrocodesToCache(true);
+
+        std::ifstream* file = OGRE_NEW_T(std::ifstream, Ogre::MEMCATEGORY_GENERAL)(fileName.c_str(), std::ios::in | std::ios::binary);
+        if (false == file->is_open())
+        {
+            OGRE_DELETE_T(file, basic_ifstream, Ogre::MEMCATEGORY_GENERAL);
+            Ogre::LogManager::getSingleton().logMessage("PostEffectProgramCache: " + fileName + " is not found, programs will be compiled");
+            return false;
+        }
+        Ogre::DataStreamPtr stream(OGRE_NEW Ogre::FileStreamDataStream(fileName, file, true));
+
+        const Ogre::String identity = stream->getLine();
+        if (identity != GetRendererIdentity())
+        {
+            //Binaries are valid only for the same driver
+            Ogre::LogManager::getSingleton().logMessage("PostEffectProgramCache: " + fileName + " was saved for another renderer \"" + identity + "\", programs will be compiled");
+            return false;
+        }
+        programManager.loadMicrocodeCache(stream);
+        mBinariesFile = fileName;
+        Ogre::LogManager::getSingleton().logMessage("PostEffectProgramCache: program binaries are loaded from " + fileName);
+        return true;
+    }
+    //-------------------------------------------------------
+    bool PostEffectProgramCache::SaveBinaries(const Ogre::String & fileName) const
+    {
+        Ogre::GpuProgramManager & programManager = Ogre::GpuProgramManager::getSingleton();
+        if ((false == programManager.canGetCompiledShaderBuffer()) || (false == programManager.getSaveMicrocodesToCache()))
+        {
+            return false;
+        }
+        if ((fileName == mBinariesFile) && (false == programManager.isCacheDirty()))
+        {
+            //all programs were loaded from the file
+            return true;
+        }
+
+        std::fstream* file = OGRE_NEW_T(std::fstream, Ogre::MEMCATEGORY_GENERAL)(fileName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+        if (false == file->is_open())
+        {
+            OGRE_DELETE_T(file, basic_fstream, Ogre::MEMCATEGORY_GENERAL);
+            Ogre::LogManager::getSingleton().logMessage("PostEffectProgramCache: failed to open " + fileName + " for writing");
+            return false;
+        }
+        Ogre::DataStreamPtr stream(OGRE_NEW Ogre::FileStreamDataStream(fileName, file, true));
+
+        const Ogre::String identity = GetRendererIdentity() + "\n";
+        stream->write(identity.c_str(), identity.size());
+        programManager.saveMicrocodeCache(stream);
+        Ogre::LogManager::getSingleton().logMessage("PostEffectProgramCache: program binaries are saved to " + fileName);
+        return true;
+    }
+
+}//namespace OgreEffect
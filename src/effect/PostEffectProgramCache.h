@@ -0,0 +1,133 @@
+/**
+* @file PostEffectProgramCache.h
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+#ifndef _POSTEFFECT_PROGRAM_CACHE_H_
+#define _POSTEFFECT_PROGRAM_CACHE_H_
+
+#include <OgrePrerequisites.h>
+#include <OgreString.h>
+#include <OgreGpuProgram.h>
+#include <OgreHighLevelGpuProgram.h>
+
+namespace OgreEffect
+{
+
+    /**
+     * Shared storage of the effects' GPU programs
+     * Programs are deduplicated by language, stage, preprocessor defines and source, so effects
+     * and instances using the same shader code share a single compiled program
+     *
+     * Programs are reference counted by their users, see AddProgramUser(); RemoveProgramUser() destroys a program
+     * with its last user. Programs never counted as used, e.g. the ones of Rain's drop material, stay until
+     * the cache is destroyed
+     *
+     * Binaries of the linked programs can be saved to a file and loaded by the next run, if the render system
+     * supports it; The file is valid only for the renderer and driver which saved it. Names of the programs
+     * depend only on their content, so changed sources miss the saved binaries and are compiled
+     */
+    class PostEffectProgramCache
+    {
+    public:
+        struct Statistics
+        {
+            size_t hits = 0;     ///< requests served by an existing program
+            size_t misses = 0;   ///< requests created a new program
+        };
+        //-------------------------------------------------------
+
+    private:
+        struct Entry
+        {
+            Ogre::String source;
+            Ogre::HighLevelGpuProgramPtr program;
+            size_t users = 0;
+        };
+        //Entries with the same key differ only by source having the same hash
+        using EntriesMap = OGRE_HashMap<Ogre::String, Ogre::vector<Entry>::type>;
+        //-------------------------------------------------------
+
+        const Ogre::String mName;
+        EntriesMap mEntries;
+        OGRE_HashMap<Ogre::String, Ogre::String> mProgramKeys; ///< key of the entry by the program name
+        size_t mProgramsCounter = 0;
+        Statistics mStatistics;
+        Ogre::String mBinariesFile; ///< file the binaries were loaded from
+        //-------------------------------------------------------
+
+        static Ogre::String GetStageName(Ogre::GpuProgramType type);
+
+        //Render system, device and driver version; Binaries are compatible only within the same identity
+        static Ogre::String GetRendererIdentity();
+
+        PostEffectProgramCache(const PostEffectProgramCache&) = delete;
+        PostEffectProgramCache(const PostEffectProgramCache&&) = delete;
+        PostEffectProgramCache& operator=(const PostEffectProgramCache&) = delete;
+        PostEffectProgramCache& operator=(const PostEffectProgramCache&&) = delete;
+        //-------------------------------------------------------
+
+    public:
+        /**
+         * @param name Unique name of the cache; Is used as a prefix of the programs names
+         */
+        explicit PostEffectProgramCache(const Ogre::String & name);
+
+        /**
+         * Get a program with the given source, creating it on the first request
+         * @param language high level language of the program, e.g. "glsl"
+         * @param type stage of the program
+         * @param source program source
+         * @param defines preprocessor defines in the Ogre format "A=1;B"
+         */
+        Ogre::HighLevelGpuProgramPtr Acquire(const Ogre::String & language, Ogre::GpuProgramType type, const Ogre::String & source, const Ogre::String & defines = Ogre::StringUtil::BLANK);
+
+        /**
+         * Load program binaries saved by a previous run
+         * Should be called after the render system is initialised and before the effects are created;
+         * Enables collecting binaries of the programs linked during this run
+         * @return false if the file is not found or was saved for another renderer or driver
+         */
+        bool LoadBinaries(const Ogre::String & fileName);
+
+        /**
+         * Save binaries of the programs linked by the render system
+         * Should be called before the render system is shut down
+         * @return false if the binaries can't be saved
+         */
+        bool SaveBinaries(const Ogre::String & fileName) const;
+
+        /**
+         * Count a user of the program, e.g. a material prototype
+         * @return false if the program was not created by the cache
+         */
+        bool AddProgramUser(const Ogre::String & programName);
+
+        /**
+         * Remove a user of the program; The program without users is destroyed
+         * Programs which never had users stay in the cache until it is destroyed
+         */
+        void RemoveProgramUser(const Ogre::String & programName);
+
+        /**
+         * Number of distinct programs in the cache
+         */
+        size_t GetProgramsNumber() const
+        {
+            return mProgramsCounter;
+        }
+
+        const Statistics & GetStatistics() const
+        {
+            return mStatistics;
+        }
+    };
+
+}//namespace OgreEffect
+
+#endif //_POSTEFFECT_PROGRAM_CACHE_H_
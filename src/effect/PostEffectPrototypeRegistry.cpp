@@ -0,0 +1,210 @@
+/**
+* @file PostEffectPrototypeRegistry.cpp
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+#include "PostEffectPrototypeRegistry.h"
+
+#include <assert.h>
+
+#include <OgreMaterial.h>
+#include <OgreMaterialManager.h>
+#include <OgreTechnique.h>
+#include <OgrePass.h>
+#include <OgreTextureManager.h>
+#include <OgreResourceGroupManager.h>
+
+#include "PostEffectProgramCache.h"
+
+namespace OgreEffect
+{
+
+    PostEffectPrototypeRegistry::PostEffectPrototypeRegistry(PostEffectProgramCache* programCache, const Ogre::StringVector & markers):
+        mProgramCache(programCache), mMarkers(markers)
+    { }
+    //-------------------------------------------------------
+    PostEffectPrototypeRegistry::~PostEffectPrototypeRegistry()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (auto & entryPair : mEntries)
+        {
+            DestroyEntry(entryPair.second);
+        }
+        mEntries.clear();
+        DestroyMarkers();
+    }
+    //-------------------------------------------------------
+    void PostEffectPrototypeRegistry::CreateMarkers()
+    {
+        if (true == mMarkersCreated)
+        {
+            return;
+        }
+        for (const Ogre::String & name : mMarkers)
+        {
+            if (true == Ogre::TextureManager::getSingleton().getByName(name).isNull())
+            {
+                Ogre::TextureManager::getSingleton().createManual(name,
+                    Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME,
+                    Ogre::TEX_TYPE_2D, 1, 1, 0, Ogre::PF_L8);
+            }
+        }
+        mMarkersCreated = true;
+    }
+    //-------------------------------------------------------
+    void PostEffectPrototypeRegistry::DestroyMarkers()
+    {
+        if (false == mMarkersCreated)
+        {
+            return;
+        }
+        Ogre::TextureManager* textureManager = Ogre::TextureManager::getSingletonPtr();
+        if (nullptr != textureManager)
+        {
+            for (const Ogre::String & name : mMarkers)
+            {
+                textureManager->remove(name);
+            }
+        }
+        mMarkersCreated = false;
+    }
+    //-------------------------------------------------------
+    void PostEffectPrototypeRegistry::DestroyEntry(Entry & entry)
+    {
+        Ogre::MaterialManager* materialManager = Ogre::MaterialManager::getSingletonPtr();
+        if (nullptr != materialManager)
+        {
+            for (Ogre::Material* material : entry.prototypes.materials)
+            {
+                materialManager->remove(material->getName());
+            }
+        }
+        entry.prototypes.materials.clear();
+        //programs are removed after the materials referring to them
+        if (nullptr != mProgramCache)
+        {
+            for (const Ogre::String & program : entry.programs)
+            {
+                mProgramCache->RemoveProgramUser(program);
+            }
+        }
+        entry.programs.clear();
+    }
+    //-------------------------------------------------------
+    const PostEffectPrototypeRegistry::Prototypes & PostEffectPrototypeRegistry::Acquire(const Ogre::String & key, const CreateFunction & create)
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        auto entryIt = mEntries.find(key);
+        while ((mEntries.end() != entryIt) && (false == entryIt->second.ready))
+        {
+            if (std::this_thread::get_id() == entryIt->second.creator)
+            {
+                OGRE_EXCEPT(Ogre::Exception::ERR_INVALID_STATE, "Prototypes " + key + " are requested while being created", "PostEffectPrototypeRegistry[Acquire]");
+            }
+            mEntryCreated.wait(lock);
+            //the creation could fail and drop the entry
+            entryIt = mEntries.find(key);
+        }
+        if (mEntries.end() == entryIt)
+        {
+            CreateMarkers();
+            //the pending entry makes other requests of the key wait instead of creating it once more
+            entryIt = mEntries.emplace(key, Entry()).first;
+            entryIt->second.creator = std::this_thread::get_id();
+
+            //Create outside the lock, so the function can acquire other prototypes
+            lock.unlock();
+            Prototypes prototypes;
+            try
+            {
+                create(prototypes);
+            }
+            catch (...)
+            {
+                lock.lock();
+                entryIt->second.prototypes = prototypes;
+                DestroyEntry(entryIt->second);
+                mEntries.erase(entryIt);
+                if (true == mEntries.empty())
+                {
+                    DestroyMarkers();
+                }
+                mEntryCreated.notify_all();
+                throw;
+            }
+            lock.lock();
+
+            Entry & entry = entryIt->second;
+            if (true == prototypes.materials.empty())
+            {
+                mEntries.erase(entryIt);
+                if (true == mEntries.empty())
+                {
+                    DestroyMarkers();
+                }
+                mEntryCreated.notify_all();
+                OGRE_EXCEPT(Ogre::Exception::ERR_INVALIDPARAMS, "Effect created no materials for " + key, "PostEffectPrototypeRegistry[Acquire]");
+            }
+            entry.prototypes = prototypes;
+            //collect the used programs in order to release them with the entry
+            for (Ogre::Material* material : entry.prototypes.materials)
+            {
+                Ogre::Technique* technique = material->getBestTechnique();
+                for (unsigned short passIdx = 0; (nullptr != technique) && (passIdx < technique->getNumPasses()); ++passIdx)
+                {
+                    const Ogre::Pass* pass = technique->getPass(passIdx);
+                    for (const Ogre::String & program : { pass->getVertexProgramName(), pass->getFragmentProgramName() })
+                    {
+                        if ((false == program.empty()) && (nullptr != mProgramCache) && (true == mProgramCache->AddProgramUser(program)))
+                        {
+                            entry.programs.push_back(program);
+                        }
+                    }
+                }
+            }
+            entry.ready = true;
+            mEntryCreated.notify_all();
+        }
+        ++entryIt->second.references;
+        return entryIt->second.prototypes;
+    }
+    //-------------------------------------------------------
+    void PostEffectPrototypeRegistry::Release(const Ogre::String & key)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto entryIt = mEntries.find(key);
+        if (mEntries.end() == entryIt)
+        {
+            OGRE_EXCEPT(Ogre::Exception::ERR_ITEM_NOT_FOUND, "Prototypes " + key + " are not found", "PostEffectPrototypeRegistry[Release]");
+        }
+        assert(entryIt->second.references > 0);
+        if (0 == --entryIt->second.references)
+        {
+            DestroyEntry(entryIt->second);
+            mEntries.erase(entryIt);
+            if (true == mEntries.empty())
+            {
+                DestroyMarkers();
+            }
+        }
+    }
+    //-------------------------------------------------------
+    size_t PostEffectPrototypeRegistry::GetEntriesNumber() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mEntries.size();
+    }
+    //-------------------------------------------------------
+    size_t PostEffectPrototypeRegistry::GetReferencesNumber(const Ogre::String & key) const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto entryIt = mEntries.find(key);
+        return (mEntries.end() != entryIt) ? entryIt->second.references : 0;
+    }
+
+}//namespace OgreEffect
@@ -0,0 +1,124 @@
+/**
+* @file PostEffectPrototypeRegistry.h
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+#ifndef _POSTEFFECT_PROTOTYPE_REGISTRY_H_
+#define _POSTEFFECT_PROTOTYPE_REGISTRY_H_
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include <OgrePrerequisites.h>
+#include <OgreString.h>
+
+#include "PostEffectPassGraph.h"
+
+namespace OgreEffect
+{
+
+    class PostEffectProgramCache;
+
+    /**
+     * Material prototypes and pass graphs shared by the effect instances with the same type and quality settings
+     * Entries are reference counted; The materials of an entry are destroyed with the last reference and the
+     * programs used only by them are removed from the program cache
+     *
+     * Texture markers are dummy textures referenced by the prototypes; They exist while there are any entries
+     * The registry can be used from several threads. An entry is created outside the lock, so the create function
+     * can acquire prototypes of other keys; Concurrent requests of the same key wait for the creating thread
+     */
+    class PostEffectPrototypeRegistry
+    {
+    public:
+        using MaterialsVector = Ogre::vector<Ogre::Material*>::type;
+
+        struct Prototypes
+        {
+            MaterialsVector materials;
+            PostEffectPassGraph graph;
+        };
+
+        //Fills the prototypes of a new entry
+        using CreateFunction = std::function<void(Prototypes & prototypes)>;
+        //-------------------------------------------------------
+
+    private:
+        struct Entry
+        {
+            Prototypes prototypes;
+            size_t references = 0;
+            Ogre::StringVector programs; ///< programs used by the materials
+            bool ready = false;          ///< the prototypes are created; otherwise the entry is pending
+            std::thread::id creator;     ///< thread running the create function of a pending entry
+        };
+        using EntriesMap = Ogre::map<Ogre::String, Entry>::type;
+        //-------------------------------------------------------
+
+        PostEffectProgramCache* mProgramCache;
+        const Ogre::StringVector mMarkers;
+        bool mMarkersCreated = false;
+
+        EntriesMap mEntries;
+        mutable std::mutex mMutex;
+        //is notified when a pending entry is published or dropped
+        std::condition_variable mEntryCreated;
+        //-------------------------------------------------------
+
+        void CreateMarkers();
+        void DestroyMarkers();
+
+        //Destroy the materials and release the programs of the entry
+        void DestroyEntry(Entry & entry);
+
+        PostEffectPrototypeRegistry(const PostEffectPrototypeRegistry&) = delete;
+        PostEffectPrototypeRegistry(const PostEffectPrototypeRegistry&&) = delete;
+        PostEffectPrototypeRegistry& operator=(const PostEffectPrototypeRegistry&) = delete;
+        PostEffectPrototypeRegistry& operator=(const PostEffectPrototypeRegistry&&) = delete;
+        //-------------------------------------------------------
+
+    public:
+        /**
+         * @param programCache cache of the programs used by the prototypes; can be null
+         * @param markers names of the dummy textures to create before the first prototypes
+         */
+        PostEffectPrototypeRegistry(PostEffectProgramCache* programCache, const Ogre::StringVector & markers);
+
+        /**
+         * Destroys all remaining entries
+         */
+        ~PostEffectPrototypeRegistry();
+
+        /**
+         * Get prototypes by the key, creating them on the first request; Adds a reference to the entry
+         * The returned object is valid until the reference is released
+         * The create function runs without the lock; Requesting the same key from it throws
+         */
+        const Prototypes & Acquire(const Ogre::String & key, const CreateFunction & create);
+
+        /**
+         * Release a reference; The last one destroys the entry
+         */
+        void Release(const Ogre::String & key);
+
+        /**
+         * Number of the existing entries
+         */
+        size_t GetEntriesNumber() const;
+
+        /**
+         * Number of references to the entry; 0 if there is no such entry
+         */
+        size_t GetReferencesNumber(const Ogre::String & key) const;
+    };
+
+}//namespace OgreEffect
+
+#endif //_POSTEFFECT_PROTOTYPE_REGISTRY_H_
@@ -0,0 +1,250 @@
+/**
+* @file PostEffectQualityGovernor.cpp
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+#include "PostEffectQualityGovernor.h"
+
+#include <OgreLogManager.h>
+#include <OgreStringConverter.h>
+
+#include "PostEffectManager.h"
+
+namespace OgreEffect
+{
+
+    PostEffectQualityGovernor::PostEffectQualityGovernor(PostEffectManager* manager, Ogre::Real targetFrameTime, size_t windowSize, const Ogre::String & logName):
+        mManager(manager), mTargetFrameTime(targetFrameTime)
+    {
+        if (nullptr == manager)
+        {
+            OGRE_EXCEPT(Ogre::Exception::ERR_INVALIDPARAMS, "Manager is null", "PostEffectQualityGovernor[PostEffectQualityGovernor]");
+        }
+        if (targetFrameTime <= 0.0f)
+        {
+            OGRE_EXCEPT(Ogre::Exception::ERR_INVALIDPARAMS, "Target frame time should be positive", "PostEffectQualityGovernor[PostEffectQualityGovernor]");
+        }
+        if (0 == windowSize)
+        {
+            OGRE_EXCEPT(Ogre::Exception::ERR_INVALIDPARAMS, "Window size should be positive", "PostEffectQualityGovernor[PostEffectQualityGovernor]");
+        }
+        mFrameTimes.resize(windowSize, 0.0f);
+
+        Ogre::LogManager* logManager = Ogre::LogManager::getSingletonPtr();
+        if (nullptr != logManager)
+        {
+            mLog = logManager->createLog(logName, false, false);
+            mLog->logMessage("PostEffectQualityGovernor: target frame time " + Ogre::StringConverter::toString(mTargetFrameTime * 1000.0f) + " ms, window " + Ogre::StringConverter::toString(windowSize) + " frames");
+        }
+    }
+    //-------------------------------------------------------
+    PostEffectQualityGovernor::~PostEffectQualityGovernor()
+    {
+        Ogre::LogManager* logManager = Ogre::LogManager::getSingletonPtr();
+        if ((nullptr != logManager) && (nullptr != mLog))
+        {
+            logManager->destroyLog(mLog);
+        }
+    }
+    //-------------------------------------------------------
+    void PostEffectQualityGovernor::SetThresholds(Ogre::Real lower, Ogre::Real raise)
+    {
+        if ((lower <= 1.0f) || (raise >= 1.0f) || (raise <= 0.0f))
+        {
+            OGRE_EXCEPT(Ogre::Exception::ERR_INVALIDPARAMS, "Thresholds should satisfy 0 < raise < 1 < lower", "PostEffectQualityGovernor[SetThresholds]");
+        }
+        mLowerThreshold = lower;
+        mRaiseThreshold = raise;
+    }
+    //-------------------------------------------------------
+    void PostEffectQualityGovernor::SetTargetFrameTime(Ogre::Real targetFrameTime)
+    {
+        if (targetFrameTime <= 0.0f)
+        {
+            OGRE_EXCEPT(Ogre::Exception::ERR_INVALIDPARAMS, "Target frame time should be positive", "PostEffectQualityGovernor[SetTargetFrameTime]");
+        }
+        mTargetFrameTime = targetFrameTime;
+        ResetWindow();
+    }
+    //-------------------------------------------------------
+    void PostEffectQualityGovernor::SetEnabled(bool enabled)
+    {
+        if (mEnabled != enabled)
+        {
+            mEnabled = enabled;
+            ResetWindow();
+        }
+    }
+    //-------------------------------------------------------
+    void PostEffectQualityGovernor::ResetWindow()
+    {
+        mFrameTimesNumber = 0;
+        mNextFrameTime = 0;
+        mFrameTimesSum = 0.0f;
+    }
+    //-------------------------------------------------------
+    Ogre::Real PostEffectQualityGovernor::GetAverageFrameTime() const
+    {
+        if (0 == mFrameTimesNumber)
+        {
+            return 0.0f;
+        }
+        return mFrameTimesSum / static_cast<Ogre::Real>(mFrameTimesNumber);
+    }
+    //-------------------------------------------------------
+    void PostEffectQualityGovernor::NotifyFrame(Ogre::Real frameTime)
+    {
+        ++mFramesCounter;
+        if (false == mEnabled)
+        {
+            return;
+        }
+        if ((mLastChangeFrame > 0) && (mFramesCounter == mLastChangeFrame + 1))
+        {
+            //this frame contains rebuilding of the changed chain
+            return;
+        }
+
+        if (mFrameTimesNumber == mFrameTimes.size())
+        {
+            mFrameTimesSum -= mFrameTimes[mNextFrameTime];
+        }
+        else
+        {
+            ++mFrameTimesNumber;
+        }
+        mFrameTimes[mNextFrameTime] = frameTime;
+        mFrameTimesSum += frameTime;
+        mNextFrameTime = (mNextFrameTime + 1) % mFrameTimes.size();
+
+        if (mFrameTimesNumber < mFrameTimes.size())
+        {
+            //decide only on the full window
+            return;
+        }
+
+        const Ogre::Real average = GetAverageFrameTime();
+        bool changed = false;
+        if (average > mTargetFrameTime * mLowerThreshold)
+        {
+            changed = Lower(average);
+        }
+        else if ((average < mTargetFrameTime * mRaiseThreshold) && (mFramesCounter >= mLastChangeFrame + mCooldownFrames))
+        {
+            changed = Raise(average);
+        }
+        if (true == changed)
+        {
+            mLastChangeFrame = mFramesCounter;
+            ResetWindow();
+        }
+    }
+    //-------------------------------------------------------
+    Ogre::Real PostEffectQualityGovernor::EstimateCost(const PostEffect* effect)
+    {
+        //Every target pass is a full screen pass scaled by the internal resolution
+        const Ogre::Real scale = effect->GetQualitySettings(effect->GetQualityTier()).resolutionScale;
+        return static_cast<Ogre::Real>(effect->GetTargetPassesNumber()) * scale * scale;
+    }
+    //-------------------------------------------------------
+    bool PostEffectQualityGovernor::FindLowerTier(const PostEffect* effect, PostEffect::QualityTier & tier)
+    {
+        const PostEffect::QualitySettings current = effect->GetQualitySettings(effect->GetQualityTier());
+        for (int lower = static_cast<int>(effect->GetQualityTier()) - 1; lower >= static_cast<int>(PostEffect::QT_LOW); --lower)
+        {
+            const PostEffect::QualityTier candidate = static_cast<PostEffect::QualityTier>(lower);
+            if (effect->GetQualitySettings(candidate) != current)
+            {
+                tier = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+    //-------------------------------------------------------
+    void PostEffectQualityGovernor::ApplyDecision(PostEffect* effect, const Decision & decision)
+    {
+        mManager->SetEffectQualityTier(effect, decision.to);
+        mDecisions.push_back(decision);
+        if (nullptr != mLog)
+        {
+            mLog->logMessage("PostEffectQualityGovernor: frame " + Ogre::StringConverter::toString(decision.frame) +
+                ", average " + Ogre::StringConverter::toString(decision.averageFrameTime * 1000.0f) + " ms, " +
+                decision.effect + ": tier " + Ogre::StringConverter::toString(static_cast<int>(decision.from)) +
+                " -> " + Ogre::StringConverter::toString(static_cast<int>(decision.to)));
+        }
+    }
+    //-------------------------------------------------------
+    bool PostEffectQualityGovernor::Lower(Ogre::Real average)
+    {
+        PostEffect* selected = nullptr;
+        PostEffect::QualityTier selectedTier = PostEffect::QT_LOW;
+        Ogre::Real selectedCost = 0.0f;
+        for (PostEffect* effect : mManager->GetPostEffects())
+        {
+            PostEffect::QualityTier tier;
+            if ((false == effect->IsEnabled()) || (false == FindLowerTier(effect, tier)))
+            {
+                continue;
+            }
+            const Ogre::Real cost = EstimateCost(effect);
+            if ((nullptr == selected) || (cost > selectedCost))
+            {
+                selected = effect;
+                selectedTier = tier;
+                selectedCost = cost;
+            }
+        }
+        if (nullptr == selected)
+        {
+            return false;
+        }
+        Decision decision;
+        decision.frame = mFramesCounter;
+        decision.averageFrameTime = average;
+        decision.effect = selected->GetName();
+        decision.from = selected->GetQualityTier();
+        decision.to = selectedTier;
+        ApplyDecision(selected, decision);
+        mLoweredStack.push_back(decision);
+        return true;
+    }
+    //-------------------------------------------------------
+    bool PostEffectQualityGovernor::Raise(Ogre::Real average)
+    {
+        PostEffect* selected = nullptr;
+        Decision lowered;
+        while ((nullptr == selected) && (false == mLoweredStack.empty()))
+        {
+            lowered = mLoweredStack.back();
+            mLoweredStack.pop_back();
+            //skip removed effects and the ones changed by the application; Names of the instances are unique
+            for (PostEffect* effect : mManager->GetPostEffects())
+            {
+                if ((effect->GetName() == lowered.effect) && (effect->GetQualityTier() == lowered.to))
+                {
+                    selected = effect;
+                    break;
+                }
+            }
+        }
+        if (nullptr == selected)
+        {
+            return false;
+        }
+        Decision decision;
+        decision.frame = mFramesCounter;
+        decision.averageFrameTime = average;
+        decision.effect = lowered.effect;
+        decision.from = lowered.to;
+        decision.to = lowered.from;
+        ApplyDecision(selected, decision);
+        return true;
+    }
+
+}//namespace OgreEffect
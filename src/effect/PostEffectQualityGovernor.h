@@ -0,0 +1,168 @@
+/**
+* @file PostEffectQualityGovernor.h
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+#ifndef _POSTEFFECT_QUALITY_GOVERNOR_H_
+#define _POSTEFFECT_QUALITY_GOVERNOR_H_
+
+#include <OgrePrerequisites.h>
+
+#include "PostEffect.h"
+
+namespace OgreEffect
+{
+
+    class PostEffectManager;
+
+    /**
+     * Adaptive quality controller
+     * Collects frame times in a rolling window and changes quality tiers of the effects to hold the frame budget
+     * If the average frame time exceeds the budget the most expensive enabled effect is lowered by one step;
+     * If there is enough headroom the last lowered effect is raised back
+     *
+     * Lowering and raising use different thresholds and raising is allowed only after a cooldown,
+     * so the governor doesn't oscillate around the budget
+     * Every decision is written to a separate log
+     */
+    class PostEffectQualityGovernor
+    {
+    public:
+        struct Decision
+        {
+            size_t frame;                  ///< index of the frame when the decision was made
+            Ogre::Real averageFrameTime;   ///< average over the window, in seconds
+            Ogre::String effect;           ///< name of the changed effect
+            PostEffect::QualityTier from;
+            PostEffect::QualityTier to;
+        };
+        using DecisionsVector = Ogre::vector<Decision>::type;
+        //-------------------------------------------------------
+
+    private:
+        PostEffectManager* mManager;
+        Ogre::Real mTargetFrameTime;
+        bool mEnabled = true;
+
+        Ogre::Real mLowerThreshold = 1.1f;  ///< lower quality if the average is above target * threshold
+        Ogre::Real mRaiseThreshold = 0.8f;  ///< raise quality if the average is below target * threshold
+        size_t mCooldownFrames = 120;       ///< frames after any change before quality can be raised
+
+        //Ring buffer of the last frame times
+        Ogre::vector<Ogre::Real>::type mFrameTimes;
+        size_t mFrameTimesNumber = 0;
+        size_t mNextFrameTime = 0;
+        Ogre::Real mFrameTimesSum = 0.0f;
+
+        size_t mFramesCounter = 0;
+        size_t mLastChangeFrame = 0;
+
+        //Lowering decisions which were not reverted yet; The last one is reverted first
+        DecisionsVector mLoweredStack;
+        DecisionsVector mDecisions;
+
+        Ogre::Log* mLog = nullptr;
+        //-------------------------------------------------------
+
+        //Returns false if there are no effects to lower
+        bool Lower(Ogre::Real average);
+        //Returns false if nothing was lowered
+        bool Raise(Ogre::Real average);
+
+        //Relative cost of the effect with the current settings
+        static Ogre::Real EstimateCost(const PostEffect* effect);
+
+        //Find the nearest lower tier with different settings; Returns false if there is no such tier
+        static bool FindLowerTier(const PostEffect* effect, PostEffect::QualityTier & tier);
+
+        void ApplyDecision(PostEffect* effect, const Decision & decision);
+
+        void ResetWindow();
+
+        PostEffectQualityGovernor(const PostEffectQualityGovernor&) = delete;
+        PostEffectQualityGovernor(const PostEffectQualityGovernor&&) = delete;
+        PostEffectQualityGovernor& operator=(const PostEffectQualityGovernor&) = delete;
+        PostEffectQualityGovernor& operator=(const PostEffectQualityGovernor&&) = delete;
+        //-------------------------------------------------------
+
+    public:
+        /**
+         * @param manager manager owning the controlled effects
+         * @param targetFrameTime frame budget in seconds
+         * @param windowSize number of frames to average
+         * @param logName name of the log receiving the decisions
+         */
+        PostEffectQualityGovernor(PostEffectManager* manager, Ogre::Real targetFrameTime, size_t windowSize = 60, const Ogre::String & logName = "PostEffectGovernor.log");
+
+        ~PostEffectQualityGovernor();
+
+        /**
+         * Should be called once per frame
+         * @param frameTime duration of the last frame in seconds
+         */
+        void NotifyFrame(Ogre::Real frameTime);
+
+        /**
+         * Set thresholds relative to the target frame time
+         * @param lower quality is lowered if the average frame time is above target * lower; Should be greater than 1
+         * @param raise quality is raised if the average frame time is below target * raise; Should be less than 1
+         */
+        void SetThresholds(Ogre::Real lower, Ogre::Real raise);
+
+        void SetCooldownFrames(size_t frames)
+        {
+            mCooldownFrames = frames;
+        }
+
+        void SetTargetFrameTime(Ogre::Real targetFrameTime);
+
+        Ogre::Real GetTargetFrameTime() const
+        {
+            return mTargetFrameTime;
+        }
+
+        /**
+         * Disabled governor ignores frames and keeps the current tiers
+         */
+        void SetEnabled(bool enabled);
+
+        bool IsEnabled() const
+        {
+            return mEnabled;
+        }
+
+        /**
+         * Average frame time over the collected part of the window; 0 if no frames were collected
+         */
+        Ogre::Real GetAverageFrameTime() const;
+
+        /**
+         * All decisions made since the creation
+         */
+        const DecisionsVector & GetDecisions() const
+        {
+            return mDecisions;
+        }
+
+        /**
+         * Number of lowering decisions which were not reverted yet
+         */
+        size_t GetLoweredNumber() const
+        {
+            return mLoweredStack.size();
+        }
+
+        size_t GetFramesNumber() const
+        {
+            return mFramesCounter;
+        }
+    };
+
+}//namespace OgreEffect
+
+#endif //_POSTEFFECT_QUALITY_GOVERNOR_H_
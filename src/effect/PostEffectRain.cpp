@@ -19,12 +19,12 @@
 #include <OgreSceneNode.h>
 #include <OgreCamera.h>
 #include <OgreTextureManager.h>
+#include <OgreImage.h>
 
 #include <OgreMaterial.h>
 #include <OgreTechnique.h>
 #include <OgrePass.h>
 #include <OgreHighLevelGpuProgram.h>
-#include <OgreHighLevelGpuProgramManager.h>
 
 #include <OgreParticleSystem.h>
 #include <OgreParticleSystemManager.h>
@@ -69,6 +69,11 @@ namespace OgreEffect
 
     class PostEffectRain : public PostEffectComplex
     {
+    private:
+        //Decoded drop image; Can be loaded on a worker thread
+        Ogre::Image mRainDropImage;
+        Ogre::String mRainDropMaterialName;
+
     public:
         PostEffectRain(const Ogre::String & name, size_t id) :
             PostEffectComplex(name, id)
@@ -86,13 +91,17 @@ namespace OgreEffect
             Ogre::TexturePtr rainDropTexture = Ogre::TextureManager::getSingleton().getByName("Texture/EffectRain/RainDrop");
             if (nullptr == rainDropTexture.get())
             {
-                //load image
-                Ogre::Image rainDropImage;
-                rainDropImage.load("drop.tga", Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+                //load image if it was not loaded in background
+                if (nullptr == mRainDropImage.getData())
+                {
+                    mRainDropImage.load("drop.tga", Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+                }
                 rainDropTexture = Ogre::TextureManager::getSingleton().loadImage("Texture/EffectRain/RainDrop",
-                    Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, rainDropImage, 
+                    Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, mRainDropImage, 
                     Ogre::TextureType::TEX_TYPE_2D, 4, 1.0f, true, Ogre::PF_A8);
             }
+            //the texture keeps its own copy
+            mRainDropImage.freeMemory();
 
             Ogre::MaterialPtr material = Ogre::MaterialManager::getSingleton().create(
                 name, Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
@@ -102,17 +111,13 @@ namespace OgreEffect
                 Ogre::Pass* pass = techniqueGL->getPass(0);
 
                 {
-                    auto vprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/V/Trans/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_VERTEX_PROGRAM);
-                    vprogram->setSource(Shader_GL_Trans_V);
+                    auto vprogram = AcquireProgram(Ogre::GPT_VERTEX_PROGRAM, Shader_GL_Trans_V);
 
                     pass->setVertexProgram(vprogram->getName());
                 }
 
                 {
-                    auto fprogram = Ogre::HighLevelGpuProgramManager::getSingleton().createProgram("Shader/GL/F/Trans/" + GetUniquePostfix(),
-                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, "glsl", Ogre::GPT_FRAGMENT_PROGRAM);
-                    fprogram->setSource(Shader_GL_Trans_F);
+                    auto fprogram = AcquireProgram(Ogre::GPT_FRAGMENT_PROGRAM, Shader_GL_Trans_F);
 
                     pass->setFragmentProgram(fprogram->getName());
 
@@ -127,9 +132,26 @@ namespace OgreEffect
             return material;
         }
 
+        virtual void DoPrepareBackground() override
+        {
+            //reading and decoding the file doesn't need the render system
+            mRainDropImage.load("drop.tga", Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+        }
+
+        virtual void DoRelease() override
+        {
+            PostEffectComplex::DoRelease();
+            if (false == mRainDropMaterialName.empty())
+            {
+                Ogre::MaterialManager::getSingleton().remove(mRainDropMaterialName);
+                mRainDropMaterialName.clear();
+            }
+        }
+
         virtual void DoSetupScene() override
         {
-            Ogre::MaterialPtr transMat = CreateRainDropMaterial("Material/RainDrop/" + GetUniquePostfix());
+            mRainDropMaterialName = "Material/RainDrop/" + GetUniquePostfix();
+            Ogre::MaterialPtr transMat = CreateRainDropMaterial(mRainDropMaterialName);
 
             mSceneManager->setAmbientLight(Ogre::ColourValue(0.5, 0.5, 0.5));
 
@@ -0,0 +1,252 @@
+/**
+* @file PostEffectScenePyramid.cpp
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+#include <assert.h>
+
+#include "PostEffectScenePyramid.h"
+#include "PostEffectProgramCache.h"
+
+#include <OgreRoot.h>
+#include <OgreCompositorManager.h>
+#include <OgreCompositorChain.h>
+#include <OgreCompositionTechnique.h>
+#include <OgreCompositionTargetPass.h>
+#include <OgreCompositionPass.h>
+#include <OgreMaterialManager.h>
+#include <OgreTechnique.h>
+#include <OgrePass.h>
+#include <OgreStringConverter.h>
+
+namespace
+{
+
+    static const char Shader_GL_Common_V[] = ""
+        "#version 120                                                              \n"
+        "                                                                          \n"
+        "                                                                          \n"
+        "void main()                                                               \n"
+        "{                                                                         \n"
+        "    gl_TexCoord[0] = gl_MultiTexCoord0;                                   \n"
+        "    gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;               \n"
+        "}                                                                         \n"
+        "";
+
+    //13 bilinear taps downsampling of the previous level; The texel size of the source is an auto constant,
+    //so one material serves all levels and chains
+    static const char Shader_GL_Downsample_F[] = ""
+        "#version 120                                                                                       \n"
+        "                                                                                                   \n"
+        "uniform sampler2D texture;                                                                         \n"
+        "uniform vec4 texelSize;  //inverse size of the source level                                        \n"
+        "                                                                                                   \n"
+        "vec4 tap(vec2 coords, float x, float y)                                                            \n"
+        "{                                                                                                  \n"
+        "    return texture2D(texture, coords + texelSize.xy * vec2(x, y));                                 \n"
+        "}                                                                                                  \n"
+        "                                                                                                   \n"
+        "void main()                                                                                        \n"
+        "{                                                                                                  \n"
+        "    vec2 coords = gl_TexCoord[0].st;                                                               \n"
+        "    vec4 inner   = tap(coords, -1.0, -1.0) + tap(coords,  1.0, -1.0) +                             \n"
+        "                   tap(coords, -1.0,  1.0) + tap(coords,  1.0,  1.0);                              \n"
+        "    vec4 corners = tap(coords, -2.0, -2.0) + tap(coords,  2.0, -2.0) +                             \n"
+        "                   tap(coords, -2.0,  2.0) + tap(coords,  2.0,  2.0);                              \n"
+        "    vec4 sides   = tap(coords,  0.0, -2.0) + tap(coords, -2.0,  0.0) +                             \n"
+        "                   tap(coords,  2.0,  0.0) + tap(coords,  0.0,  2.0);                              \n"
+        "    gl_FragColor = 0.125 * (inner + tap(coords, 0.0, 0.0)) + 0.03125 * corners + 0.0625 * sides;   \n"
+        "}                                                                                                  \n"
+        "";
+
+    static const char Shader_GL_Copy_F[] = ""
+        "#version 120                                                              \n"
+        "                                                                          \n"
+        "uniform sampler2D texture;                                                \n"
+        "                                                                          \n"
+        "void main()                                                               \n"
+        "{                                                                         \n"
+        "    gl_FragColor = texture2D(texture, gl_TexCoord[0].st);                 \n"
+        "}                                                                         \n"
+        "";
+
+    static const char SCENE_TEXTURE_NAME[] = "Scene";
+}
+
+namespace OgreEffect
+{
+
+    const Ogre::String PostEffectScenePyramid::COMPOSITOR_NAME = "PostEffect/ScenePyramid";
+    const size_t PostEffectScenePyramid::LEVELS_NUMBER;
+
+    //-------------------------------------------------------
+    Ogre::String PostEffectScenePyramid::GetLevelName(size_t level)
+    {
+        return "Level/" + Ogre::StringConverter::toString(level);
+    }
+    //-------------------------------------------------------
+    PostEffectScenePyramid::PostEffectScenePyramid(PostEffectProgramCache* programCache) :
+        mProgramCache(programCache)
+    {
+        assert(nullptr != programCache);
+    }
+    //-------------------------------------------------------
+    PostEffectScenePyramid::~PostEffectScenePyramid()
+    {
+        if (nullptr != Ogre::Root::getSingletonPtr())
+        {
+            Release();
+        }
+    }
+    //-------------------------------------------------------
+    Ogre::MaterialPtr PostEffectScenePyramid::CreateMaterial(const Ogre::String & passName, const char* fragmentSource, Ogre::TextureFilterOptions filtering)
+    {
+        Ogre::MaterialPtr material = Ogre::MaterialManager::getSingleton().create("Material/" + COMPOSITOR_NAME + "/" + passName,
+            Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+        Ogre::Pass* pass = material->getTechnique(0)->getPass(0);
+        auto vprogram = mProgramCache->Acquire("glsl", Ogre::GPT_VERTEX_PROGRAM, Shader_GL_Common_V);
+        auto fprogram = mProgramCache->Acquire("glsl", Ogre::GPT_FRAGMENT_PROGRAM, fragmentSource);
+        pass->setVertexProgram(vprogram->getName());
+
+        auto unit = pass->createTextureUnitState();
+        unit->setTextureAddressingMode(Ogre::TextureUnitState::TAM_CLAMP);
+        unit->setTextureFiltering(filtering);
+
+        pass->setFragmentProgram(fprogram->getName());
+        auto fparams = pass->getFragmentProgramParameters();
+        fparams->setNamedConstant("texture", 0);
+
+        //keep the programs alive as long as the materials
+        for (const Ogre::String & program : { vprogram->getName(), fprogram->getName() })
+        {
+            if (true == mProgramCache->AddProgramUser(program))
+            {
+                mPrograms.push_back(program);
+            }
+        }
+        return material;
+    }
+    //-------------------------------------------------------
+    void PostEffectScenePyramid::CreateCompositor()
+    {
+        //the taps fetch between texels
+        mMaterial = CreateMaterial("Downsample", Shader_GL_Downsample_F, Ogre::TFO_BILINEAR);
+        mMaterial->getTechnique(0)->getPass(0)->getFragmentProgramParameters()->setNamedAutoConstant("texelSize",
+            Ogre::GpuProgramParameters::ACT_INVERSE_TEXTURE_SIZE, 0);
+        mCopyMaterial = CreateMaterial("Copy", Shader_GL_Copy_F, Ogre::TFO_NONE);
+
+        mCompositor = Ogre::CompositorManager::getSingleton().create(COMPOSITOR_NAME,
+            Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+        Ogre::CompositionTechnique* technique = mCompositor->createTechnique();
+        {
+            //local copy of the input; the previous output is produced only once, here
+            Ogre::CompositionTechnique::TextureDefinition* def = technique->createTextureDefinition(SCENE_TEXTURE_NAME);
+            def->width = 0;
+            def->height = 0;
+            def->widthFactor = 1.0f;
+            def->heightFactor = 1.0f;
+            def->formatList.push_back(Ogre::PF_R8G8B8A8);
+
+            Ogre::CompositionTargetPass* target = technique->createTargetPass();
+            target->setInputMode(Ogre::CompositionTargetPass::IM_PREVIOUS);
+            target->setOutputName(SCENE_TEXTURE_NAME);
+        }
+        Ogre::String source = SCENE_TEXTURE_NAME;
+        Ogre::Real factor = 1.0f;
+        for (size_t level = 0; level < LEVELS_NUMBER; ++level)
+        {
+            factor *= 0.5f;
+            const Ogre::String name = GetLevelName(level);
+            Ogre::CompositionTechnique::TextureDefinition* def = technique->createTextureDefinition(name);
+            if (nullptr == def)
+            {
+                OGRE_EXCEPT(Ogre::Exception::ERR_INTERNAL_ERROR, "Failed to create texture definition", "PostEffectScenePyramid[CreateCompositor]");
+            }
+            //chain scope textures can be referenced by all compositors placed after the pyramid
+            def->scope = Ogre::CompositionTechnique::TS_CHAIN;
+            def->width = 0;
+            def->height = 0;
+            def->widthFactor = factor;
+            def->heightFactor = factor;
+            def->formatList.push_back(Ogre::PF_R8G8B8A8);
+
+            Ogre::CompositionTargetPass* target = technique->createTargetPass();
+            target->setInputMode(Ogre::CompositionTargetPass::IM_NONE);
+            target->setOutputName(name);
+            Ogre::CompositionPass* pass = target->createPass();
+            pass->setMaterial(mMaterial);
+            pass->setInput(0, source);
+            source = name;
+        }
+        //Pass the input to the next compositor by copying the local texture; IM_PREVIOUS would render the previous
+        //output once more, i.e. the scene if the pyramid is the first in the chain
+        {
+            Ogre::CompositionTargetPass* output = technique->getOutputTargetPass();
+            output->setInputMode(Ogre::CompositionTargetPass::IM_NONE);
+            Ogre::CompositionPass* pass = output->createPass();
+            pass->setMaterial(mCopyMaterial);
+            pass->setInput(0, SCENE_TEXTURE_NAME);
+        }
+    }
+    //-------------------------------------------------------
+    Ogre::CompositorInstance* PostEffectScenePyramid::Attach(Ogre::CompositorChain* chain, size_t position)
+    {
+        assert(nullptr != chain);
+        if (true == mCompositor.isNull())
+        {
+            CreateCompositor();
+        }
+        Ogre::CompositorInstance* instance = chain->addCompositor(mCompositor, position);
+        if (nullptr == instance)
+        {
+            OGRE_EXCEPT(Ogre::Exception::ERR_INTERNAL_ERROR, "Compositor is not supported", "PostEffectScenePyramid[Attach]");
+        }
+        ++mInstancesNumber;
+        return instance;
+    }
+    //-------------------------------------------------------
+    void PostEffectScenePyramid::Detach(Ogre::CompositorInstance* instance)
+    {
+        assert(nullptr != instance);
+        Ogre::CompositorChain* chain = instance->getChain();
+        for (size_t idx = 0; idx < chain->getNumCompositors(); ++idx)
+        {
+            if (chain->getCompositor(idx) == instance)
+            {
+                chain->removeCompositor(idx);
+                assert(mInstancesNumber > 0);
+                --mInstancesNumber;
+                break;
+            }
+        }
+    }
+    //-------------------------------------------------------
+    void PostEffectScenePyramid::Release()
+    {
+        assert(0 == mInstancesNumber);
+        if (false == mCompositor.isNull())
+        {
+            Ogre::CompositorManager::getSingleton().remove(mCompositor->getName());
+            mCompositor.setNull();
+        }
+        for (Ogre::MaterialPtr* material : { &mMaterial, &mCopyMaterial })
+        {
+            if (false == material->isNull())
+            {
+                Ogre::MaterialManager::getSingleton().remove((*material)->getName());
+                material->setNull();
+            }
+        }
+        for (const Ogre::String & program : mPrograms)
+        {
+            mProgramCache->RemoveProgramUser(program);
+        }
+        mPrograms.clear();
+    }
+
+}//namespace OgreEffect
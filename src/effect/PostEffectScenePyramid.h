@@ -0,0 +1,111 @@
+/**
+* @file PostEffectScenePyramid.h
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+#ifndef _POSTEFFECT_SCENE_PYRAMID_H_
+#define _POSTEFFECT_SCENE_PYRAMID_H_
+
+#include <OgrePrerequisites.h>
+#include <OgreCompositor.h>
+#include <OgreMaterial.h>
+
+namespace Ogre
+{
+    class CompositorChain;
+    class CompositorInstance;
+}
+
+namespace OgreEffect
+{
+
+    class PostEffectProgramCache;
+
+    /**
+     * Downsampled copies of the scene shared by the effects of a chain
+     * The pyramid compositor is placed before the first effect reading the levels; it renders the input
+     * scene into chain scope textures of 1/2, 1/4 and 1/8 of the target size and copies the input to its output
+     * Effects read the levels through the PostEffectPassGraph::GetPyramidResource() inputs, which are turned
+     * into references to the compositor's textures. The levels keep the scene colour as is, so every effect
+     * applies its own threshold at the level it reads
+     *
+     * One compositor is shared by all chains; each chain gets its own instance with its own textures
+     */
+    class PostEffectScenePyramid
+    {
+    public:
+        static const Ogre::String COMPOSITOR_NAME;
+        static const size_t LEVELS_NUMBER = 3;
+
+        /**
+         * Name of the chain scope texture of the level
+         */
+        static Ogre::String GetLevelName(size_t level);
+        //-------------------------------------------------------
+
+    private:
+        PostEffectProgramCache* const mProgramCache;
+
+        Ogre::CompositorPtr mCompositor;
+        Ogre::MaterialPtr mMaterial;
+        Ogre::MaterialPtr mCopyMaterial;    ///< copies the local scene texture to the output
+        Ogre::vector<Ogre::String>::type mPrograms; ///< programs of the material counted as its users
+        size_t mInstancesNumber = 0;
+        //-------------------------------------------------------
+
+        //Full screen material reading the texture unit 0
+        Ogre::MaterialPtr CreateMaterial(const Ogre::String & passName, const char* fragmentSource, Ogre::TextureFilterOptions filtering);
+
+        //Create the materials and the compositor
+        void CreateCompositor();
+
+        PostEffectScenePyramid(const PostEffectScenePyramid&) = delete;
+        PostEffectScenePyramid(const PostEffectScenePyramid&&) = delete;
+        PostEffectScenePyramid& operator=(const PostEffectScenePyramid&) = delete;
+        PostEffectScenePyramid& operator=(const PostEffectScenePyramid&&) = delete;
+        //-------------------------------------------------------
+
+    public:
+        /**
+         * @param programCache cache of the downsampling program; Should outlive the pyramid
+         */
+        explicit PostEffectScenePyramid(PostEffectProgramCache* programCache);
+
+        ~PostEffectScenePyramid();
+
+        /**
+         * Add the pyramid compositor to the chain
+         * The compositor is created on the first call
+         * @param position index of the first compositor reading the levels
+         * @return the chain's instance; it should be enabled while any effect reading the levels is enabled
+         */
+        Ogre::CompositorInstance* Attach(Ogre::CompositorChain* chain, size_t position);
+
+        /**
+         * Remove the pyramid instance from its chain
+         */
+        void Detach(Ogre::CompositorInstance* instance);
+
+        /**
+         * Destroy the compositor and the material
+         * All instances should be detached already
+         */
+        void Release();
+
+        /**
+         * Number of the chains having the pyramid attached
+         */
+        size_t GetInstancesNumber() const
+        {
+            return mInstancesNumber;
+        }
+    };
+
+}//namespace OgreEffect
+
+#endif //_POSTEFFECT_SCENE_PYRAMID_H_
@@ -0,0 +1,325 @@
+/**
+* @file PostEffectTexturePool.cpp
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+#include <assert.h>
+#include <algorithm>
+#include <numeric>
+#include <iterator>
+
+#include "PostEffectTexturePool.h"
+#include "PostEffect.h"
+
+#include <OgreRoot.h>
+#include <OgreCompositorManager.h>
+#include <OgreCompositorChain.h>
+#include <OgreCompositionTechnique.h>
+#include <OgreCompositionTargetPass.h>
+#include <OgrePixelFormat.h>
+#include <OgreStringConverter.h>
+
+namespace OgreEffect
+{
+
+    size_t PostEffectTexturePool::GetTextureSize(size_t width, size_t height, Ogre::PixelFormat format)
+    {
+        return Ogre::PixelUtil::getMemorySize(static_cast<Ogre::uint32>(width), static_cast<Ogre::uint32>(height), 1, format);
+    }
+    //-------------------------------------------------------
+    size_t PostEffectTexturePool::GetTextureSize(size_t width, size_t height, Ogre::Real widthFactor, Ogre::Real heightFactor, Ogre::PixelFormat format) const
+    {
+        if ((0 == width) || (0 == height))
+        {
+            width = static_cast<size_t>(mTargetWidth * widthFactor + 0.5f);
+            height = static_cast<size_t>(mTargetHeight * heightFactor + 0.5f);
+        }
+        return GetTextureSize(width, height, format);
+    }
+    //-------------------------------------------------------
+    bool PostEffectTexturePool::Intersect(const PassesVector & lhs, const PassesVector & rhs)
+    {
+        auto lhsIt = lhs.cbegin();
+        auto rhsIt = rhs.cbegin();
+        while ((lhsIt != lhs.cend()) && (rhsIt != rhs.cend()))
+        {
+            if (*lhsIt == *rhsIt)
+            {
+                return true;
+            }
+            if (*lhsIt < *rhsIt)
+            {
+                ++lhsIt;
+            }
+            else
+            {
+                ++rhsIt;
+            }
+        }
+        return false;
+    }
+    //-------------------------------------------------------
+    PostEffectTexturePool::PostEffectTexturePool(const Ogre::String & name, bool zeroCopyInput) :
+        mName(name), mZeroCopyInput(zeroCopyInput)
+    {
+        assert(false == name.empty());
+    }
+    //-------------------------------------------------------
+    PostEffectTexturePool::~PostEffectTexturePool()
+    {
+        if (nullptr != Ogre::Root::getSingletonPtr())
+        {
+            Detach();
+        }
+    }
+    //-------------------------------------------------------
+    void PostEffectTexturePool::AddEffect(PostEffect* effect)
+    {
+        assert(nullptr != effect);
+        Ogre::CompositionTechnique* technique = effect->GetCompositionTechnique();
+        if (nullptr == technique)
+        {
+            OGRE_EXCEPT(Ogre::Exception::ERR_INVALID_STATE, "The effect compositor was not built", "PostEffectTexturePool[AddEffect]");
+        }
+        if (false == mCompositor.isNull())
+        {
+            OGRE_EXCEPT(Ogre::Exception::ERR_INVALID_STATE, "The pool was allocated already", "PostEffectTexturePool[AddEffect]");
+        }
+
+        for (const auto & entry : effect->GetTextureLifetimes())
+        {
+            Ogre::CompositionTechnique::TextureDefinition* def = technique->getTextureDefinition(entry.first);
+            //only simple textures can be aliased
+            if ((nullptr == def) || (false == def->refCompName.empty()) || (1 != def->formatList.size()))
+            {
+                continue;
+            }
+            Request request;
+            request.effect = effect;
+            request.name = entry.first;
+            request.width = def->width;
+            request.height = def->height;
+            //factors are used by the compositor only if the size is 0
+            bool relative = (0 == def->width) || (0 == def->height);
+            request.widthFactor = relative ? def->widthFactor : 0.0f;
+            request.heightFactor = relative ? def->heightFactor : 0.0f;
+            request.format = def->formatList.front();
+            request.slot = 0;
+            if (0 == entry.second.firstPass)
+            {
+                //The first target pass receives output of the closest enabled effect before this one
+                //Any previous effect can be disabled, so the texture is written by the output pass of any of them
+                if (true == mZeroCopyInput)
+                {
+                    //The input is alive only since the writing pass; 
+                    //it can share memory with the textures which are not used by the previous effects' output passes
+                    request.passes = mOutputPasses;
+                }
+                else
+                {
+                    //Consider the input alive from the beginning of the chain
+                    for (size_t passIdx = 0; passIdx < mPassesCounter; ++passIdx)
+                    {
+                        request.passes.push_back(passIdx);
+                    }
+                }
+            }
+            for (size_t passIdx = entry.second.firstPass; passIdx <= entry.second.lastPass; ++passIdx)
+            {
+                request.passes.push_back(mPassesCounter + passIdx);
+            }
+            mRequests.push_back(request);
+        }
+        if (true == effect->IsSceneCopyRequired())
+        {
+            ++mSceneCopiesCounter;
+        }
+        mPassesCounter += effect->GetTargetPassesNumber();
+        mOutputPasses.push_back(mPassesCounter - 1);
+    }
+    //-------------------------------------------------------
+    void PostEffectTexturePool::AssignSlots()
+    {
+        Ogre::vector<size_t>::type order(mRequests.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [this](size_t lhs, size_t rhs) { return mRequests[lhs].passes.front() < mRequests[rhs].passes.front(); });
+
+        for (size_t requestIdx : order)
+        {
+            Request & request = mRequests[requestIdx];
+            auto slotIt = std::find_if(mSlots.begin(), mSlots.end(), [&request](const Slot & slot)
+            {
+                //a texture can't be read and written in the same pass, so the lifetimes should not touch
+                return (slot.width == request.width) && (slot.height == request.height) && (slot.widthFactor == request.widthFactor) && (slot.heightFactor == request.heightFactor) &&
+                    (slot.format == request.format) && (false == Intersect(slot.passes, request.passes));
+            });
+            if (slotIt == mSlots.end())
+            {
+                Slot slot;
+                slot.name = "Texture/Pool/" + mName + "/" + Ogre::StringConverter::toString(mSlots.size());
+                slot.width = request.width;
+                slot.height = request.height;
+                slot.widthFactor = request.widthFactor;
+                slot.heightFactor = request.heightFactor;
+                slot.format = request.format;
+                mSlots.push_back(slot);
+                slotIt = mSlots.end() - 1;
+            }
+            PassesVector passes;
+            std::set_union(slotIt->passes.cbegin(), slotIt->passes.cend(), request.passes.cbegin(), request.passes.cend(), std::back_inserter(passes));
+            slotIt->passes.swap(passes);
+            request.slot = static_cast<size_t>(slotIt - mSlots.begin());
+        }
+    }
+    //-------------------------------------------------------
+    void PostEffectTexturePool::ComputeReport()
+    {
+        mReport = MemoryReport();
+        mReport.texturesNumber = mRequests.size();
+        mReport.slotsNumber = mSlots.size();
+        mReport.sceneCopiesNumber = mSceneCopiesCounter;
+        for (const Request & request : mRequests)
+        {
+            mReport.naiveBytes += GetTextureSize(request.width, request.height, request.widthFactor, request.heightFactor, request.format);
+        }
+        for (const Slot & slot : mSlots)
+        {
+            mReport.pooledBytes += GetTextureSize(slot.width, slot.height, slot.widthFactor, slot.heightFactor, slot.format);
+        }
+        for (size_t passIdx = 0; passIdx < mPassesCounter; ++passIdx)
+        {
+            size_t aliveBytes = 0;
+            for (const Request & request : mRequests)
+            {
+                if (true == std::binary_search(request.passes.cbegin(), request.passes.cend(), passIdx))
+                {
+                    aliveBytes += GetTextureSize(request.width, request.height, request.widthFactor, request.heightFactor, request.format);
+                }
+            }
+            mReport.peakBytes = std::max(mReport.peakBytes, aliveBytes);
+        }
+    }
+    //-------------------------------------------------------
+    void PostEffectTexturePool::CreatePoolCompositor()
+    {
+        mCompositor = Ogre::CompositorManager::getSingleton().create("Compositor/" + mName,
+            Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+        Ogre::CompositionTechnique* technique = mCompositor->createTechnique();
+        for (const Slot & slot : mSlots)
+        {
+            Ogre::CompositionTechnique::TextureDefinition* def = technique->createTextureDefinition(slot.name);
+            if (nullptr == def)
+            {
+                OGRE_EXCEPT(Ogre::Exception::ERR_INTERNAL_ERROR, "Failed to create texture definition", "PostEffectTexturePool[CreatePoolCompositor]");
+            }
+            //chain scope textures can be referenced by all compositors placed after the pool
+            def->scope = Ogre::CompositionTechnique::TS_CHAIN;
+            def->width = slot.width;
+            def->height = slot.height;
+            def->widthFactor = slot.widthFactor;
+            def->heightFactor = slot.heightFactor;
+            def->formatList.push_back(slot.format);
+        }
+        //pass the previous output through without any rendering
+        technique->getOutputTargetPass()->setInputMode(Ogre::CompositionTargetPass::IM_PREVIOUS);
+
+        //Redirect effects' textures to the pool
+        for (const Request & request : mRequests)
+        {
+            Ogre::CompositionTechnique::TextureDefinition* def = request.effect->GetCompositionTechnique()->getTextureDefinition(request.name);
+            assert(nullptr != def);
+            def->refCompName = mCompositor->getName();
+            def->refTexName = mSlots[request.slot].name;
+            def->scope = Ogre::CompositionTechnique::TS_LOCAL;
+        }
+    }
+    //-------------------------------------------------------
+    void PostEffectTexturePool::Allocate(size_t targetWidth, size_t targetHeight)
+    {
+        if (false == mCompositor.isNull())
+        {
+            OGRE_EXCEPT(Ogre::Exception::ERR_INVALID_STATE, "The pool was allocated already", "PostEffectTexturePool[Allocate]");
+        }
+        mTargetWidth = targetWidth;
+        mTargetHeight = targetHeight;
+        AssignSlots();
+        ComputeReport();
+        if (false == mSlots.empty())
+        {
+            CreatePoolCompositor();
+        }
+    }
+    //-------------------------------------------------------
+    void PostEffectTexturePool::NotifyResized(size_t targetWidth, size_t targetHeight)
+    {
+        mTargetWidth = targetWidth;
+        mTargetHeight = targetHeight;
+        ComputeReport();
+    }
+    //-------------------------------------------------------
+    void PostEffectTexturePool::Attach(Ogre::CompositorChain* chain)
+    {
+        assert(nullptr != chain);
+        if (true == mCompositor.isNull())
+        {
+            //nothing to share
+            return;
+        }
+        mCompositorInstance = chain->addCompositor(mCompositor, 0);
+        if (nullptr == mCompositorInstance)
+        {
+            OGRE_EXCEPT(Ogre::Exception::ERR_INTERNAL_ERROR, "Compositor is not supported", "PostEffectTexturePool[Attach]");
+        }
+        //referenced chain textures should be alive all the time
+        mCompositorInstance->setEnabled(true);
+        mChain = chain;
+    }
+    //-------------------------------------------------------
+    void PostEffectTexturePool::Detach()
+    {
+        if ((nullptr != mChain) && (nullptr != mCompositorInstance))
+        {
+            for (size_t idx = 0; idx < mChain->getNumCompositors(); ++idx)
+            {
+                if (mChain->getCompositor(idx) == mCompositorInstance)
+                {
+                    mChain->removeCompositor(idx);
+                    break;
+                }
+            }
+        }
+        mCompositorInstance = nullptr;
+        mChain = nullptr;
+        if (false == mCompositor.isNull())
+        {
+            Ogre::CompositorManager::getSingleton().remove(mCompositor->getName());
+            mCompositor.setNull();
+        }
+    }
+    //-------------------------------------------------------
+    void PostEffectTexturePool::Release()
+    {
+        if (false == mCompositor.isNull())
+        {
+            for (const Request & request : mRequests)
+            {
+                Ogre::CompositionTechnique* technique = request.effect->GetCompositionTechnique();
+                Ogre::CompositionTechnique::TextureDefinition* def = (nullptr != technique) ? technique->getTextureDefinition(request.name) : nullptr;
+                if ((nullptr != def) && (def->refCompName == mCompositor->getName()))
+                {
+                    def->refCompName.clear();
+                    def->refTexName.clear();
+                }
+            }
+        }
+        Detach();
+        mRequests.clear();
+        mSlots.clear();
+    }
+
+}//namespace OgreEffect
@@ -0,0 +1,184 @@
+/**
+* @file PostEffectTexturePool.h
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+#ifndef _POSTEFFECT_TEXTURE_POOL_H_
+#define _POSTEFFECT_TEXTURE_POOL_H_
+
+#include <OgrePrerequisites.h>
+#include <OgrePixelFormat.h>
+#include <OgreCompositor.h>
+
+namespace Ogre
+{
+    class CompositorChain;
+    class CompositorInstance;
+}
+
+namespace OgreEffect
+{
+
+    class PostEffect;
+
+    /**
+     * Chain-wide render targets allocator
+     * Collects texture definitions of all effects in a compositors chain, computes their lifetimes
+     * in terms of compositor target passes and aliases definitions with equal size and format and
+     * non overlapping lifetimes onto a shared set of chain scope textures
+     * Relative sized definitions are aliased only with the ones having the same size factors
+     *
+     * The pool textures are owned by a pass-through compositor placed at the beginning of the chain;
+     * the effects' definitions are turned into references to them
+     */
+    class PostEffectTexturePool
+    {
+    public:
+        struct MemoryReport
+        {
+            size_t texturesNumber = 0; ///< number of aliased texture definitions
+            size_t slotsNumber = 0;    ///< number of textures actually allocated by the pool
+            size_t naiveBytes = 0;     ///< memory required without aliasing
+            size_t pooledBytes = 0;    ///< memory allocated by the pool
+            size_t peakBytes = 0;      ///< maximum memory of the textures alive at the same pass
+            size_t sceneCopiesNumber = 0; ///< number of effects keeping the input scene after their first pass
+        };
+        //-------------------------------------------------------
+
+    private:
+        using PassesVector = Ogre::vector<size_t>::type;
+
+        struct Request
+        {
+            PostEffect* effect;
+            Ogre::String name;   ///< local texture definition name
+            size_t width;        ///< 0 if the size is relative
+            size_t height;
+            Ogre::Real widthFactor;
+            Ogre::Real heightFactor;
+            Ogre::PixelFormat format;
+            PassesVector passes; ///< sorted global indices of the target passes where the texture is alive
+            size_t slot;
+        };
+
+        struct Slot
+        {
+            Ogre::String name;
+            size_t width;
+            size_t height;
+            Ogre::Real widthFactor;
+            Ogre::Real heightFactor;
+            Ogre::PixelFormat format;
+            PassesVector passes; ///< union of passes of the aliased requests
+        };
+        //-------------------------------------------------------
+
+        const Ogre::String mName;
+        const bool mZeroCopyInput;
+
+        Ogre::vector<Request>::type mRequests;
+        Ogre::vector<Slot>::type mSlots;
+
+        size_t mPassesCounter = 0;
+        //global indices of the output passes of the added effects
+        PassesVector mOutputPasses;
+        size_t mSceneCopiesCounter = 0;
+        MemoryReport mReport;
+
+        //size of the target for computing memory of the relative sized textures
+        size_t mTargetWidth = 0;
+        size_t mTargetHeight = 0;
+
+        Ogre::CompositorPtr mCompositor;
+        Ogre::CompositorInstance* mCompositorInstance = nullptr;
+        Ogre::CompositorChain* mChain = nullptr;
+        //-------------------------------------------------------
+
+        static size_t GetTextureSize(size_t width, size_t height, Ogre::PixelFormat format);
+
+        //Memory of a texture with the possibly relative size
+        size_t GetTextureSize(size_t width, size_t height, Ogre::Real widthFactor, Ogre::Real heightFactor, Ogre::PixelFormat format) const;
+
+        //Check if two sorted sets of passes have common elements
+        static bool Intersect(const PassesVector & lhs, const PassesVector & rhs);
+
+        //Assign pool slots to the collected requests
+        void AssignSlots();
+        //Compute memory statistics
+        void ComputeReport();
+        //Create the compositor holding pool textures and redirect effects' definitions to them
+        void CreatePoolCompositor();
+
+        PostEffectTexturePool(const PostEffectTexturePool&) = delete;
+        PostEffectTexturePool(const PostEffectTexturePool&&) = delete;
+        PostEffectTexturePool& operator=(const PostEffectTexturePool&) = delete;
+        PostEffectTexturePool& operator=(const PostEffectTexturePool&&) = delete;
+        //-------------------------------------------------------
+
+    public:
+        /**
+         * @param name Unique name of the pool; Is used for the pool compositor and textures
+         * @param zeroCopyInput If true then an effect's scene input is considered alive only from the pass 
+         *     writing the previous output into it to the last pass reading it; Otherwise the input is 
+         *     considered alive from the beginning of the chain
+         */
+        PostEffectTexturePool(const Ogre::String & name, bool zeroCopyInput = true);
+
+        ~PostEffectTexturePool();
+
+        /**
+         * Register texture definitions of the effect
+         * Effects should be added in the same order as they are placed in the chain
+         * The effect compositor should be built, but not added to the chain yet
+         */
+        void AddEffect(PostEffect* effect);
+
+        /**
+         * Alias compatible textures and create the pool compositor
+         * Should be called after all effects are added and before they are attached to the chain
+         * @param targetWidth width of the chain's target; Is used for the memory report only
+         * @param targetHeight height of the chain's target; Is used for the memory report only
+         */
+        void Allocate(size_t targetWidth, size_t targetHeight);
+
+        /**
+         * Update the memory report after the target has been resized
+         * The relative sized textures are reallocated by the compositor chain
+         */
+        void NotifyResized(size_t targetWidth, size_t targetHeight);
+
+        /**
+         * Add the pool compositor to the beginning of the chain
+         */
+        void Attach(Ogre::CompositorChain* chain);
+
+        /**
+         * Remove the pool compositor from the chain and free textures
+         */
+        void Detach();
+
+        /**
+         * Restore the effects' texture definitions and detach the pool
+         * Is used to reallocate textures when the effects are rebuilt; The effects should be detached already
+         */
+        void Release();
+
+        const MemoryReport & GetMemoryReport() const
+        {
+            return mReport;
+        }
+
+        const Ogre::String & GetName() const
+        {
+            return mName;
+        }
+    };
+
+}//namespace OgreEffect
+
+#endif //_POSTEFFECT_TEXTURE_POOL_H_
@@ -0,0 +1,98 @@
+/**
+* @file PostEffectUniform.cpp
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+#include "PostEffectUniform.h"
+
+#include <algorithm>
+
+namespace OgreEffect
+{
+
+    const size_t PostEffectUniform::MAX_SIZE;
+    PostEffectUniform::Statistics PostEffectUniform::msStatistics;
+    //-------------------------------------------------------
+
+    bool PostEffectUniform::Bind(const Ogre::GpuProgramParametersSharedPtr & params, const Ogre::String & name)
+    {
+        Unbind();
+        if (params.isNull())
+        {
+            return false;
+        }
+        const Ogre::GpuConstantDefinition* definition = params->_findNamedConstantDefinition(name, false);
+        if ((nullptr == definition) || (false == definition->isFloat()))
+        {
+            return false;
+        }
+        mParams = params;
+        mPhysicalIndex = definition->physicalIndex;
+        mSize = std::min(definition->elementSize, MAX_SIZE);
+        //components which are not set keep the values of the material
+        const float* current = params->getFloatPointer(mPhysicalIndex);
+        std::copy(current, current + mSize, mShadow);
+        return true;
+    }
+    //-------------------------------------------------------
+    void PostEffectUniform::Unbind()
+    {
+        mParams.setNull();
+        mPhysicalIndex = 0;
+        mSize = 0;
+        mWritten = false;
+    }
+    //-------------------------------------------------------
+    void PostEffectUniform::Write(const float* values, size_t count)
+    {
+        if (0 == mSize)
+        {
+            return;
+        }
+        count = std::min(count, mSize);
+        if ((true == mWritten) && (true == std::equal(values, values + count, mShadow)))
+        {
+            ++msStatistics.skips;
+            return;
+        }
+        std::copy(values, values + count, mShadow);
+        mParams->_writeRawConstants(mPhysicalIndex, mShadow, mSize);
+        mWritten = true;
+        ++msStatistics.uploads;
+    }
+    //-------------------------------------------------------
+    void PostEffectUniform::Set(Ogre::Real value)
+    {
+        const float values[1] = { static_cast<float>(value) };
+        Write(values, 1);
+    }
+    //-------------------------------------------------------
+    void PostEffectUniform::Set(const Ogre::Vector2 & value)
+    {
+        const float values[2] = { static_cast<float>(value.x), static_cast<float>(value.y) };
+        Write(values, 2);
+    }
+    //-------------------------------------------------------
+    void PostEffectUniform::Set(const Ogre::Vector3 & value)
+    {
+        const float values[3] = { static_cast<float>(value.x), static_cast<float>(value.y), static_cast<float>(value.z) };
+        Write(values, 3);
+    }
+    //-------------------------------------------------------
+    void PostEffectUniform::Set(const Ogre::Vector4 & value)
+    {
+        const float values[4] = { static_cast<float>(value.x), static_cast<float>(value.y), static_cast<float>(value.z), static_cast<float>(value.w) };
+        Write(values, 4);
+    }
+    //-------------------------------------------------------
+    void PostEffectUniform::Set(const Ogre::ColourValue & value)
+    {
+        Write(value.ptr(), 4);
+    }
+
+}//namespace OgreEffect
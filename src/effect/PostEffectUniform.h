@@ -0,0 +1,97 @@
+/**
+* @file PostEffectUniform.h
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+#ifndef _POSTEFFECT_UNIFORM_H_
+#define _POSTEFFECT_UNIFORM_H_
+
+#include <OgrePrerequisites.h>
+#include <OgreGpuProgramParams.h>
+#include <OgreVector2.h>
+#include <OgreVector3.h>
+#include <OgreVector4.h>
+#include <OgreColourValue.h>
+
+namespace OgreEffect
+{
+
+    /**
+     * Binding of a float uniform of a material pass
+     * The constant is looked up by name once, when the binding is created; Values are written to the
+     * parameters by the physical index and only if they differ from the last written value
+     *
+     * A binding refers to the parameters of one material copy; Bind it again when the compositor
+     * instance recreates its materials
+     */
+    class PostEffectUniform
+    {
+    public:
+        struct Statistics
+        {
+            size_t uploads = 0;  ///< values written to the parameters
+            size_t skips = 0;    ///< values equal to the written ones
+        };
+        //-------------------------------------------------------
+
+    private:
+        static const size_t MAX_SIZE = 4;
+        //-------------------------------------------------------
+
+        static Statistics msStatistics;
+        //-------------------------------------------------------
+
+        Ogre::GpuProgramParametersSharedPtr mParams;
+        size_t mPhysicalIndex = 0;
+        size_t mSize = 0;           ///< number of floats of the constant; 0 if not bound
+        float mShadow[MAX_SIZE] = {};    ///< last written value
+        bool mWritten = false;
+        //-------------------------------------------------------
+
+        void Write(const float* values, size_t count);
+        //-------------------------------------------------------
+
+    public:
+        PostEffectUniform() = default;
+
+        /**
+         * Resolve the constant in the parameters
+         * @return false if the program has no such float constant, e.g. it was optimized out;
+         *         Values set to an unbound uniform are ignored
+         */
+        bool Bind(const Ogre::GpuProgramParametersSharedPtr & params, const Ogre::String & name);
+
+        /**
+         * Release the parameters
+         */
+        void Unbind();
+
+        bool IsBound() const
+        {
+            return 0 != mSize;
+        }
+
+        void Set(Ogre::Real value);
+        void Set(const Ogre::Vector2 & value);
+        void Set(const Ogre::Vector3 & value);
+        void Set(const Ogre::Vector4 & value);
+        void Set(const Ogre::ColourValue & value);
+
+        /**
+         * Total counters of all uniforms
+         * Is supposed to be used from the render thread only
+         */
+        static const Statistics & GetStatistics()
+        {
+            return msStatistics;
+        }
+    };
+
+}//namespace OgreEffect
+
+#endif //_POSTEFFECT_UNIFORM_H_
@@ -0,0 +1,211 @@
+/**
+* @file PostEffectPassGraphTest.cpp
+*
+* Copyright (c) 2015 by Gruzdev Alexey
+*
+* Code covered by the MIT License
+* The authors make no representations about the suitability of this software
+* for any purpose. It is provided "as is" without express or implied warranty.
+*/
+
+#include <iostream>
+
+#include "PostEffectPassGraph.h"
+
+#include <OgreException.h>
+
+/**
+ * Checks of the pass graph validation, culling, scheduling and textures sharing
+ * The graph doesn't touch the render system, so the test runs without a GPU and a window
+ * Returns the number of the failed checks
+ */
+
+namespace
+{
+    using OgreEffect::PostEffectPassGraph;
+    using StringsVector = Ogre::vector<Ogre::String>::type;
+
+    size_t gFailedChecks = 0;
+
+    void Check(bool condition, const char* expression, const char* test, int line)
+    {
+        if (false == condition)
+        {
+            std::cerr << test << ":" << line << ": check failed: " << expression << std::endl;
+            ++gFailedChecks;
+        }
+    }
+
+    #define CHECK(condition) Check((condition), #condition, __FUNCTION__, __LINE__)
+
+    //Compile the graph expecting an exception with the code and the text in the description
+    void CheckCompileThrows(const PostEffectPassGraph & graph, int code, const Ogre::String & text, const char* test)
+    {
+        try
+        {
+            graph.Compile("Test");
+        }
+        catch (const Ogre::Exception & e)
+        {
+            Check(code == e.getNumber(), "code == e.getNumber()", test, __LINE__);
+            Check(Ogre::String::npos != e.getDescription().find(text), ("'" + text + "' in the description").c_str(), test, __LINE__);
+            return;
+        }
+        Check(false, "Compile() throws", test, __LINE__);
+    }
+    //-------------------------------------------------------
+
+    void TestUnknownResource()
+    {
+        PostEffectPassGraph graph;
+        graph.AddPass("Material", { "Missing" }, PostEffectPassGraph::RESOURCE_OUTPUT);
+        CheckCompileThrows(graph, Ogre::Exception::ERR_ITEM_NOT_FOUND, "unknown resource 'Missing'", __FUNCTION__);
+
+        PostEffectPassGraph undeclaredOutput;
+        undeclaredOutput.AddPass("Material", { PostEffectPassGraph::RESOURCE_SCENE }, "Missing");
+        undeclaredOutput.AddPass("Material", { PostEffectPassGraph::RESOURCE_SCENE }, PostEffectPassGraph::RESOURCE_OUTPUT);
+        CheckCompileThrows(undeclaredOutput, Ogre::Exception::ERR_ITEM_NOT_FOUND, "invalid resource 'Missing'", __FUNCTION__);
+    }
+
+    void TestMultiplyWrittenResource()
+    {
+        PostEffectPassGraph graph;
+        graph.AddRelativeResource("A", 1.0f, 1.0f);
+        graph.AddPass("First", { PostEffectPassGraph::RESOURCE_SCENE }, "A");
+        graph.AddPass("Second", { PostEffectPassGraph::RESOURCE_SCENE }, "A");
+        graph.AddPass("Blend", { "A" }, PostEffectPassGraph::RESOURCE_OUTPUT);
+        CheckCompileThrows(graph, Ogre::Exception::ERR_DUPLICATE_ITEM, "written already", __FUNCTION__);
+
+        PostEffectPassGraph outputs;
+        outputs.AddPass("First", { PostEffectPassGraph::RESOURCE_SCENE }, PostEffectPassGraph::RESOURCE_OUTPUT);
+        outputs.AddPass("Second", { PostEffectPassGraph::RESOURCE_SCENE }, PostEffectPassGraph::RESOURCE_OUTPUT);
+        CheckCompileThrows(outputs, Ogre::Exception::ERR_DUPLICATE_ITEM, "output written already", __FUNCTION__);
+    }
+
+    void TestSelfRead()
+    {
+        PostEffectPassGraph graph;
+        graph.AddRelativeResource("A", 1.0f, 1.0f);
+        graph.AddPass("Feedback", { PostEffectPassGraph::RESOURCE_SCENE, "A" }, "A");
+        graph.AddPass("Blend", { "A" }, PostEffectPassGraph::RESOURCE_OUTPUT);
+        CheckCompileThrows(graph, Ogre::Exception::ERR_INVALIDPARAMS, "reads its own output", __FUNCTION__);
+    }
+
+    void TestMissingOutput()
+    {
+        PostEffectPassGraph graph;
+        graph.AddRelativeResource("A", 1.0f, 1.0f);
+        graph.AddPass("Material", { PostEffectPassGraph::RESOURCE_SCENE }, "A");
+        CheckCompileThrows(graph, Ogre::Exception::ERR_INVALID_STATE, "No pass writes the output", __FUNCTION__);
+    }
+
+    void TestCycle()
+    {
+        PostEffectPassGraph graph;
+        graph.AddRelativeResource("A", 1.0f, 1.0f);
+        graph.AddRelativeResource("B", 1.0f, 1.0f);
+        graph.AddPass("First", { "B" }, "A");
+        graph.AddPass("Second", { "A" }, "B");
+        graph.AddPass("Blend", { "A" }, PostEffectPassGraph::RESOURCE_OUTPUT);
+        CheckCompileThrows(graph, Ogre::Exception::ERR_INVALID_STATE, "cyclic dependency", __FUNCTION__);
+    }
+
+    void TestCulling()
+    {
+        PostEffectPassGraph graph;
+        graph.AddRelativeResource("A", 0.5f, 0.5f);
+        graph.AddRelativeResource("Unused", 0.5f, 0.5f);
+        graph.AddRelativeResource("UnusedToo", 0.25f, 0.25f);
+        graph.AddPass("Down", { PostEffectPassGraph::RESOURCE_SCENE }, "A");
+        graph.AddPass("Debug", { PostEffectPassGraph::RESOURCE_SCENE }, "Unused");
+        graph.AddPass("DebugToo", { "Unused" }, "UnusedToo");
+        graph.AddPass("Blend", { PostEffectPassGraph::RESOURCE_SCENE, "A" }, PostEffectPassGraph::RESOURCE_OUTPUT);
+
+        const PostEffectPassGraph::CompiledGraph compiled = graph.Compile("Test");
+        CHECK(2 == compiled.culledPassesNumber);
+        CHECK(2 == compiled.passes.size());
+        CHECK(1 == compiled.textures.size());
+        for (const PostEffectPassGraph::CompiledPass & pass : compiled.passes)
+        {
+            CHECK(("Debug" != pass.material) && ("DebugToo" != pass.material));
+        }
+    }
+
+    void TestScheduleOrder()
+    {
+        //passes are declared in the reverse order
+        PostEffectPassGraph graph;
+        graph.AddRelativeResource("A", 0.5f, 0.5f);
+        graph.AddRelativeResource("B", 0.5f, 0.5f);
+        graph.AddPass("Blend", { PostEffectPassGraph::RESOURCE_SCENE, "B" }, PostEffectPassGraph::RESOURCE_OUTPUT);
+        graph.AddPass("Blur", { "A" }, "B");
+        graph.AddPass("Down", { PostEffectPassGraph::RESOURCE_SCENE }, "A");
+
+        const PostEffectPassGraph::CompiledGraph compiled = graph.Compile("Test");
+        CHECK(3 == compiled.passes.size());
+        if (3 == compiled.passes.size())
+        {
+            CHECK((2 == compiled.passes[0].pass) && ("Down" == compiled.passes[0].material));
+            CHECK((1 == compiled.passes[1].pass) && ("Blur" == compiled.passes[1].material));
+            CHECK((0 == compiled.passes[2].pass) && ("Blend" == compiled.passes[2].material));
+            CHECK(PostEffectPassGraph::RESOURCE_OUTPUT == compiled.passes[2].output);
+            //inputs are resolved to the compiled textures, external ones are kept
+            CHECK(compiled.passes[0].output == compiled.passes[1].inputs[0]);
+            CHECK(compiled.passes[1].output == compiled.passes[2].inputs[1]);
+            CHECK(PostEffectPassGraph::RESOURCE_SCENE == compiled.passes[2].inputs[0]);
+        }
+    }
+
+    void TestTexturesSharing()
+    {
+        //A is dead when C is written, so they share a texture; B overlaps both
+        PostEffectPassGraph graph;
+        graph.AddRelativeResource("A", 0.5f, 0.5f);
+        graph.AddRelativeResource("B", 0.5f, 0.5f);
+        graph.AddRelativeResource("C", 0.5f, 0.5f);
+        graph.AddRelativeResource("D", 0.5f, 0.5f, Ogre::PF_FLOAT16_RGBA);
+        graph.AddPass("First", { PostEffectPassGraph::RESOURCE_SCENE }, "A");
+        graph.AddPass("Second", { "A" }, "B");
+        graph.AddPass("Third", { "B" }, "C");
+        graph.AddPass("Fourth", { "C" }, "D");
+        graph.AddPass("Blend", { PostEffectPassGraph::RESOURCE_SCENE, "D" }, PostEffectPassGraph::RESOURCE_OUTPUT);
+
+        const PostEffectPassGraph::CompiledGraph compiled = graph.Compile("Test");
+        CHECK(5 == compiled.passes.size());
+        //D has another format, so it gets its own texture though B is free already
+        CHECK(3 == compiled.textures.size());
+        CHECK(1 == compiled.sharedResourcesNumber);
+        if (5 == compiled.passes.size())
+        {
+            CHECK(compiled.passes[0].output == compiled.passes[2].output);
+            CHECK(compiled.passes[0].output != compiled.passes[1].output);
+            CHECK(compiled.passes[1].output != compiled.passes[2].output);
+            CHECK(compiled.passes[3].output != compiled.passes[1].output);
+        }
+        for (const PostEffectPassGraph::CompiledTexture & texture : compiled.textures)
+        {
+            CHECK(0 == texture.name.find("Test/"));
+            CHECK(texture.firstPass <= texture.lastPass);
+        }
+    }
+}
+
+int main()
+{
+    TestUnknownResource();
+    TestMultiplyWrittenResource();
+    TestSelfRead();
+    TestMissingOutput();
+    TestCycle();
+    TestCulling();
+    TestScheduleOrder();
+    TestTexturesSharing();
+
+    if (0 != gFailedChecks)
+    {
+        std::cerr << gFailedChecks << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed" << std::endl;
+    return 0;
+}